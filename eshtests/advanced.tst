@@ -7,3 +7,20 @@
 5 advanced/io_and_pipes.py
 5 advanced/pipe_job_cntl.py
 10 advanced/exclusive_access_test.py
+5 advanced/heredoc_test.py
+5 advanced/jobslots_test.py
+5 advanced/coproc_test.py
+5 advanced/long_pipe_fd_test.py
+5 advanced/subst_test.py
+5 advanced/env_test.py
+5 advanced/glob_test.py
+5 advanced/batch_test.py
+5 advanced/joboutput_test.py
+5 advanced/group_test.py
+5 advanced/placement_test.py
+5 advanced/sched_test.py
+5 advanced/context_threads_test.py
+5 advanced/headless_test.py
+5 advanced/script_cache_test.py
+5 advanced/lineedit_test.py
+5 advanced/parse_batch_test.py
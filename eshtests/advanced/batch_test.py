@@ -0,0 +1,38 @@
+#!/usr/bin/python
+from testutil import *
+import tempfile, shutil
+
+setup_tests()
+
+d = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, d)
+out = os.path.join(d, 'out')
+
+message = '''Test that an argv over ARG_MAX is split into several
+invocations when prefixed with batch:
+batch echo $(seq 400000) > OUT
+wc -w < OUT'''
+
+sendline('batch echo $(seq 400000) > %s' % out)
+expect_prompt(message)
+
+sendline('wc -w < %s' % out)
+expect_exact('400000', message)
+expect_prompt(message)
+
+message = '''Test that a small argv runs as a single invocation:
+batch -P 2 echo $(seq 3) end'''
+
+sendline('batch -P 2 echo $(seq 3) end')
+expect_exact('1 2 3 end', message)
+expect_prompt(message)
+
+message = '''Test that the options of batch may come from a command
+substitution:
+batch -P $(echo 2) echo $(seq 3) end'''
+
+sendline('batch -P $(echo 2) echo $(seq 3) end')
+expect_exact('1 2 3 end', message)
+expect_prompt(message)
+
+test_success()
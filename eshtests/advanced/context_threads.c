@@ -0,0 +1,167 @@
+/*
+ * Runs N shell contexts at once, each on a thread of its own, for
+ * context_threads_test.py.
+ *
+ *      context_threads [N]
+ *
+ * Each context gets files of its own as stdout and stderr, runs a few
+ * command lines with external commands, builtins and background jobs,
+ * and polls until its jobs are done.  Then every context's output must
+ * hold what it ran and nothing another context ran, its errors must be
+ * on its stderr, and no child may be left unreaped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "esh.h"
+#include "esh-context.h"
+
+struct run {
+    pthread_t thread;
+    int id;
+    FILE *out, *err;
+    int exit_status;
+    bool exited;
+    bool jobs_left;
+};
+
+static const char *lines[] = {
+    "echo out %d",
+    "sleep 0.%d &",
+    "jobs",
+    "echo $(echo sub %d) | tr a-z A-Z",
+    "bgsched",
+    "jobs -o 99",
+    "kill 99",
+    NULL
+};
+
+static void *
+run_context(void *arg)
+{
+    struct run *r = arg;
+    struct esh_context *ctx = esh_context_create(0);
+    char line[64];
+    int i;
+
+    esh_context_set_io(ctx, 0, fileno(r->out), fileno(r->err));
+    for (i = 0; lines[i] != NULL; i++) {
+        snprintf(line, sizeof line, lines[i], r->id % 10 + 1);
+        struct esh_command_line *cline = esh_context_parse(ctx, line);
+        if (cline == NULL)
+            continue;
+        esh_context_run(ctx, cline);
+        esh_command_line_free(cline);
+    }
+
+    /* the background job leaves the list once it is reaped */
+    for (i = 0; i < 300 && !list_empty(esh_context_jobs(ctx)); i++) {
+        usleep(10000);
+        esh_context_poll(ctx);
+    }
+    r->jobs_left = !list_empty(esh_context_jobs(ctx));
+
+    struct esh_command_line *cline = esh_context_parse(ctx, "exit 7");
+    esh_context_run(ctx, cline);
+    esh_command_line_free(cline);
+    r->exited = esh_context_exited(ctx, &r->exit_status);
+    esh_context_destroy(ctx);
+    return NULL;
+}
+
+/* All that was written to 'f' */
+static char *
+contents(FILE *f)
+{
+    long len = ftell(f);
+    char *buf = calloc(1, len + 1);
+    if (buf != NULL)
+        pread(fileno(f), buf, len, 0);
+    return buf;
+}
+
+static int failures;
+
+static void
+check(struct run *r, const char *what, const char *text, const char *want, bool present)
+{
+    if ((strstr(text, want) != NULL) != present) {
+        printf("context %d: %s %s %s:\n%s\n", r->id, what,
+               present ? "lacks" : "has", want, text);
+        failures++;
+    }
+}
+
+int
+main(int ac, char *av[])
+{
+    int n = ac > 1 ? atoi(av[1]) : 8, i;
+    struct run *runs = calloc(n, sizeof *runs);
+
+    for (i = 0; i < n; i++) {
+        runs[i].id = i;
+        runs[i].out = tmpfile();
+        runs[i].err = tmpfile();
+        if (runs[i].out == NULL || runs[i].err == NULL) {
+            perror("tmpfile");
+            return EXIT_FAILURE;
+        }
+        pthread_create(&runs[i].thread, NULL, run_context, &runs[i]);
+    }
+    for (i = 0; i < n; i++)
+        pthread_join(runs[i].thread, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct run *r = &runs[i];
+        char want[64];
+        fseek(r->out, 0, SEEK_END);
+        fseek(r->err, 0, SEEK_END);
+        char *out = contents(r->out), *err = contents(r->err);
+        int other = (r->id + 1) % 10 + 1;
+
+        snprintf(want, sizeof want, "out %d\n", r->id % 10 + 1);
+        check(r, "stdout", out, want, true);
+        snprintf(want, sizeof want, "SUB %d\n", r->id % 10 + 1);
+        check(r, "stdout", out, want, true);
+        snprintf(want, sizeof want, "(sleep 0.%d &)", r->id % 10 + 1);
+        check(r, "stdout", out, want, true);
+        check(r, "stdout", out, "Running", true);
+        check(r, "stdout", out, "bgsched: normal nice=0 io=none\n", true);
+        if (other != r->id % 10 + 1) {
+            snprintf(want, sizeof want, "out %d\n", other);
+            check(r, "stdout", out, want, false);
+        }
+        check(r, "stdout", out, "no captured output", false);
+        check(r, "stdout", out, "kill", false);
+        check(r, "stderr", err, "jobs: 99: no captured output\n", true);
+        check(r, "stderr", err, "kill: (99)", true);
+
+        if (r->jobs_left) {
+            printf("context %d: jobs left after polling\n", r->id);
+            failures++;
+        }
+        if (!r->exited || r->exit_status != 7) {
+            printf("context %d: exit 7 not seen\n", r->id);
+            failures++;
+        }
+        free(out);
+        free(err);
+        fclose(r->out);
+        fclose(r->err);
+    }
+    free(runs);
+
+    /* every context reaped its own children */
+    if (waitpid(-1, NULL, WNOHANG) != -1 || errno != ECHILD) {
+        printf("children left unreaped\n");
+        failures++;
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#!/usr/bin/python
+from testutil import *
+import testutil
+import subprocess
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+message = '''Test that shell contexts running on threads of their own keep
+their output, errors and children apart: context_threads 16, built
+with make in the directory of the shell'''
+
+srcdir = os.path.dirname(os.path.abspath(settings_module.shell.split()[0]))
+driver = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'context_threads')
+subprocess.check_call(['make', '-s', '-C', srcdir, os.path.relpath(driver, srcdir)])
+
+p = subprocess.Popen([driver, '16'], stdout=subprocess.PIPE)
+out = p.communicate()[0]
+assert p.returncode == 0 and out.strip().endswith('PASS'), message + '\n' + out
+
+test_success()
@@ -0,0 +1,45 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+message = '''Test that a coprocess is started as a background job and
+that later commands can talk to it:
+coproc up sed -u s/^/got:/
+echo hello >%up
+head -n 1 <%up'''
+
+sendline('coproc up sed -u s/^/got:/')
+job = parse_bg_status()
+expect_prompt(message)
+
+sendline('echo hello >%up')
+expect_prompt(message)
+
+sendline('head -n 1 <%up')
+expect('got:hello', message)
+expect_prompt(message)
+
+run_builtin('jobs')
+expect('Running', message)
+expect_prompt(message)
+
+message = '''Test that the coprocess is forgotten once its job is killed,
+and that %up then names a file:
+echo hello >%up
+cat <%up'''
+
+run_builtin('kill', job.job_id)
+expect_prompt(message)
+time.sleep(0.5)
+
+atexit.register(lambda: os.path.exists('%up') and os.remove('%up'))
+sendline('echo hello >%up')
+expect_prompt(message)
+assert open('%up').read() == 'hello\n', message
+
+sendline('cat <%up')
+expect_exact('hello', message)
+expect_prompt(message)
+
+test_success()
@@ -0,0 +1,40 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+message = '''Test that export sets a variable seen by later commands:
+export ESH_T1=one
+printenv ESH_T1'''
+
+sendline('export ESH_T1=one')
+expect_prompt(message)
+
+sendline('printenv ESH_T1')
+expect('one', message)
+expect_prompt(message)
+
+message = '''Test that a VAR=value prefix applies to that command only:
+ESH_T1=two printenv ESH_T1
+printenv ESH_T1'''
+
+sendline('ESH_T1=two printenv ESH_T1')
+expect('two', message)
+expect_prompt(message)
+
+sendline('printenv ESH_T1')
+expect('one', message)
+expect_prompt(message)
+
+message = '''Test that unset removes the variable:
+unset ESH_T1
+printenv ESH_T1 ; echo gone'''
+
+sendline('unset ESH_T1')
+expect_prompt(message)
+
+sendline('printenv ESH_T1 ; echo gone')
+expect_exact('gone', message)
+expect_prompt(message)
+
+test_success()
@@ -0,0 +1,41 @@
+#!/usr/bin/python
+from testutil import *
+import tempfile, shutil
+
+setup_tests()
+
+d = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, d)
+for f in ['b.c', 'a.c', 'c.h', '.hidden.c', 'sub/x.c']:
+    if '/' in f:
+        os.mkdir(os.path.join(d, os.path.dirname(f)))
+    open(os.path.join(d, f), 'w').close()
+
+message = '''Test that a pattern expands to the sorted matching paths,
+skipping dot files:
+echo DIR/*.c'''
+
+sendline('echo %s/*.c' % d)
+expect_exact('%s/a.c %s/b.c' % (d, d), message)
+expect_prompt(message)
+
+message = '''Test classes and patterns in directory components:
+echo DIR/?.[ch] DIR/*/x.c'''
+
+sendline('echo %s/?.[ch] %s/*/x.c' % (d, d))
+expect_exact('%s/a.c %s/b.c %s/c.h %s/sub/x.c' % (d, d, d, d), message)
+expect_prompt(message)
+
+message = '''Test that a new file shows up and a pattern without matches
+is left as is:
+touch DIR/d.c
+echo DIR/*.c DIR/*.none'''
+
+sendline('touch %s/d.c' % d)
+expect_prompt(message)
+
+sendline('echo %s/*.c %s/*.none' % (d, d))
+expect_exact('%s/a.c %s/b.c %s/d.c %s/*.none' % (d, d, d, d), message)
+expect_prompt(message)
+
+test_success()
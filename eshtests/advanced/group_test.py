@@ -0,0 +1,49 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+outfile = tempfile.mktemp()
+
+message = '''Test that a brace group redirects as a unit:
+{ echo first; echo second; } > FILE'''
+
+sendline('{ echo first; echo second; } > ' + outfile)
+expect_prompt(message)
+sendline('cat ' + outfile)
+expect('first\r\nsecond', message)
+expect_prompt(message)
+
+message = '''Test a brace group as a stage of a pipeline:
+{ echo a; echo b; echo c; } | wc -l'''
+
+sendline('{ echo a; echo b; echo c; } | wc -l')
+expect('3', message)
+expect_prompt(message)
+
+message = '''Test that a subshell is one job for stop, jobs and fg:
+( sleep 1; echo subshell done )'''
+
+sendline('( sleep 1; echo subshell done )')
+time.sleep(0.5)
+sendcontrol('z')
+expect_prompt(message)
+
+run_builtin('jobs')
+job = parse_job_line()
+assert job.status == 'stopped', message
+expect_prompt(message)
+
+run_builtin('fg', str(job.id))
+expect('\nsubshell done', message)
+expect_prompt(message)
+
+message = '''Test that '}' after a command is a word, not the end of a group:
+echo }'''
+
+sendline('echo }')
+expect('}', message)
+expect_prompt(message)
+
+os.unlink(outfile)
+test_success()
@@ -0,0 +1,69 @@
+#!/usr/bin/python
+#
+# Checks that esh runs headless where there is no terminal: started
+# with setsid(1), so that it has no controlling terminal, and with
+# commands piped into stdin, as under a container runtime or systemd.
+#
+# It runs a pipeline and a background job, once as detected and once
+# forced with -n -g (process groups still on).  Each run must exit 0,
+# print nothing on stderr and produce the commands' output.  ttytrap.c,
+# preloaded, logs every call of tcsetpgrp and tcsetattr; there must be
+# none.
+#
+from testutil import *
+import testutil
+import subprocess
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+esh = os.path.abspath(settings_module.shell.split()[0])
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+trap = os.path.join(tmpdir, "ttytrap.so")
+subprocess.check_call(["cc", "-shared", "-fPIC", "-o", trap,
+                       os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                    "ttytrap.c"), "-ldl"])
+
+commands = ("echo one two | tr o 0 | cat\n"
+            "sleep 0.2 &\n"
+            "jobs\n"
+            "sleep 0.5\n"
+            "jobs\n"
+            "echo done\n")
+
+failures = []
+
+def run(name, flags):
+    log = os.path.join(tmpdir, name + ".log")
+    env = dict(os.environ, LD_PRELOAD=trap, TTYTRAP_LOG=log)
+    p = subprocess.Popen(["setsid", "-w", esh] + flags, env=env,
+                         stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                         stderr=subprocess.PIPE)
+    out, err = p.communicate(commands.encode())
+    out, err = out.decode(), err.decode()
+    calls = open(log).read().split() if os.path.exists(log) else []
+
+    if p.returncode != 0:
+        failures.append("%s: exit status %d" % (name, p.returncode))
+    if err:
+        failures.append("%s: stderr %r" % (name, err))
+    if calls:
+        failures.append("%s: called %s" % (name, ", ".join(sorted(set(calls)))))
+    # the job is running at the first 'jobs' and reaped by the second
+    for want in ["0ne tw0\n", "[1] ", "Running", "done\n"]:
+        if want not in out:
+            failures.append("%s: no %r in output %r" % (name, want, out))
+    if out.count("Running") != 1:
+        failures.append("%s: background job not reaped: %r" % (name, out))
+
+run("detected", [])
+run("forced", ["-n", "-g"])
+
+message = '''Test that esh runs headless, without a controlling terminal and
+with commands on stdin, as detected and with -n -g:
+''' + "\n".join(failures)
+assert not failures, message
+
+test_success()
@@ -0,0 +1,49 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+message = '''Test a here-string feeding a single command:
+rev <<< hello'''
+
+sendline('rev <<< hello')
+expect('olleh', message)
+expect_prompt(message)
+
+message = '''Test a here-document read up to its delimiter:
+cat << EOF'''
+
+sendline('cat << EOF')
+sendline('first line')
+sendline('second line')
+sendline('EOF')
+expect('first line\r\nsecond line', message)
+expect_prompt(message)
+
+message = '''Test a here-document as input of the first stage of a pipe:
+wc -c << EOF | rev'''
+
+sendline('wc -c << EOF | rev')
+sendline('abc')
+sendline('EOF')
+expect('4', message)
+expect_prompt(message)
+
+message = '''Test that mixing < and <<< is rejected as ambiguous'''
+
+sendline('cat < /dev/null <<< x')
+expect('Ambiguous input redirect.', message)
+expect_prompt(message)
+
+message = '''Test that the here-document's memfd is not leaked into the
+child beyond the standard file descriptors.
+'''
+sendline('sleep 100 <<< x &')
+job = parse_bg_status()
+
+assert_correct_fds(job.pid, message)
+expect_prompt()
+
+os.kill(int(job.pid), signal.SIGKILL)
+
+test_success()
@@ -0,0 +1,56 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+message = '''Test that the output of background jobs is captured into a
+bounded buffer and shown with jobs -o:
+joboutput capture size=1024
+seq 1 20000 &
+jobs -o %N'''
+
+sendline('joboutput capture size=1024')
+expect_prompt(message)
+
+sendline('seq 1 20000 &')
+job = parse_bg_status()
+expect_prompt(message)
+time.sleep(0.5)
+
+# the ring holds the last 1024 bytes of seq's output
+output = ''.join('%d\n' % i for i in range(1, 20001))
+sendline('jobs -o %%%d' % int(job.job_id))
+expect_exact('[%d] ... first %d bytes dropped\r\n'
+             % (int(job.job_id), len(output) - 1024), message)
+expect_exact(output[-1024:].replace('\n', '\r\n'), message)
+expect_prompt(message)
+
+message = '''Test that a background job's stderr is captured too:
+ls /nonexistent-esh-dir &
+jobs -o N'''
+
+sendline('ls /nonexistent-esh-dir &')
+job = parse_bg_status()
+expect_prompt(message)
+time.sleep(0.5)
+
+sendline('jobs -o %d' % int(job.job_id))
+expect('ls: .*nonexistent-esh-dir', message)
+expect_prompt(message)
+
+message = '''Test that streamed output reaches the terminal, prefixed
+with the job id:
+joboutput stream
+echo streamed &'''
+
+sendline('joboutput stream')
+expect_prompt(message)
+
+sendline('echo streamed &')
+job = parse_bg_status()
+expect(r'\[%s\] streamed' % job.job_id, message)
+
+sendline('joboutput off')
+expect_prompt(message)
+
+test_success()
@@ -0,0 +1,57 @@
+#!/usr/bin/python
+from testutil import *
+import testutil
+
+setup_tests()
+
+message = '''Test that background jobs beyond the job slot limit are queued
+and started once a slot frees up:
+jobslots 1
+sleep 1 &
+echo started &'''
+
+sendline('jobslots 1')
+expect_prompt(message)
+
+sendline('sleep 1 &')
+parse_bg_status()
+expect_prompt(message)
+
+sendline('echo started &')
+expect('queued', message)
+expect_prompt(message)
+
+run_builtin('jobs')
+expect('Running', message)
+expect('Queued', message)
+expect_prompt(message)
+
+# the queued job is launched when the sleep is reaped
+testutil.console.timeout = 4
+expect('started', message)
+
+message = '''Test that a queued job starts while a foreground job runs:
+sleep 0.5 &
+echo second &
+sleep 2'''
+
+# let the shell reap the echo
+time.sleep(0.5)
+sendline('sleep 0.5 &')
+parse_bg_status()
+expect_prompt(message)
+
+sendline('echo second &')
+expect('queued', message)
+expect_prompt(message)
+
+sendline('sleep 2')
+testutil.console.timeout = 1.8
+expect('second', message)
+testutil.console.timeout = 4
+expect_prompt(message)
+
+sendline('jobslots 0')
+expect_prompt(message)
+
+test_success()
@@ -0,0 +1,132 @@
+#!/usr/bin/python
+#
+# Checks the built-in line editor of esh -e: the editing keys, the
+# history, Tab completion and ^C.  Each line pipes its words through
+# tr a-z A-Z, so that the output in capitals is told apart from the
+# line as it is echoed while typed.
+#
+from testutil import *
+import testutil
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+sh = pexpect.spawn(settings_module.shell + ' -e', drainpty=True,
+                   logfile=sys.stdout)
+sh.timeout = 2
+assert sh.expect(settings_module.prompt) == 0, 'esh -e did not print a prompt'
+
+UP = '\x1b[A'
+LEFT = '\x1b[D'
+UPPER = ' | tr a-z A-Z'
+
+def enter(message, want, unwanted=None):
+    '''Enter the line typed so far; 'want' must be in its output,
+    'unwanted' must not'''
+    sh.send('\r')
+    assert sh.expect_exact(want) == 0, message
+    assert sh.expect(settings_module.prompt) == 0, message
+    if unwanted is not None:
+        assert unwanted not in sh.before, message
+
+message = '''Test that ^A moves to the start of the line:
+cho moved | tr a-z A-Z ^A e'''
+
+sh.send('cho moved' + UPPER)
+sh.sendcontrol('a')
+sh.send('e')
+enter(message, 'MOVED')
+
+message = '''Test that ^W deletes words back from the cursor and ^E moves to
+the end of the line:
+echo kept one two ^W ^W ^A ^E | tr a-z A-Z'''
+
+sh.send('echo kept one two')
+sh.sendcontrol('w')
+sh.sendcontrol('w')
+sh.sendcontrol('a')
+sh.sendcontrol('e')
+sh.send(UPPER)
+enter(message, 'KEPT', 'ONE')
+
+message = '''Test that ^U deletes the line up to the cursor:
+echo gone ^U echo fresh | tr a-z A-Z'''
+
+sh.send('echo gone')
+sh.sendcontrol('u')
+sh.send('echo fresh' + UPPER)
+enter(message, 'FRESH', 'GONE')
+
+message = '''Test that ^B, Left and ^K delete the end of the line, and ^F and
+^D move and delete at the cursor:
+echo back | tr a-z A-Zjunk ^B ^B Left Left ^K
+echo xfix | tr a-z A-Z ^A ^F ^F ^F ^F ^F ^D'''
+
+sh.send('echo back' + UPPER + 'junk')
+sh.sendcontrol('b')
+sh.sendcontrol('b')
+sh.send(LEFT + LEFT)
+sh.sendcontrol('k')
+enter(message, 'BACK', 'JUNK')
+
+sh.send('echo xfix' + UPPER)
+sh.sendcontrol('a')
+for i in range(5):
+    sh.sendcontrol('f')
+sh.sendcontrol('d')
+enter(message, 'FIX', 'XFIX')
+
+message = '''Test that Up and ^P go back through the history:
+Up
+^P ^P ^P'''
+
+sh.send(UP)
+enter(message, 'FIX')
+
+# FIX, BACK (the same line again is not added), then FRESH
+sh.sendcontrol('p')
+sh.sendcontrol('p')
+sh.sendcontrol('p')
+enter(message, 'FRESH')
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+open(os.path.join(tmpdir, 'lineedit_unique'), 'w').write('tabbed\n')
+open(os.path.join(tmpdir, 'lineedit_pair_a'), 'w').write('pair a\n')
+open(os.path.join(tmpdir, 'lineedit_pair_b'), 'w').write('pair b\n')
+
+message = '''Test that Tab completes a file name, and lists the candidates
+when there is nothing to add:
+cat DIR/lineedit_u Tab | tr a-z A-Z
+cat DIR/lineedit_p Tab Tab a | tr a-z A-Z'''
+
+sh.send('cat %s/lineedit_u' % tmpdir)
+sh.send('\t')
+sh.send('| tr a-z A-Z')
+enter(message, 'TABBED')
+
+sh.send('cat %s/lineedit_p' % tmpdir)
+sh.send('\t')
+sh.send('\t')
+assert sh.expect(r'lineedit_pair_[ab]  \S+/lineedit_pair_[ab]') == 0, message
+sh.send('a' + UPPER)
+enter(message, 'PAIR A', 'PAIR B')
+
+message = '''Test that ^C abandons the line, which stays on the screen
+followed by ^C:
+echo abandoned | tr a-z A-Z ^C'''
+
+sh.send('echo abandoned' + UPPER)
+sh.sendcontrol('c')
+assert sh.expect(r'\^C\r+\n') == 0, message
+assert sh.expect(settings_module.prompt) == 0, message
+sh.sendline('echo after' + UPPER)
+assert sh.expect_exact('AFTER') == 0, message
+assert 'ABANDONED' not in sh.before, message
+assert sh.expect(settings_module.prompt) == 0, message
+
+sh.sendline('exit')
+assert sh.expect(pexpect.EOF) == 0, 'esh -e did not exit'
+
+test_success()
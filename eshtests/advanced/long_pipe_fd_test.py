@@ -0,0 +1,46 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+def pgrp_members(pgrp):
+    '''Return the pids of all processes in process group pgrp.'''
+    pids = []
+    for pid in os.listdir('/proc'):
+        if not pid.isdigit():
+            continue
+        try:
+            with open('/proc/{0}/stat'.format(pid)) as f:
+                fields = f.read().rsplit(')', 1)[1].split()
+        except IOError:
+            continue
+        if int(fields[2]) == pgrp:
+            pids.append(pid)
+    return pids
+
+stages = 1000
+shell_fds = sorted(os.listdir('/proc/{0}/fd'.format(get_shell_pid())))
+
+message = '''Test a {0}-stage pipeline: every stage must be started, each
+must have only stdin, stdout and stderr open (the pipe ends of other
+stages must not leak into it), and the shell must not keep any pipe
+ends open once all stages are forked.
+'''.format(stages)
+
+console.timeout = 30
+sendline('sleep 100 | ' + ' | '.join(['cat'] * (stages - 2)) + ' | sleep 100 &')
+job = parse_bg_status()
+expect_prompt(message)
+time.sleep(1)
+
+members = pgrp_members(int(job.pid))
+assert len(members) == stages, message
+
+for pid in members:
+    assert_correct_fds(pid, message)
+
+assert sorted(os.listdir('/proc/{0}/fd'.format(get_shell_pid()))) == shell_fds, message
+
+os.killpg(int(job.pid), signal.SIGKILL)
+
+test_success()
@@ -0,0 +1,75 @@
+#!/usr/bin/python
+#
+# Checks that 'esh -k', which parses a script in chunks on several
+# threads, reports the same errors as a serial parse.
+#
+# The script is some hundreds of kilobytes, so that it is split into
+# many chunks (of at least 64 KiB each), with invalid lines throughout,
+# at varying columns, and as its last line without a newline.  The
+# invalid lines alone make a script small enough for one chunk: its
+# errors, renumbered to the lines of the big script, are what a serial
+# parse finds.  Both must agree in line, column and message.
+#
+from testutil import *
+import testutil
+import random, subprocess
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+esh = os.path.abspath(settings_module.shell.split()[0])
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+
+good = ["ls -l | wc -l",
+        "echo a b c > out ; cat < out &",
+        "grep foo bar baz | head -n 3 | tail -1 &",
+        "# a comment",
+        ""]
+
+def bad():
+    '''An invalid line, its error at a random column'''
+    words = " ".join(["w%d" % random.randrange(100)]
+                     * random.randrange(20))
+    return random.choice(["echo %s | | cat",
+                          "cat %s >",
+                          "  ls %s > a > b",
+                          "| ls %s",
+                          "sort %s < a < b"]) % words
+
+random.seed(3214)
+lines = []
+for i in range(40000):
+    lines.append(bad() if random.random() < 0.002 else random.choice(good))
+lines.append(bad())
+invalid = [i for i, l in enumerate(lines) if l not in good]
+
+def check(name, text):
+    '''The errors esh -k reports for 'text', as (line, column, message)'''
+    path = os.path.join(tmpdir, name)
+    open(path, "w").write(text)
+    p = subprocess.Popen([esh, "-k", path], stdout=subprocess.PIPE)
+    out = p.communicate()[0].decode()
+    errors = []
+    for l in out.splitlines():
+        line, column, msg = l[len(path) + 1:].split(":", 2)
+        errors.append((int(line), int(column), msg))
+    return p.returncode, errors
+
+status, errors = check("big.esh", "\n".join(lines))
+serial_status, serial = check("invalid.esh",
+                              "\n".join(lines[i] for i in invalid) + "\n")
+expected = [(invalid[line - 1] + 1, column, msg)
+            for line, column, msg in serial]
+
+message = '''Test that esh -k reports the line, column and message of each
+invalid line of a script of %d bytes as a serial parse does:
+got %r
+expected %r''' % (len("\n".join(lines)), errors, expected)
+
+assert len(serial) == len(invalid), message
+assert status == 1 and serial_status == 1, message
+assert errors == expected, message
+
+test_success()
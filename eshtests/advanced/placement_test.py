@@ -0,0 +1,158 @@
+#!/usr/bin/python
+from testutil import *
+import testutil
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+def cpus_allowed(pid):
+    '''The Cpus_allowed_list of process 'pid', as a set of CPUs'''
+    for line in open('/proc/%d/status' % pid):
+        if line.startswith('Cpus_allowed_list:'):
+            cpus = set()
+            for part in line.split()[1].split(','):
+                lo, _, hi = part.partition('-')
+                cpus.update(range(int(lo), int(hi or lo) + 1))
+            return cpus
+
+def pids_in_pgrp(pgrp):
+    '''The processes in process group 'pgrp' '''
+    pids = []
+    for name in os.listdir('/proc'):
+        if not name.isdigit():
+            continue
+        try:
+            stat = open('/proc/%s/stat' % name).read()
+        except IOError:
+            continue
+        if int(stat.rsplit(')', 1)[1].split()[2]) == pgrp:
+            pids.append(int(name))
+    return pids
+
+def pipeline_pids(pid):
+    '''The two processes of the background pipeline of 'pid', once
+    both have been started'''
+    pgrp = os.getpgid(int(pid))
+    for i in range(20):
+        pids = pids_in_pgrp(pgrp)
+        if len(pids) == 2:
+            return pids
+        time.sleep(0.1)
+    return pids
+
+shell_cpus = cpus_allowed(get_shell_pid())
+cpu = min(shell_cpus)
+
+message = '''Test that every command of a pipeline runs on the CPUs
+given with 'on':
+on cpus=%d sleep 30 | sleep 31 &''' % cpu
+
+sendline('on cpus=%d sleep 30 | sleep 31 &' % cpu)
+jid, pid = parse_bg_status()
+expect_prompt(message)
+
+pids = pipeline_pids(pid)
+assert len(pids) == 2, message
+for p in pids:
+    assert cpus_allowed(p) == set([cpu]), message
+
+sendline('jobs -l')
+expect_exact('cpus=%d' % cpu, message)
+expect_prompt(message)
+
+run_builtin('kill', jid)
+expect_prompt(message)
+
+message = '''Test that the commands of a pipeline without 'on' run on the
+same CPUs, among those of the shell:
+sleep 32 | sleep 33 &'''
+
+sendline('sleep 32 | sleep 33 &')
+jid, pid = parse_bg_status()
+expect_prompt(message)
+
+pids = pipeline_pids(pid)
+assert len(pids) == 2, message
+assert cpus_allowed(pids[0]) == cpus_allowed(pids[1]), message
+assert cpus_allowed(pids[0]) <= shell_cpus, message
+
+run_builtin('kill', jid)
+expect_prompt(message)
+
+message = '''Test that the placement words of 'on' may come from a command
+substitution:
+on $(echo cpus=%d) sleep 34 &''' % cpu
+
+sendline('on $(echo cpus=%d) sleep 34 &' % cpu)
+jid, pid = parse_bg_status()
+expect_prompt(message)
+assert cpus_allowed(int(pid)) == set([cpu]), message
+
+run_builtin('kill', jid)
+expect_prompt(message)
+
+def cpu_list(cpus):
+    return ','.join(str(c) for c in sorted(cpus))
+
+def fake_sysfs(root, domains):
+    '''Describe, under 'root', CPUs whose last-level (L3) caches are
+    shared within each of 'domains', a list of sets of CPUs'''
+    for domain in domains:
+        for cpu in domain:
+            for index, level, shared in [(0, 1, [cpu]), (1, 3, domain)]:
+                d = os.path.join(root, 'devices/system/cpu/cpu%d/cache/index%d'
+                                 % (cpu, index))
+                os.makedirs(d)
+                open(os.path.join(d, 'level'), 'w').write('%d\n' % level)
+                open(os.path.join(d, 'shared_cpu_list'), 'w').write(cpu_list(shared) + '\n')
+
+if len(shell_cpus) >= 2:
+    cpus = sorted(shell_cpus)
+    domains = [set(cpus[:len(cpus) // 2]), set(cpus[len(cpus) // 2:])]
+    root = tempfile.mkdtemp()
+    atexit.register(shutil.rmtree, root)
+    fake_sysfs(root, domains)
+
+    message = '''Test that, on a machine with two cache domains (a fake sysfs in
+ESH_SYSFS_ROOT), background pipelines without 'on' take the domains in
+turn, and a foreground pipeline is not placed:
+sleep 35 | sleep 36 &
+sleep 37 | sleep 38 &
+grep Cpus_allowed_list /proc/self/status | cat'''
+
+    env = dict(os.environ, ESH_SYSFS_ROOT=root)
+    sh = pexpect.spawn(settings_module.shell, drainpty=True, env=env,
+                       logfile=sys.stdout)
+    sh.timeout = 2
+    assert sh.expect(settings_module.prompt) == 0, message
+
+    placed = []
+    for cmd in ['sleep 35 | sleep 36 &', 'sleep 37 | sleep 38 &']:
+        sh.sendline(cmd)
+        assert sh.expect(settings_module.bgjob_regex) == 0, message
+        jid, pid = sh.match.groups()
+        assert sh.expect(settings_module.prompt) == 0, message
+        pids = pipeline_pids(pid)
+        assert len(pids) == 2, message
+        assert cpus_allowed(pids[0]) == cpus_allowed(pids[1]), message
+        placed.append((jid, cpus_allowed(pids[0])))
+    assert sorted(cpus for jid, cpus in placed) == sorted(domains), message
+
+    sh.sendline('jobs -l')
+    assert sh.expect_exact('auto cpus=') == 0, message
+    assert sh.expect(settings_module.prompt) == 0, message
+
+    sh.sendline('grep Cpus_allowed_list /proc/self/status | cat')
+    assert sh.expect(r'Cpus_allowed_list:\s+(\S+)') == 0, message
+    assert sh.match.group(1) == open('/proc/%d/status' % sh.pid).read() \
+        .split('Cpus_allowed_list:')[1].split()[0], message
+    assert sh.expect(settings_module.prompt) == 0, message
+
+    for jid, cpus in placed:
+        sh.sendline(settings_module.builtin_commands['kill'] % jid)
+        assert sh.expect(settings_module.prompt) == 0, message
+    sh.sendline('exit')
+    assert sh.expect(pexpect.EOF) == 0, message
+
+test_success()
@@ -0,0 +1,119 @@
+#!/usr/bin/python
+from testutil import *
+import testutil
+import subprocess
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+def sched(pid):
+    '''The scheduling policy and nice value of process 'pid', from
+    fields 41 and 19 of /proc/<pid>/stat'''
+    fields = open('/proc/%d/stat' % pid).read().rsplit(')', 1)[1].split()
+    return int(fields[38]), int(fields[16])
+
+SCHED_OTHER, SCHED_BATCH = 0, 3
+
+message = '''Test that background jobs keep normal priority until bgsched
+sets a class:
+sleep 30 &'''
+
+sendline('sleep 30 &')
+jid, pid = parse_bg_status()
+expect_prompt(message)
+time.sleep(0.2)
+assert sched(int(pid)) == (SCHED_OTHER, 0), message
+
+run_builtin('kill', jid)
+expect_prompt(message)
+
+message = '''Test that a background job gets the class set with bgsched,
+normal priority in the foreground, and the class again once stopped:
+bgsched batch nice=5
+sleep 31 &
+fg
+^Z'''
+
+sendline('bgsched batch nice=5')
+expect_prompt(message)
+sendline('sleep 31 &')
+jid, pid = parse_bg_status()
+pid = int(pid)
+expect_prompt(message)
+time.sleep(0.2)
+assert sched(pid) == (SCHED_BATCH, 5), message
+
+run_builtin('fg', jid)
+time.sleep(0.3)
+assert sched(pid) == (SCHED_OTHER, 0), message
+
+sendcontrol('z')
+expect_prompt(message)
+assert sched(pid) == (SCHED_BATCH, 5), message
+
+run_builtin('kill', jid)
+expect_prompt(message)
+sendline('bgsched normal')
+expect_prompt(message)
+
+message = '''Test that a job gets normal priority in the foreground even if
+the class was changed after it was put into the background:
+bgsched batch io=idle
+sleep 100 &
+bgsched normal
+fg'''
+
+def ioclass(pid):
+    '''The I/O scheduling class of process 'pid', as shown by ionice'''
+    return subprocess.check_output(['ionice', '-p', str(pid)]).split(b':')[0].strip()
+
+sendline('bgsched batch io=idle')
+expect_prompt(message)
+sendline('sleep 100 &')
+jid, pid = parse_bg_status()
+pid = int(pid)
+expect_prompt(message)
+time.sleep(0.2)
+assert sched(pid)[0] == SCHED_BATCH, message
+assert ioclass(pid) == b'idle', message
+
+sendline('bgsched normal')
+expect_prompt(message)
+run_builtin('fg', jid)
+time.sleep(0.3)
+assert sched(pid)[0] == SCHED_OTHER, message
+assert ioclass(pid) != b'idle', message
+
+sendcontrol('c')
+expect_prompt(message)
+
+message = '''Test that, headless and without process groups, a background
+job gets the class set with bgsched, and normal priority in the
+foreground:
+esh -n
+bgsched batch nice=5
+sleep 32 &
+fg'''
+
+headless = pexpect.spawn(settings_module.shell + ' -n', drainpty=True,
+                         logfile=sys.stdout)
+headless.timeout = 2
+headless.sendline('bgsched batch nice=5')
+headless.sendline('sleep 32 &')
+assert headless.expect(settings_module.bgjob_regex) == 0, message
+jid, pid = headless.match.groups()
+pid = int(pid)
+time.sleep(0.3)
+assert sched(pid) == (SCHED_BATCH, 5), message
+assert os.getpgid(pid) == os.getpgid(headless.pid), message
+
+headless.sendline('fg %s' % jid)
+time.sleep(0.3)
+assert sched(pid) == (SCHED_OTHER, 0), message
+
+os.kill(pid, signal.SIGKILL)
+headless.sendline('exit')
+assert headless.expect(pexpect.EOF) == 0, message
+
+test_success()
@@ -0,0 +1,123 @@
+#!/usr/bin/python
+#
+# Checks that 'esh script' runs alike from a fresh parse and from its
+# .eshc cache, and that it does not trust a damaged cache.
+#
+# A script with groups, a here-document, pipelines and a line that does
+# not parse is run cold, then warm: both runs must print the same output
+# and the same parse error.  Then the cache file is damaged, in chosen
+# places (truncated, offsets in the header and the tables pointing out
+# of the file) and at random bytes, and run again.  A chosen damage must
+# be detected, so that the output is still right; no damage may make
+# esh die of a signal or hang.
+#
+# The seed of the random damage is in the failure message.
+#
+from testutil import *
+import testutil
+import glob, random, struct, subprocess
+
+setup_tests()
+# bound by setup_tests, after the import above
+settings_module = testutil.settings_module
+
+esh = os.path.abspath(settings_module.shell.split()[0])
+nrandom = 200
+seed = random.randrange(1 << 30)
+random.seed(seed)
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+script = os.path.join(tmpdir, "test.esh")
+cachedir = os.path.join(tmpdir, "cache")
+with open(script, "w") as f:
+    f.write("#!/usr/bin/esh\n"
+            "echo one two | tr o 0\n"
+            "{ echo a; echo b | cat; }\n"
+            "echo bad | | cat\n"
+            "cat <<EOF\n"
+            "here line\n"
+            "EOF\n"
+            "( echo sub ) ; echo last\n")
+
+env = dict(os.environ, XDG_CACHE_HOME=cachedir)
+failures = []
+
+def run():
+    p = subprocess.Popen(["timeout", "10", esh, "-n", script], env=env,
+                         stdin=open(os.devnull),
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = p.communicate()
+    return p.returncode, out, err
+
+def cache_file():
+    files = glob.glob(os.path.join(cachedir, "esh", "*.eshc"))
+    return files[0] if len(files) == 1 else None
+
+cold = run()
+good = cache_file()
+warm = run()
+if good is None:
+    failures.append("no cache file written")
+if cold[0] != 0 or b"0ne tw0" not in cold[1] or b"here line" not in cold[1]:
+    failures.append("cold run: %r" % (cold,))
+if b"test.esh:4:" not in cold[2]:
+    failures.append("cold run did not report the parse error: %r" % (cold[2],))
+if warm != cold:
+    failures.append("warm run differs: %r, cold %r" % (warm, cold))
+
+image = open(good, "rb").read() if good else b""
+saved = os.path.join(tmpdir, "good.eshc")
+if good:
+    shutil.copy(good, saved)
+
+def damaged(data):
+    shutil.copy(saved, good)
+    with open(good, "r+b") as f:
+        f.write(data)
+        f.truncate()
+    return run()
+
+def u64(off):
+    return struct.unpack_from("<Q", image, off)[0]
+
+def put(data, off, value):
+    return data[:off] + struct.pack("<Q", value) + data[off + 8:]
+
+# header: magic, abi, mtime sec and nsec, size, hash, then the
+# (count, offset) pairs of the lines, relocation and error tables
+NLINES, LINES, NRELOCS, RELOCS, NERRORS, ERRORS = range(48, 96, 8)
+chosen = {
+    "truncated": image[:len(image) // 2],
+    "header only": image[:ERRORS + 8],
+    "line table offset": put(image, LINES, len(image)),
+    "line count": put(image, NLINES, 1 << 61),
+    "relocation count": put(image, NRELOCS, u64(NRELOCS) + 1000),
+    "error table offset": put(image, ERRORS, 1 << 62),
+    "line offset": put(image, u64(LINES), len(image) + 4096),
+    "relocation into the tables": put(image, u64(RELOCS), u64(RELOCS)),
+    "pointer out of the file": put(image, u64(u64(RELOCS)), len(image) + 64),
+    "error message offset": put(image, u64(ERRORS) + 8, len(image) + 1),
+}
+if good:
+    for what, data in sorted(chosen.items()):
+        result = damaged(data)
+        if result != cold:
+            failures.append("%s: %r" % (what, result))
+
+    for i in range(nrandom):
+        data = bytearray(image)
+        for j in range(random.randint(1, 8)):
+            off = random.randrange(ERRORS + 8, len(data))
+            data[off] = random.randrange(256)
+        result = damaged(bytes(data))
+        if result[0] < 0 or result[0] == 124:
+            failures.append("random damage %d: %s" % (i, "killed by signal %d"
+                            % -result[0] if result[0] < 0 else "timed out"))
+
+message = '''Test that 'esh script' runs alike from its .eshc cache, and
+that a damaged cache is not trusted (seed %d):
+''' % seed + "\n".join(failures)
+assert not failures, message
+
+test_success()
@@ -0,0 +1,50 @@
+#!/usr/bin/python
+from testutil import *
+
+setup_tests()
+
+message = '''Test that $(...) is replaced by the words of its output:
+echo $(echo a b) c'''
+
+sendline('echo $(echo a b) c')
+expect('a b c', message)
+expect_prompt(message)
+
+message = '''Test that a substituted pipeline can supply the command name:
+$(echo echo) $(echo x y | tr y z)'''
+
+sendline('$(echo echo) $(echo x y | tr y z)')
+expect('x z', message)
+expect_prompt(message)
+
+message = """Test that a substitution may be part of a word, nest, and
+contain parentheses inside quotes:
+echo x$(echo y)z $(echo in $(echo ner)) $(echo '(a)' | sed 's/)//')"""
+
+sendline("echo x$(echo y)z $(echo in $(echo ner)) $(echo '(a)' | sed 's/)//')")
+expect_exact('xyz in ner (a', message)
+expect_prompt(message)
+
+message = """Test that a substitution in an assignment is not split:
+X=$(echo one two) env | grep ^X="""
+
+sendline('X=$(echo one two) env | grep ^X=')
+expect_exact('X=one two', message)
+expect_prompt(message)
+
+message = '''Test that a builtin-only substitution sees the shell's jobs:
+sleep 30 &
+echo got $(jobs)'''
+
+sendline('sleep 30 &')
+job = parse_bg_status()
+expect_prompt(message)
+
+sendline('echo got $(jobs)')
+expect('got \[' + job.job_id + '\]', message)
+expect_prompt(message)
+
+run_builtin('kill', job.job_id)
+expect_prompt(message)
+
+test_success()
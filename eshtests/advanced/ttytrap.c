@@ -0,0 +1,41 @@
+/*
+ * An LD_PRELOAD library for headless_test.py: logs each call of the
+ * functions that change the terminal, which a headless esh must not
+ * make.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Append 'name' to the file named by $TTYTRAP_LOG */
+static void
+note(const char *name)
+{
+    const char *log = getenv("TTYTRAP_LOG");
+    int fd = log ? open(log, O_WRONLY | O_APPEND | O_CREAT, 0600) : -1;
+    if (fd == -1)
+        return;
+    write(fd, name, strlen(name));
+    write(fd, "\n", 1);
+    close(fd);
+}
+
+int
+tcsetpgrp(int fd, pid_t pgrp)
+{
+    note("tcsetpgrp");
+    int (*real)(int, pid_t) = dlsym(RTLD_NEXT, "tcsetpgrp");
+    return real(fd, pgrp);
+}
+
+int
+tcsetattr(int fd, int action, const struct termios *t)
+{
+    note("tcsetattr");
+    int (*real)(int, int, const struct termios *) = dlsym(RTLD_NEXT, "tcsetattr");
+    return real(fd, action, t);
+}
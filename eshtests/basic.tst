@@ -6,3 +6,5 @@
 7 basic/stop_test.py
 8 basic/bg_test.py
 7 basic/kill_test.py
+6 basic/bg_exit_test.py
+6 basic/pipe_reap_test.py
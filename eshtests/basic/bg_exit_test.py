@@ -0,0 +1,86 @@
+#!/usr/bin/python
+#
+# Background Exit Test: Start a shell, run a background job, run a
+#              foreground job, let the background job exit, then
+#              send SIGTSTP, which must stop the foreground job
+#
+# Requires use of the following commands:
+#
+#    ctrl-z control, kill, sleep
+#
+
+import sys, imp, atexit
+sys.path.append("/home/courses/cs3214/software/pexpect-dpty/");
+import pexpect, proc_check, shellio, signal, time, threading
+
+#Ensure the shell process is terminated
+def force_shell_termination(shell_process):
+	c.close(force=True)
+
+# pulling in the regular expression and other definitions
+definitions_scriptname = sys.argv[1]
+def_module = imp.load_source('', definitions_scriptname)
+logfile = None
+if hasattr(def_module, 'logfile'):
+    logfile = def_module.logfile
+
+# spawn an instance of the shell
+c = pexpect.spawn(def_module.shell, drainpty=True, logfile=logfile)
+atexit.register(force_shell_termination, shell_process=c)
+
+# set timeout for all following 'expect*' calls to 2 seconds
+c.timeout = 2
+
+# ensure that shell prints expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+# run a short background job
+c.sendline("sleep 1 &")
+
+# pull the jobid and pid from the background process printout
+(jobid, pid) = shellio.parse_regular_expression(c, def_module.bgjob_regex)
+
+# ensure that the shell prints the expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+# run a foreground job that outlives it
+c.sendline("sleep 60")
+
+proc_check.wait_until_child_is_in_foreground(c)
+
+# the background job exits while 'sleep 60' runs; the terminal must
+# stay with the foreground job
+time.sleep(1.5)
+
+
+
+# send SIGTSTP to 'sleep 60'
+c.sendcontrol('z')
+
+# shell should pick up that 'sleep 60' was stopped and respond with job status
+(jobid, statusmsg, cmdline) = \
+        shellio.parse_regular_expression(c, def_module.job_status_regex)
+assert statusmsg == def_module.jobs_status_msg['stopped'] and \
+        'sleep 60' in cmdline, "Shell did not report stopped job"
+
+# ensure that the shell prints the expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+# kill the stopped job
+c.sendline(def_module.builtin_commands['kill'] % jobid)
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+#exit
+c.sendline("exit")
+assert c.expect_exact("exit\r\n") == 0, "Shell output extraneous characters"
+
+
+shellio.success()
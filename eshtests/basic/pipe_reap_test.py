@@ -0,0 +1,82 @@
+#!/usr/bin/python
+#
+# Pipe Reap Test: Start a shell, run a background pipeline whose last
+#              command exits first, and check that the job is listed
+#              until all of its processes have exited
+#
+# Requires use of the following commands:
+#
+#    jobs, sleep, true
+#
+
+import sys, imp, atexit
+sys.path.append("/home/courses/cs3214/software/pexpect-dpty/");
+import pexpect, proc_check, shellio, signal, time, threading, re
+
+#Ensure the shell process is terminated
+def force_shell_termination(shell_process):
+	c.close(force=True)
+
+# pulling in the regular expression and other definitions
+definitions_scriptname = sys.argv[1]
+def_module = imp.load_source('', definitions_scriptname)
+logfile = None
+if hasattr(def_module, 'logfile'):
+    logfile = def_module.logfile
+
+# spawn an instance of the shell
+c = pexpect.spawn(def_module.shell, drainpty=True, logfile=logfile)
+atexit.register(force_shell_termination, shell_process=c)
+
+# set timeout for all following 'expect*' calls to 2 seconds
+c.timeout = 2
+
+# ensure that shell prints expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+# run a pipeline in which 'true' exits long before 'sleep'
+c.sendline("sleep 2 | true &")
+
+# pull the jobid and pid from the background process printout
+(jobid, pid) = shellio.parse_regular_expression(c, def_module.bgjob_regex)
+
+# ensure that the shell prints the expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+# let 'true' exit and be reaped
+time.sleep(0.5)
+
+
+
+# the job is still running while 'sleep' is
+c.sendline(def_module.builtin_commands['jobs'])
+
+(jobid2, status_message, command_line) = \
+        shellio.parse_regular_expression(c, def_module.job_status_regex)
+assert jobid2 == jobid and \
+        status_message == def_module.jobs_status_msg['running'] and \
+        'sleep 2' in command_line, "Job left the jobs list before all its processes exited"
+
+# ensure that the shell prints the expected prompt
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+
+
+
+# once 'sleep' has exited, the job is gone
+time.sleep(2)
+
+c.sendline(def_module.builtin_commands['jobs'])
+assert c.expect(def_module.prompt) == 0, "Shell did not print expected prompt"
+assert re.search(def_module.job_status_regex, c.before) is None, \
+        "Job still listed after all its processes exited"
+
+
+
+#exit
+c.sendline("exit")
+assert c.expect_exact("exit\r\n") == 0, "Shell output extraneous characters"
+
+
+shellio.success()
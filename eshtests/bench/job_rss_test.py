@@ -0,0 +1,80 @@
+#!/usr/bin/python
+#
+# Memory footprint of esh over a long run of jobs.
+#
+# esh runs headless with its commands fed through a pipe: a mix of
+# foreground, background and two-stage pipeline jobs, 1M by default.
+# The resident set size of esh is sampled from /proc/<pid>/status
+# every 1% of the jobs.  After a warm-up of the first 10%, RSS may not
+# grow past its warm-up peak by more than the tolerance, else the test
+# fails.  Every finished job that is not freed costs a pipeline, its
+# commands and their argv, so a leak shows up as steady growth well
+# within the run.
+#
+# A run of 1M jobs takes about 20 minutes; use -n for a quicker check.
+#
+# Usage: python job_rss_test.py [-e path/to/esh] [-n jobs] [-t tolerance_kB]
+#
+from __future__ import print_function
+import getopt, subprocess, sys, time
+
+esh = "./esh"
+njobs = 1000000
+tolerance = 1024
+
+opts, args = getopt.getopt(sys.argv[1:], "e:n:t:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-n":
+        njobs = int(a)
+    elif o == "-t":
+        tolerance = int(a)
+
+jobs = [b"true\n", b"true &\n", b"true | true\n"]
+
+def rss(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+
+def sync(i):
+    """Wait until esh has read and run everything sent so far"""
+    mark = ("mark %d\n" % i).encode()
+    shell.stdin.write(b"echo " + mark)
+    shell.stdin.flush()
+    while shell.stdout.readline() != mark:
+        pass
+
+shell = subprocess.Popen([esh, "-n"], stdin=subprocess.PIPE,
+                         stdout=subprocess.PIPE)
+sync(0)
+step = max(1, njobs // 100)
+samples = []
+start = time.time()
+for i in range(0, njobs, step):
+    n = min(step, njobs - i)
+    # readline echoes each line; keep what is unread within a pipe buffer
+    for k in range(0, n, 1000):
+        m = min(1000, n - k)
+        shell.stdin.write(b"".join(jobs[(i + k + j) % len(jobs)] for j in range(m)))
+        sync(i + k + m)
+    samples.append((i + n, rss(shell.pid)))
+shell.stdin.write(b"exit\n")
+shell.stdin.close()
+shell.wait()
+elapsed = time.time() - start
+
+for n, kb in samples:
+    print("%9d jobs  %7d kB" % (n, kb))
+
+warm = len(samples) // 10 + 1
+base = max(kb for n, kb in samples[:warm])
+peak = max(kb for n, kb in samples[warm:] or samples[-1:])
+print("%d jobs in %.1f s, RSS %d kB after warm-up, %d kB peak"
+      % (njobs, elapsed, base, peak))
+if peak - base > tolerance:
+    print("FAIL: RSS grew by %d kB (tolerance %d kB)" % (peak - base, tolerance))
+    sys.exit(1)
+print("PASS")
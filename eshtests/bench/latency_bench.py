@@ -0,0 +1,156 @@
+#!/usr/bin/python
+#
+# Job-control latencies of esh, measured under a pseudo-terminal.
+#
+#   exec       command entered -> child running (date prints its start
+#              time; includes date's own startup)
+#   stop       Ctrl-Z -> "Stopped" line
+#   bg         'bg N' -> prompt
+#   fg         'fg N' -> "Foreground" line
+#   roundtrip  bg + fg + Ctrl-Z of the same job, back to "Stopped"
+#   intr       Ctrl-C on a foreground job -> prompt
+#   reap       background child exits -> job gone from 'jobs'
+#
+# With -c N, every sample is taken while N short background jobs exit
+# around it, so reaping happens under load.  The report is JSON: for
+# each latency the sample count and min/p50/p90/p99/max in ms.
+#
+# Usage: python latency_bench.py [-e path/to/esh] [-n samples] [-c concurrency]
+#                                [-o report.json]
+#
+from __future__ import print_function
+import getopt, json, sys, time
+import pexpect
+
+esh = "./esh"
+samples = 50
+concurrency = 0
+output = None
+
+opts, args = getopt.getopt(sys.argv[1:], "e:n:c:o:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-n":
+        samples = int(a)
+    elif o == "-c":
+        concurrency = int(a)
+    elif o == "-o":
+        output = a
+
+prompt = "esh> "
+shell = pexpect.spawn(esh, timeout=10)
+shell.delaybeforesend = None    # pexpect sleeps 50 ms before each send
+shell.expect(prompt)
+results = dict((k, []) for k in
+               ["exec", "stop", "bg", "fg", "roundtrip", "intr", "reap"])
+
+def now():
+    return time.time()
+
+def load():
+    """Start 'concurrency' background jobs that exit over the next ~50 ms"""
+    if concurrency == 0:
+        return
+    jobs = ["sleep 0.%03d &" % (5 + (45 * i) // concurrency)
+            for i in range(concurrency)]
+    shell.sendline(" ".join(jobs))
+    shell.expect(prompt)
+
+def jobs():
+    """Output of the 'jobs' builtin"""
+    shell.sendline("jobs")
+    shell.expect("jobs\r\n")
+    shell.expect(prompt)
+    return shell.before
+
+def settle():
+    """Wait until the load jobs are gone so job ids start over"""
+    for i in range(200):
+        if b"Running" not in jobs():
+            return
+        time.sleep(0.01)
+
+def ms(t):
+    return t * 1000.0
+
+def stopped_job():
+    shell.expect(r"\[(\d+)\][+-]? Stopped")
+    return int(shell.match.group(1))
+
+for i in range(samples):
+    # command entry to exec
+    load()
+    start = now()
+    shell.sendline("date +%s.%N")
+    shell.expect(r"(\d{10}\.\d+)\r\n")
+    results["exec"].append(ms(float(shell.match.group(1)) - start))
+    shell.expect(prompt)
+    settle()
+
+    # Ctrl-Z, bg, fg and a round trip on one job
+    load()
+    shell.sendline("sleep 100")
+    time.sleep(0.05)
+    start = now()
+    shell.sendcontrol("z")
+    jid = stopped_job()
+    results["stop"].append(ms(now() - start))
+    shell.expect(prompt)
+
+    start = now()
+    shell.sendline("bg %d" % jid)
+    shell.expect(prompt)
+    bg_done = now()
+    results["bg"].append(ms(bg_done - start))
+    shell.sendline("fg %d" % jid)
+    shell.expect("Foreground")
+    results["fg"].append(ms(now() - bg_done))
+    shell.sendcontrol("z")
+    stopped_job()
+    results["roundtrip"].append(ms(now() - start))
+    shell.expect(prompt)
+    shell.sendline("kill %d" % jid)
+    shell.expect(prompt)
+    settle()
+
+    # Ctrl-C to prompt
+    load()
+    shell.sendline("sleep 100")
+    time.sleep(0.05)
+    start = now()
+    shell.sendcontrol("c")
+    shell.expect(prompt)
+    results["intr"].append(ms(now() - start))
+    settle()
+
+    # exit of a background child until 'jobs' no longer lists it
+    load()
+    shell.sendline("date +%s.%N &")
+    shell.expect(r"(\d{10}\.\d+)\r\n")
+    exited = float(shell.match.group(1))
+    while b"date" in jobs():
+        pass
+    results["reap"].append(ms(now() - exited))
+    settle()
+
+shell.sendline("exit")
+shell.expect(pexpect.EOF)
+
+def percentile(xs, p):
+    return xs[min(len(xs) - 1, int(p * len(xs)))]
+
+report = {"esh": esh, "samples": samples, "concurrency": concurrency,
+          "unit": "ms", "latencies": {}}
+for name, xs in sorted(results.items()):
+    xs = sorted(xs)
+    report["latencies"][name] = {
+        "n": len(xs), "min": xs[0], "p50": percentile(xs, 0.5),
+        "p90": percentile(xs, 0.9), "p99": percentile(xs, 0.99), "max": xs[-1],
+    }
+
+text = json.dumps(report, indent=2, sort_keys=True)
+if output:
+    with open(output, "w") as f:
+        f.write(text + "\n")
+print(text)
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+#
+# Syntax checking of a large generated script with 'esh -k'.
+#
+# The script mixes pipelines, redirections, background jobs, comments
+# and blank lines, with about one line in a thousand made invalid in
+# one of several ways.  esh -k parses it on all CPUs; the test fails
+# unless it reports exactly the invalid lines, in order, and exits
+# with status 1.  Prints the parse rate.
+#
+# Usage: python parse_check_bench.py [-e path/to/esh] [-n lines]
+#
+from __future__ import print_function
+import getopt, os, random, shutil, subprocess, sys, tempfile, time
+
+esh = "./esh"
+nlines = 2000000
+
+opts, args = getopt.getopt(sys.argv[1:], "e:n:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-n":
+        nlines = int(a)
+
+good = ["ls -l | wc -l",
+        "echo a b c > out ; cat < out &",
+        "sort <<< word | uniq >> out",
+        "grep foo bar baz | head -n 3 | tail -1 &",
+        "jobs",
+        "# a comment",
+        ""]
+bad = ["ls >", "ls > a > b", "| ls", "cat < a < b", "ls | >"]
+
+random.seed(3214)
+tmpdir = tempfile.mkdtemp()
+script = os.path.join(tmpdir, "corpus.esh")
+expected = []
+with open(script, "w") as f:
+    for i in range(1, nlines + 1):
+        if random.random() < 0.001:
+            f.write(random.choice(bad) + "\n")
+            expected.append(i)
+        else:
+            f.write(random.choice(good) + "\n")
+
+start = time.time()
+shell = subprocess.Popen([esh, "-k", script], stdout=subprocess.PIPE)
+out = shell.communicate()[0].decode()
+elapsed = time.time() - start
+shutil.rmtree(tmpdir)
+
+reported = [int(l.split(":")[1]) for l in out.splitlines()]
+print("%d lines in %.2f s, %.0f lines/s, %d errors"
+      % (nlines, elapsed, nlines / elapsed, len(reported)))
+if reported != expected or shell.returncode != 1:
+    print("FAIL: expected %d errors, exit status 1; got %d, exit status %d"
+          % (len(expected), len(reported), shell.returncode))
+    sys.exit(1)
+print("PASS")
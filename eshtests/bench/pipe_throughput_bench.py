@@ -0,0 +1,122 @@
+#!/usr/bin/python
+#
+# Data throughput of pipelines launched by esh, with bash and dash as
+# baselines.
+#
+# Each case is one command line run from a script by each shell:
+#
+#   pipe-N     pipegen gen | pipegen pass | ... | pipegen sink  (N stages)
+#   redir-out  pipegen gen > FILE
+#   redir-app  pipegen gen >> FILE
+#   redir-in   pipegen sink < FILE
+#
+# For each shell and case the best of several runs is reported, as
+# bytes per second of payload, CPU time (user + system of the shell and
+# everything it ran) per payload byte, and voluntary plus involuntary
+# context switches.  The report is JSON.
+#
+# Usage: python pipe_throughput_bench.py [-e path/to/esh] [-g path/to/pipegen]
+#            [-b bytes] [-s stages,...] [-S shell,...] [-r runs] [-o report.json]
+#
+from __future__ import print_function
+import getopt, json, os, resource, shutil, subprocess, sys, tempfile, time
+
+esh = "./esh"
+pipegen = os.path.join(os.path.dirname(os.path.abspath(__file__)), "pipegen")
+nbytes = 64 << 20
+stages = [1, 2, 4, 8, 16, 32, 64]
+shells = ["esh", "bash", "dash"]
+runs = 3
+output = None
+
+opts, args = getopt.getopt(sys.argv[1:], "e:g:b:s:S:r:o:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-g":
+        pipegen = a
+    elif o == "-b":
+        nbytes = int(a)
+    elif o == "-s":
+        stages = [int(s) for s in a.split(",")]
+    elif o == "-S":
+        shells = a.split(",")
+    elif o == "-r":
+        runs = int(a)
+    elif o == "-o":
+        output = a
+
+pipegen = os.path.abspath(pipegen)
+tmpdir = tempfile.mkdtemp()
+datafile = os.path.join(tmpdir, "data")
+env = dict(os.environ, XDG_CACHE_HOME=os.path.join(tmpdir, "cache"))
+
+def pipeline(n):
+    gen = "%s gen %d" % (pipegen, nbytes)
+    if n == 1:
+        return gen + " > /dev/null"
+    return " | ".join([gen] + ["%s pass" % pipegen] * (n - 2)
+                      + ["%s sink" % pipegen])
+
+cases = [("pipe-%d" % n, pipeline(n)) for n in stages]
+cases += [
+    ("redir-out", "%s gen %d > %s" % (pipegen, nbytes, datafile)),
+    ("redir-app", "%s gen %d >> %s" % (pipegen, nbytes, datafile)),
+    ("redir-in", "%s sink < %s" % (pipegen, datafile)),
+]
+
+def argv_for(shell, script):
+    if shell == "esh":
+        return [esh, "-n", script]
+    return [shell, script]
+
+def prepare(name):
+    """redir-app appends to an empty file; redir-in reads nbytes"""
+    if name == "redir-app" and os.path.exists(datafile):
+        os.unlink(datafile)
+    if name == "redir-in" and (not os.path.exists(datafile)
+                               or os.path.getsize(datafile) != nbytes):
+        with open(datafile, "wb") as f:
+            block = b"x" * (1 << 20)
+            for i in range(0, nbytes, len(block)):
+                f.write(block[:nbytes - i])
+
+def run(shell, name, line):
+    script = os.path.join(tmpdir, "case")
+    with open(script, "w") as f:
+        f.write(line + "\n")
+    prepare(name)
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.time()
+    subprocess.check_call(argv_for(shell, script), env=env,
+                          stdin=open(os.devnull))
+    wall = time.time() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+    cpu = (after.ru_utime - before.ru_utime) + (after.ru_stime - before.ru_stime)
+    csw = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw)
+    return wall, cpu, csw
+
+report = {"bytes": nbytes, "runs": runs, "unit": {
+    "throughput": "MB/s", "cpu_per_byte": "ns/B", "wall": "s"}, "cases": {}}
+for name, line in cases:
+    report["cases"][name] = {}
+    for shell in shells:
+        best = min(run(shell, name, line) for i in range(runs))
+        wall, cpu, csw = best
+        report["cases"][name][shell] = {
+            "wall": wall,
+            "throughput": nbytes / wall / 1e6,
+            "cpu_per_byte": cpu * 1e9 / nbytes,
+            "context_switches": csw,
+        }
+        print("%-10s %-5s %9.1f MB/s %7.3f ns/B %8d csw" % (
+            name, shell, nbytes / wall / 1e6, cpu * 1e9 / nbytes, csw),
+            file=sys.stderr)
+
+shutil.rmtree(tmpdir)
+
+text = json.dumps(report, indent=2, sort_keys=True)
+if output:
+    with open(output, "w") as f:
+        f.write(text + "\n")
+print(text)
@@ -0,0 +1,67 @@
+/*
+ * Synthetic pipeline stages for pipe_throughput_bench.py.
+ *
+ *      pipegen gen BYTES [BLOCK]   write BYTES bytes in BLOCK-sized writes
+ *      pipegen pass [BLOCK]        copy stdin to stdout
+ *      pipegen sink [BLOCK]        read and discard stdin
+ *
+ * All stages use plain read(2)/write(2) so that the numbers reflect
+ * how the shell wired the pipeline, not tricks in the stages.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+static void
+write_all(const char *buf, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(1, buf, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("pipegen: write");
+            exit(EXIT_FAILURE);
+        }
+        buf += w;
+        n -= w;
+    }
+}
+
+int
+main(int ac, char *av[])
+{
+    if (ac < 2) {
+        fprintf(stderr, "usage: pipegen gen BYTES [BLOCK] | pass [BLOCK] | sink [BLOCK]\n");
+        return EXIT_FAILURE;
+    }
+    int gen = strcmp(av[1], "gen") == 0;
+    size_t block = 65536;
+    if (ac > 2 + gen)
+        block = strtoul(av[2 + gen], NULL, 0);
+    char *buf = malloc(block);
+    memset(buf, 'x', block);
+
+    if (gen) {
+        unsigned long long left = ac > 2 ? strtoull(av[2], NULL, 0) : 0;
+        while (left > 0) {
+            size_t n = left < block ? left : block;
+            write_all(buf, n);
+            left -= n;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int pass = strcmp(av[1], "pass") == 0;
+    for (;;) {
+        ssize_t n = read(0, buf, block);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        if (pass)
+            write_all(buf, n);
+    }
+}
@@ -0,0 +1,58 @@
+#!/usr/bin/python
+#
+# Cold versus warm startup of 'esh script'.
+#
+# A cold run parses the script and writes its .eshc cache file; a warm
+# run maps the cache and executes without parsing.  The generated script
+# uses builtins only, so no time is spent in fork/exec.
+#
+# Usage: python script_cache_bench.py [-e path/to/esh] [-n lines] [-r runs]
+#
+from __future__ import print_function
+import getopt, os, shutil, subprocess, sys, tempfile, time
+
+esh = "./esh"
+nlines = 20000
+runs = 10
+
+opts, args = getopt.getopt(sys.argv[1:], "e:n:r:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-n":
+        nlines = int(a)
+    elif o == "-r":
+        runs = int(a)
+
+tmpdir = tempfile.mkdtemp()
+script = os.path.join(tmpdir, "bench.esh")
+cachedir = os.path.join(tmpdir, "cache")
+with open(script, "w") as f:
+    for i in range(nlines):
+        f.write("jobslots 0 ; bgsched batch nice=0 io=idle ; "
+                "jobs < /dev/null | cat >> /dev/null &\n")
+
+env = dict(os.environ, XDG_CACHE_HOME=cachedir)
+
+def run_once(cold):
+    if cold and os.path.exists(cachedir):
+        shutil.rmtree(cachedir)
+    start = time.time()
+    subprocess.check_call([esh, "-n", script], env=env,
+                          stdin=open(os.devnull), stdout=open(os.devnull, "w"))
+    return time.time() - start
+
+def median(xs):
+    xs = sorted(xs)
+    return xs[len(xs) // 2]
+
+cold = median([run_once(True) for i in range(runs)])
+run_once(False)
+warm = median([run_once(False) for i in range(runs)])
+
+print("lines: %d  runs: %d" % (nlines, runs))
+print("cold (parse + write cache): %8.2f ms" % (cold * 1000))
+print("warm (mapped cache):        %8.2f ms" % (warm * 1000))
+print("speedup:                    %8.2fx" % (cold / warm))
+
+shutil.rmtree(tmpdir)
@@ -0,0 +1,200 @@
+#!/usr/bin/python
+#
+# Soak test: drives esh under a pseudo-terminal through a long random
+# mix of operations and watches it for leaks.
+#
+#   fg      a simple foreground command, with or without redirection
+#   pipe    a pipeline of 2 to 8 stages
+#   bg      a short background job
+#   stop    Ctrl-Z a foreground job, then bg, fg, Ctrl-Z and kill it
+#   intr    Ctrl-C a foreground job
+#   kill    kill a running background job
+#   error   a parse error or a command that cannot be run
+#   jobs    the jobs builtin
+#
+# Every -i operations, esh's VmRSS, its open file descriptors, its
+# zombie children and the length of its jobs list are sampled.  After
+# a warm-up of the first 10% of the samples, the rest is split into
+# four windows.  A metric whose floor (the window minimum) never drops
+# from one window to the next and ends higher than it started, by more
+# than 512 kB for RSS and by anything at all for the others, is a leak
+# and fails the test.  The report is JSON, with the throughput in
+# operations per second.
+#
+# Usage: python soak_test.py [-e path/to/esh] [-n operations] [-i interval]
+#                            [-s seed] [-o report.json]
+#
+from __future__ import print_function
+import getopt, json, os, random, re, shutil, sys, tempfile, time
+import pexpect
+
+esh = "./esh"
+nops = 2000000
+interval = 1000
+seed = None
+output = None
+
+opts, args = getopt.getopt(sys.argv[1:], "e:n:i:s:o:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-n":
+        nops = int(a)
+    elif o == "-i":
+        interval = int(a)
+    elif o == "-s":
+        seed = int(a)
+    elif o == "-o":
+        output = a
+
+if seed is None:
+    seed = int(time.time())
+rng = random.Random(seed)
+
+tmp = tempfile.mkdtemp()
+data = os.path.join(tmp, "data")
+with open(data, "w") as f:
+    f.write("soak\n" * 100)
+
+prompt = "esh> "
+shell = pexpect.spawn(esh, timeout=10)
+shell.delaybeforesend = None    # pexpect sleeps 50 ms before each send
+shell.expect(prompt)
+
+def command(line):
+    shell.sendline(line)
+    shell.expect(prompt)
+    return shell.before
+
+def children():
+    """pids of esh's children"""
+    try:
+        with open("/proc/%d/task/%d/children" % (shell.pid, shell.pid)) as f:
+            return [int(p) for p in f.read().split()]
+    except IOError:
+        return []
+
+def state(pid):
+    """(comm, state, in foreground) of a process, or None if it is gone"""
+    try:
+        with open("/proc/%d/stat" % pid) as f:
+            s = f.read()
+    except IOError:
+        return None
+    fields = s[s.rindex(")") + 2:].split()
+    return s[s.index("(") + 1:s.rindex(")")], fields[0], fields[2] == fields[5]
+
+def wait_for_fg_child(name):
+    """Wait until a child running 'name' owns the terminal"""
+    for i in range(5000):
+        for p in children():
+            st = state(p)
+            if st is not None and st[0] == name and st[1] != "Z" and st[2]:
+                return
+        time.sleep(0.001)
+    raise Exception("%s did not get the terminal" % name)
+
+def stopped_job():
+    shell.expect(r"\[(\d+)\][+-]? Stopped")
+    jid = int(shell.match.group(1))
+    shell.expect(prompt)
+    return jid
+
+def op_fg():
+    command(rng.choice(["true", "echo soak", "echo soak > %s" % data,
+                        "echo soak >> %s" % data, "cat < %s" % data,
+                        "wc -l < %s > %s.out" % (data, data)]))
+
+def op_pipe():
+    stages = ["cat"] * rng.randint(1, 7)
+    command(" | ".join(["cat %s" % data] + stages))
+
+def op_bg():
+    command(rng.choice(["true &", "sleep 0.01 &", "echo soak > %s.bg &" % data]))
+
+def op_stop():
+    shell.sendline("sleep 100")
+    wait_for_fg_child("sleep")
+    shell.sendcontrol("z")
+    jid = stopped_job()
+    command("bg %d" % jid)
+    shell.sendline("fg %d" % jid)
+    shell.expect("Foreground")
+    shell.sendcontrol("z")
+    stopped_job()
+    command("kill %d" % jid)
+
+def op_intr():
+    shell.sendline("sleep 100")
+    wait_for_fg_child("sleep")
+    shell.sendcontrol("c")
+    shell.expect(prompt)
+
+def op_kill():
+    out = command("sleep 100 &")
+    jid = int(re.search(br"\[(\d+)\]", out).group(1))
+    command("kill %d" % jid)
+
+def op_error():
+    command(rng.choice(["echo >", "| |", "cat <", "nosuchcommand_soak",
+                        "cat < %s.missing" % data]))
+
+def op_jobs():
+    command("jobs")
+
+ops = [(op_fg, 30), (op_pipe, 20), (op_bg, 20), (op_stop, 3), (op_intr, 3),
+       (op_kill, 5), (op_error, 9), (op_jobs, 10)]
+choices = [f for f, w in ops for i in range(w)]
+counts = dict((f.__name__[3:], 0) for f, w in ops)
+
+def sample():
+    with open("/proc/%d/status" % shell.pid) as f:
+        rss = int(re.search(r"VmRSS:\s+(\d+)", f.read()).group(1))
+    fds = len(os.listdir("/proc/%d/fd" % shell.pid))
+    zombies = sum(1 for p in children() if (state(p) or ("", ""))[1:2] == ("Z",))
+    jobs = len(re.findall(br"\[\d+\]", command("jobs")))
+    return {"rss_kb": rss, "fds": fds, "zombies": zombies, "jobs": jobs}
+
+samples = []
+start = time.time()
+for i in range(nops):
+    f = rng.choice(choices)
+    f()
+    counts[f.__name__[3:]] += 1
+    if (i + 1) % interval == 0:
+        s = sample()
+        s["ops"] = i + 1
+        samples.append(s)
+        print("%9d ops  rss %6d kB  fds %3d  zombies %3d  jobs %3d"
+              % (i + 1, s["rss_kb"], s["fds"], s["zombies"], s["jobs"]))
+elapsed = time.time() - start
+
+shell.sendline("exit")
+shell.expect(pexpect.EOF)
+shutil.rmtree(tmp)
+
+slack = {"rss_kb": 512, "fds": 0, "zombies": 0, "jobs": 0}
+failures = []
+steady = samples[len(samples) // 10:]
+if len(steady) >= 8:
+    w = len(steady) // 4
+    for metric, allowed in sorted(slack.items()):
+        floors = [min(s[metric] for s in steady[k * w:(k + 1) * w])
+                  for k in range(4)]
+        growing = all(a <= b for a, b in zip(floors, floors[1:]))
+        if growing and floors[-1] - floors[0] > allowed:
+            failures.append("%s grows: window floors %s" % (metric, floors))
+
+report = {"esh": esh, "seed": seed, "operations": nops, "seconds": elapsed,
+          "ops_per_sec": nops / elapsed, "counts": counts,
+          "samples": len(samples), "checked": len(steady) >= 8,
+          "first": samples[0] if samples else None,
+          "last": samples[-1] if samples else None,
+          "failures": failures}
+
+text = json.dumps(report, indent=2, sort_keys=True)
+if output:
+    with open(output, "w") as f:
+        f.write(text + "\n")
+print(text)
+sys.exit(1 if failures else 0)
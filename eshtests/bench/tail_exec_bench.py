@@ -0,0 +1,68 @@
+#!/usr/bin/python
+#
+# Short-lived esh invocations, with and without tail-exec.
+#
+# Each run feeds esh one line on stdin.  A lone command is the last
+# thing the shell runs, so esh execs it in place: the command's parent
+# is this script, and its exit status is esh's.  Followed by a builtin,
+# the same command is forked and waited for as usual.  The test fails
+# unless the lone command replaced the shell and its status came
+# through.  Prints the time per invocation of both.
+#
+# Usage: python tail_exec_bench.py [-e path/to/esh] [-r runs]
+#
+from __future__ import print_function
+import getopt, os, shutil, subprocess, sys, tempfile, time
+
+esh = "./esh"
+runs = 500
+
+opts, args = getopt.getopt(sys.argv[1:], "e:r:")
+for o, a in opts:
+    if o == "-e":
+        esh = a
+    elif o == "-r":
+        runs = int(a)
+
+tmpdir = tempfile.mkdtemp()
+cmd = os.path.join(tmpdir, "cmd.sh")
+with open(cmd, "w") as f:
+    f.write("echo $PPID\nexit 3\n")
+
+def make_input(name, line):
+    path = os.path.join(tmpdir, name)
+    with open(path, "w") as f:
+        f.write(line + "\n")
+    return path
+
+last = make_input("last", "sh " + cmd)
+notlast = make_input("notlast", "sh " + cmd + " ; jobs")
+
+def run(path):
+    shell = subprocess.Popen([esh, "-n"], stdin=open(path),
+                             stdout=subprocess.PIPE)
+    out = shell.communicate()[0].decode()
+    return shell.pid, out, shell.returncode
+
+def bench(path):
+    start = time.time()
+    for i in range(runs):
+        run(path)
+    return (time.time() - start) / runs
+
+pid, out, status = run(last)
+ppid = int(out.split()[-1])
+ok = ppid == os.getpid() and status == 3
+
+t_last = bench(last)
+t_notlast = bench(notlast)
+shutil.rmtree(tmpdir)
+
+print("runs: %d" % runs)
+print("last command exec'd in place: %8.3f ms" % (t_last * 1000))
+print("last command forked:          %8.3f ms" % (t_notlast * 1000))
+if not ok:
+    print("FAIL: command's parent %d (expected %d), exit status %d (expected 3)"
+          % (ppid, os.getpid(), status))
+    sys.exit(1)
+print("PASS")
@@ -0,0 +1,161 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Argument batching.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "esh.h"
+#include "esh-sys-utils.h"
+#include "esh-batch.h"
+
+/* headroom below ARG_MAX, as xargs keeps */
+#define BATCH_HEADROOM  2048
+
+extern char **environ;
+
+int
+esh_batch_from_argv(char **argv, int *nwords)
+{
+    int jobs = 1, i = 1;
+    if (argv[i] != NULL && strcmp(argv[i], "-P") == 0) {
+        if (argv[i + 1] == NULL || (jobs = atoi(argv[i + 1])) < 1) {
+            fprintf(stderr, "batch: -P needs a positive number\n");
+            return -1;
+        }
+        i += 2;
+    }
+    if (argv[i] == NULL) {
+        fprintf(stderr, "batch: missing command\n");
+        return -1;
+    }
+
+    *nwords = i;
+    return jobs;
+}
+
+/* Bytes that 'word' takes in the new process image */
+static size_t
+cost(const char *word)
+{
+    return strlen(word) + 1 + sizeof(char *);
+}
+
+/* True if 'word' came from an expansion of 'cmd' */
+static bool
+expanded(struct esh_command *cmd, const char *word)
+{
+    return cmd->subst_arena != NULL && word >= cmd->subst_arena
+        && word < cmd->subst_arena + cmd->subst_arena_size;
+}
+
+/* Exit status of a child as the shell reports it */
+static int
+exit_code(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return 128 + WTERMSIG(status);
+}
+
+void
+esh_batch_exec(struct esh_command *cmd)
+{
+    char **argv = cmd->argv;
+    int argc = 0, head, tail, i;
+    while (argv[argc] != NULL)
+        argc++;
+
+    /* expanded words are split; the literal words around them are not */
+    for (head = 0; head < argc && !expanded(cmd, argv[head]); head++)
+        ;
+    tail = argc;
+    if (head == argc)
+        head = 1;
+    else
+        while (!expanded(cmd, argv[tail - 1]))
+            tail--;
+
+    long limit = sysconf(_SC_ARG_MAX);
+    if (limit <= 0)
+        limit = 128 * 1024;
+    limit -= BATCH_HEADROOM;
+    char **e;
+    for (e = environ; *e != NULL; e++)
+        limit -= cost(*e);
+
+    size_t fixed = 0;
+    for (i = 0; i < head; i++)
+        fixed += cost(argv[i]);
+    for (i = tail; i < argc; i++)
+        fixed += cost(argv[i]);
+    if ((long)fixed >= limit) {
+        fprintf(stderr, "%s: fixed arguments exceed ARG_MAX\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* it all fits: no batching needed */
+    size_t total = fixed;
+    for (i = head; i < tail; i++)
+        total += cost(argv[i]);
+    if ((long)total < limit) {
+        execvp(argv[0], argv);
+        esh_sys_fatal_error("%s: command not found\n", argv[0]);
+    }
+
+    /* the invocations are our own children now */
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    esh_signal_unblock(SIGCHLD);
+
+    /* MAX_ARG_STRLEN of the kernel */
+    size_t max_strlen = 32 * sysconf(_SC_PAGESIZE);
+    char **bargv = malloc((argc + 1) * sizeof(char *));
+    memcpy(bargv, argv, head * sizeof(char *));
+    int running = 0, worst = 0, status;
+    int next = head;
+    while (next < tail || running > 0) {
+        if (next < tail && running < cmd->batch) {
+            size_t size = fixed;
+            int n = head;
+            while (next < tail && (n == head || (long)(size + cost(argv[next])) < limit)) {
+                if (strlen(argv[next]) >= max_strlen)
+                    fprintf(stderr, "%s: argument too long: %.32s...\n", argv[0], argv[next]);
+                size += cost(argv[next]);
+                bargv[n++] = argv[next++];
+            }
+            memcpy(bargv + n, argv + tail, (argc - tail) * sizeof(char *));
+            bargv[n + argc - tail] = NULL;
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                esh_sys_error("batch: fork failed: ");
+                worst = worst > 126 ? worst : 126;
+                break;
+            }
+            if (pid == 0) {
+                execvp(bargv[0], bargv);
+                esh_sys_fatal_error("%s: command not found\n", bargv[0]);
+            }
+            running++;
+            continue;
+        }
+        if (wait(&status) < 0)
+            break;
+        running--;
+        if (exit_code(status) > worst)
+            worst = exit_code(status);
+    }
+    while (running > 0 && wait(&status) > 0) {
+        running--;
+        if (exit_code(status) > worst)
+            worst = exit_code(status);
+    }
+    exit(worst);
+}
@@ -0,0 +1,29 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Argument batching, as requested with the 'batch' prefix:
+ *
+ *      batch [-P n] cmd args...
+ *
+ * If the expanded argv of cmd is too big for one execve (ARG_MAX or
+ * the per-string limit), it is split into several invocations that
+ * each fit, run one after another or up to n at a time.  They are one
+ * job and share its stdin and stdout; the job exits with the worst
+ * exit status of the invocations.
+ */
+
+#include <stdbool.h>
+
+struct esh_command;
+
+/* Parse a 'batch' prefix and its options at the start of argv, and
+ * set *nwords to the number of words they take; the caller removes
+ * them.  Returns the number of invocations to run at a time, or -1
+ * after printing an error. */
+int esh_batch_from_argv(char **argv, int *nwords);
+
+/* Run cmd in batches of arguments and exit with the worst status.
+ * Words that came from globs or substitutions are split between
+ * invocations; literal words before and after them are repeated in
+ * each.  Meant to be called in the child instead of exec. */
+void esh_batch_exec(struct esh_command *cmd) __attribute__((noreturn));
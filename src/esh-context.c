@@ -0,0 +1,2271 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Shell contexts: jobs, job control, builtins and word expansion.
+ *
+ * Everything that a shell changes as it runs lives in its context.
+ * Code that walks or changes a context's jobs list runs with SIGCHLD
+ * blocked, since the process context's SIGCHLD handler changes it
+ * too.  Other contexts reap their own children, by pid, from
+ * job_wait and esh_context_poll.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <wait.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "esh.h"
+#include "esh-sys-utils.h"
+#include "esh-placement.h"
+#include "esh-sched.h"
+#include "esh-plumbing.h"
+#include "esh-env.h"
+#include "esh-glob.h"
+#include "esh-batch.h"
+#include "esh-events.h"
+#include "esh-hooks.h"
+#include "esh-output.h"
+#include "esh-vjob.h"
+#include "esh-context.h"
+
+struct esh_context {
+	int flags;
+	struct list jobs;       /* <esh_pipeline> */
+	struct list finished;   /* jobs that finished; freed once their
+	                           status events are delivered */
+	struct list coprocs;    /* <coproc> */
+	struct list dead_coprocs;   /* coprocesses whose job finished; freed
+	                               with the finished jobs */
+	int jcount;
+	int job_slots;          /* max. running background jobs, 0 if unlimited */
+	bool headless;          /* no controlling terminal: no job control */
+	bool use_pgrps;         /* put each job in its own process group */
+	struct termios *termi;  /* the shell's terminal state */
+	struct list *plugins;   /* plugins to run, or 'no_plugins' */
+	struct list no_plugins;
+	struct esh_event_ring events;
+	struct esh_env env;
+	int fd[3];              /* stdin, stdout and stderr of commands */
+	FILE *out;              /* output of builtins */
+	FILE *err;              /* errors of builtins and of the shell */
+	struct esh_command_line *(*parse)(char *);
+	bool tail_exec;         /* running the last line of the process */
+	bool subshell;          /* a forked copy running a group or $(...) */
+	volatile sig_atomic_t slots_freed;  /* a job ended or stopped since
+	                                       queued jobs were last started */
+	bool exited;            /* 'exit' ran */
+	int exit_status;
+};
+
+/* The context whose children the SIGCHLD handler reaps */
+static struct esh_context *process_ctx;
+
+static void change_chld_stat(struct esh_context *ctx, pid_t chld, int stat);
+static void start_queued_jobs(struct esh_context *ctx);
+static void start_freed_slots(struct esh_context *ctx);
+static int run_command_line(struct esh_context *ctx, struct esh_command_line *cline);
+
+static void print_pipeline_words(FILE *out, struct esh_pipeline *pipe);
+
+/* Print the words of 'cmd', or the pipelines of a group in brackets */
+static void print_words(FILE *out, struct esh_command *cmd) {
+	if (cmd->group == NULL) {
+		char **p = cmd->argv;
+		while (*p) {
+			fprintf(out, "%s", *p);
+			p++;
+			if(*p != NULL) {
+				fprintf(out, " ");
+			}
+		}
+		return;
+	}
+	fprintf(out, "%s", cmd->subshell ? "(" : "{");
+	struct list_elem * e = list_begin(&cmd->group->pipes);
+	for (; e != list_end(&cmd->group->pipes); e = list_next(e)) {
+		struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+		bool last = e == list_rbegin(&cmd->group->pipes);
+		fprintf(out, " ");
+		print_pipeline_words(out, pipe);
+		/* '}' needs a separator before it, ')' does not */
+		fprintf(out, "%s", pipe->bg_job ? " &" : !last || !cmd->subshell ? ";" : "");
+	}
+	fprintf(out, " %s", cmd->subshell ? ")" : "}");
+}
+
+/* Print the commands of 'pipe', separated by | */
+static void print_pipeline_words(FILE *out, struct esh_pipeline *pipe) {
+	struct list_elem * e = list_begin(&pipe->commands);
+	for (; e != list_end(&pipe->commands); e = list_next(e)) {
+		print_words(out, list_entry(e, struct esh_command, elem));
+		if (e != list_rbegin(&pipe->commands)) {
+			fprintf(out, "|");
+		}
+	}
+}
+
+/**
+*This method print the commands in the pipeline
+*/
+static void print_command(struct esh_context *ctx, struct esh_pipeline *Ljobs, bool verbose) {
+    FILE *out = ctx->out;
+    fprintf(out, "\n[%d]", Ljobs->jid);
+    if(&Ljobs->elem == list_prev(list_rbegin(&ctx->jobs))) {
+        fprintf(out, "-");
+    }
+    if(&Ljobs->elem == list_rbegin(&ctx->jobs)) {
+        fprintf(out, "+");
+    }
+
+    if(Ljobs->status == BACKGROUND) {
+        fprintf(out, " Running\t\t");
+    }
+    if(Ljobs->status == STOPPED) {
+        fprintf(out, " Stopped\t\t");
+    }
+    if(Ljobs->status == FOREGROUND) {
+        fprintf(out, " Foreground\t\t");
+    }
+    if(Ljobs->status == NEEDSTERMINAL) {
+        fprintf(out, " Need Terminal\t\t");
+    }
+    if(Ljobs->status == QUEUED) {
+        fprintf(out, " Queued\t\t");
+    }
+    if (verbose) {
+        fprintf(out, "%d\t%s\t", Ljobs->pgrp,
+            Ljobs->placement ? Ljobs->placement->desc : "-");
+    }
+
+    fprintf(out, "(");
+    print_pipeline_words(out, Ljobs);
+
+
+    if (Ljobs->bg_job)
+        fprintf(out, " &");
+
+    fprintf(out, ")\n");
+}
+
+/* Print an error about the last syscall to the context's error output,
+ * as esh_sys_error does to stderr */
+static void ctx_error(struct esh_context *ctx, char *fmt, ...) {
+	char errbuf[1024];
+	char *errmsg = strerror_r(errno, errbuf, sizeof errbuf);
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(ctx->err, fmt, ap);
+	va_end(ap);
+	fprintf(ctx->err, "%s\n", errmsg);
+}
+
+static struct esh_pipeline * get_job_from_jid(struct esh_context *ctx, int jid) {
+	struct list_elem * e = list_begin (&ctx->jobs);
+	for (; e != list_end(&ctx->jobs); e = list_next(e)) {
+		struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+		if (job->jid == jid) {
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/* A coprocess: a long-lived job whose stdin and stdout are pipes
+ * that later commands can redirect to and from with >%NAME and <%NAME. */
+struct coproc {
+    struct list_elem elem;
+    char *name;
+    struct esh_pipeline *job;
+    int to[2];      /* pipe to the coprocess's stdin */
+    int from[2];    /* pipe from the coprocess's stdout */
+};
+
+static struct coproc * get_coproc(struct esh_context *ctx, const char *name) {
+	struct list_elem * e = list_begin(&ctx->coprocs);
+	for (; e != list_end(&ctx->coprocs); e = list_next(e)) {
+		struct coproc *cp = list_entry(e, struct coproc, elem);
+		if (strcmp(cp->name, name) == 0) {
+			return cp;
+		}
+	}
+	return NULL;
+}
+
+/* Return the fd that a command of pipeline 'pipe' should use to read
+ * from (or write to, if 'output') coprocess 'name', or -1.  The
+ * coprocess's own job gets the far ends of the pipes. */
+static int coproc_fd(struct esh_context *ctx, const char *name, struct esh_pipeline *pipe, bool output) {
+	struct coproc *cp = get_coproc(ctx, name);
+	if (cp == NULL) {
+		return -1;
+	}
+	if (cp->job == pipe) {
+		return output ? cp->from[1] : cp->to[0];
+	}
+	return output ? cp->to[1] : cp->from[0];
+}
+
+/* Forget the coprocess run by job 'pipe', if any, once it is gone.
+ * Called from the SIGCHLD handler: it is freed later, by
+ * deliver_events. */
+static void coproc_job_done(struct esh_context *ctx, struct esh_pipeline *pipe) {
+	struct list_elem * e = list_begin(&ctx->coprocs);
+	for (; e != list_end(&ctx->coprocs); e = list_next(e)) {
+		struct coproc *cp = list_entry(e, struct coproc, elem);
+		if (cp->job == pipe) {
+			close(cp->to[1]);
+			close(cp->from[0]);
+			list_remove(&cp->elem);
+			list_push_back(&ctx->dead_coprocs, &cp->elem);
+			return;
+		}
+	}
+}
+
+/* Same for a pipeline, before it is run */
+static bool
+plugins_process_pipeline(struct esh_context *ctx, struct esh_pipeline *pipe)
+{
+    struct list_elem * e = list_begin(ctx->plugins);
+    for (; e != list_end(ctx->plugins); e = list_next(e)) {
+        struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+        if (plugin->process_pipeline == NULL)
+            continue;
+
+        struct esh_hook_timer t;
+        esh_hook_begin(&t);
+        bool stop = plugin->process_pipeline(pipe);
+        esh_hook_end(&t, plugin, ESH_HOOK_PIPELINE);
+        if (stop)
+            return true;
+    }
+    return false;
+}
+
+/* Run 'cmd' if it is a builtin provided by a plugin */
+static bool
+plugins_process_builtin(struct esh_context *ctx, struct esh_command *cmd)
+{
+    struct list_elem * e = list_begin(ctx->plugins);
+    for (; e != list_end(ctx->plugins); e = list_next(e)) {
+        struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+        if (plugin->process_builtin == NULL)
+            continue;
+
+        struct esh_hook_timer t;
+        esh_hook_begin(&t);
+        bool done = plugin->process_builtin(cmd);
+        esh_hook_end(&t, plugin, ESH_HOOK_BUILTIN);
+        if (done)
+            return true;
+    }
+    return false;
+}
+
+/* Tell plugins that all processes of 'pipe' have been forked */
+static void
+plugins_pipeline_forked(struct esh_context *ctx, struct esh_pipeline *pipe)
+{
+    struct list_elem * e = list_begin(ctx->plugins);
+    for (; e != list_end(ctx->plugins); e = list_next(e)) {
+        struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+        if (plugin->pipeline_forked == NULL)
+            continue;
+
+        struct esh_hook_timer t;
+        esh_hook_begin(&t);
+        plugin->pipeline_forked(pipe);
+        esh_hook_end(&t, plugin, ESH_HOOK_FORKED);
+    }
+}
+
+/*
+ * SIGCHLD handler.
+ * Call waitpid() to learn about any child processes that
+ * have exited or changed status (been stopped, needed the
+ * terminal, etc.)
+ * Just record the information by updating the job list
+ * data structures.  Since the call may be spurious (e.g.
+ * already pending SIGCHLD is delivered even though
+ * a foreground process was already reaped), ignore when
+ * waitpid returns -1.
+ * Use a loop with WNOHANG since only a single SIGCHLD
+ * signal may be delivered for multiple children that have
+ * exited.
+ */
+static void
+sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
+{
+    pid_t child;
+    int status;
+
+    assert(sig == SIGCHLD);
+
+    while ((child = waitpid(-1, &status, WUNTRACED|WNOHANG)) > 0) {
+        change_chld_stat(process_ctx, child, status);
+    }
+}
+
+/* Reap the children of a context other than the process context that
+ * changed state, without blocking */
+static void
+reap_children(struct esh_context *ctx)
+{
+    struct list_elem * e = list_begin(&ctx->jobs);
+    while (e != list_end(&ctx->jobs)) {
+        struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+        /* a job that finishes moves to 'finished' */
+        e = list_next(e);
+
+        struct list_elem *c = list_begin(&job->commands);
+        for (; c != list_end(&job->commands); c = list_next(c)) {
+            struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+            int status;
+            if (cmd->pid > 0 && !cmd->exited
+                && waitpid(cmd->pid, &status, WUNTRACED|WNOHANG) > 0) {
+                change_chld_stat(ctx, cmd->pid, status);
+            }
+        }
+    }
+}
+
+/* Deliver queued status events to plugins, then free the jobs that
+ * have finished.  The events hold references to their pipelines, so a
+ * job goes away only after plugins have seen its last event.  Captured
+ * output outlives the job, for 'jobs -o'. */
+static void
+deliver_events(struct esh_context *ctx)
+{
+    esh_event_deliver(&ctx->events, ctx->plugins);
+
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    while (!list_empty(&ctx->finished)) {
+        struct list_elem *e = list_pop_front(&ctx->finished);
+        struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+        if (pipe->output != NULL) {
+            esh_output_retire(pipe->output);
+            pipe->output = NULL;
+        }
+        esh_pipeline_free(pipe);
+    }
+    while (!list_empty(&ctx->dead_coprocs)) {
+        struct list_elem *e = list_pop_front(&ctx->dead_coprocs);
+        struct coproc *cp = list_entry(e, struct coproc, elem);
+        free(cp->name);
+        free(cp);
+    }
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+}
+
+static struct esh_command * get_command_from_pid(struct esh_context *ctx, pid_t pid) {
+    struct list_elem * e = list_begin(&ctx->jobs);
+	for (; e != list_end(&ctx->jobs); e = list_next(e)) {
+		struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+		struct list_elem *c = list_begin(&pipe->commands);
+		for (; c != list_end(&pipe->commands); c = list_next(c)) {
+			struct esh_command *command = list_entry(c, struct esh_command, elem);
+			if (command->pid == pid) {
+			return command;
+		}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Assign ownership of ther terminal to process group
+ * pgrp, restoring its terminal state if provided.
+ *
+ * Before printing a new prompt, the shell should
+ * invoke this function with its own process group
+ * id (obtained on startup via getpgrp()) and a
+ * sane terminal state (obtained on startup via
+ * esh_sys_tty_init()).
+ */
+static void
+give_terminal_to(struct esh_context *ctx, pid_t pgrp, struct termios *pg_tty_state)
+{
+    if (ctx->headless)
+        return;
+
+    esh_signal_block(SIGTTOU);
+    int rc = tcsetpgrp(esh_sys_tty_getfd(), pgrp);
+    if (rc == -1)
+        esh_sys_fatal_error("tcsetpgrp: ");
+
+    if (pg_tty_state)
+        esh_sys_tty_restore(pg_tty_state);
+    esh_signal_unblock(SIGTTOU);
+}
+
+/* True if every process of 'pipe' has exited */
+static bool pipeline_exited(struct esh_pipeline *pipe) {
+	struct list_elem *c = list_begin(&pipe->commands);
+	for (; c != list_end(&pipe->commands); c = list_next(c)) {
+		if (!list_entry(c, struct esh_command, elem)->exited) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* You may use this code in your shell without attribution. */
+static void change_chld_stat(struct esh_context *ctx, pid_t chld, int stat) {
+	assert(chld > 0);
+	struct esh_command *cmd = get_command_from_pid(ctx, chld);
+	if (cmd == NULL) {
+		fprintf(ctx->err, "no such job\n");
+		//give_terminal_to(getpgrp(), termi);
+
+		return;
+	}
+	if (ctx->subshell && WIFSTOPPED(stat)) {
+		/* its jobs share the subshell's process group, so it stopped
+		 * and continues along with them; keep waiting */
+		return;
+	}
+	esh_event_push(&ctx->events, cmd, stat);
+	struct esh_pipeline * chld_pipe = cmd->pipeline;
+	if (&cmd->elem == list_rbegin(&chld_pipe->commands)) {
+		chld_pipe->waitstatus = stat;
+	}
+	/* only the foreground job's end hands the terminal back;
+	 * a background job exiting must not take it from the foreground */
+	bool was_fg = chld_pipe->status == FOREGROUND;
+	/* a job is done once all of its processes are, not just the last */
+	if (WIFEXITED(stat) || WIFSIGNALED(stat)) {
+		cmd->exited = true;
+		if (pipeline_exited(chld_pipe)) {
+			chld_pipe->status = BACKGROUND;
+			list_remove(&chld_pipe->elem);
+			list_push_back(&ctx->finished, &chld_pipe->elem);
+			coproc_job_done(ctx, chld_pipe);
+			if (was_fg) {
+				give_terminal_to(ctx, getpgrp(), ctx->termi);
+			}
+		}
+	}
+	if (WIFSTOPPED(stat)) {
+		chld_pipe->status = STOPPED;
+		esh_sched_background(chld_pipe, ctx->use_pgrps);
+		/* a job stopped with 'stop' (SIGSTOP) is not reported */
+		if (WSTOPSIG(stat) != SIGSTOP) {
+			print_command(ctx, chld_pipe, false);
+		}
+		if (was_fg) {
+			give_terminal_to(ctx, getpgrp(), ctx->termi);
+		}
+	}
+
+	/* queued jobs are started from the main loop: launching forks,
+	 * allocates and runs plugin hooks, none of it safe in a handler */
+	ctx->slots_freed = 1;
+
+	if (list_empty(&ctx->jobs)) {
+		ctx->jcount = 0;
+	}
+}
+
+/* A process of 'job' that has not exited, or 0 */
+static pid_t running_pid(struct esh_pipeline *job) {
+	struct list_elem *c = list_begin(&job->commands);
+	for (; c != list_end(&job->commands); c = list_next(c)) {
+		struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+		if (cmd->pid > 0 && !cmd->exited) {
+			return cmd->pid;
+		}
+	}
+	return 0;
+}
+
+/* The child to wait for until 'job' changes: any child for the process
+ * context, else a process of 'job' or, while it is queued, of another
+ * job of the context.  0 if there is none. */
+static pid_t wait_pid(struct esh_context *ctx, struct esh_pipeline *job) {
+	if (ctx->flags & ESH_CONTEXT_PROCESS) {
+		return -1;
+	}
+	pid_t pid = running_pid(job);
+	struct list_elem *e = list_begin(&ctx->jobs);
+	for (; pid == 0 && e != list_end(&ctx->jobs); e = list_next(e)) {
+		pid = running_pid(list_entry(e, struct esh_pipeline, elem));
+	}
+	return pid;
+}
+
+/* Wait until 'job' has exited or stopped */
+static void job_wait(struct esh_context *ctx, struct esh_pipeline *job) {
+	assert(esh_signal_is_blocked(SIGCHLD));
+
+	while (!pipeline_exited(job) && job->status != STOPPED) {
+		int stat;
+		pid_t pid = wait_pid(ctx, job);
+		if (pid == 0) {
+			break;
+		}
+		pid_t chld = waitpid(pid, &stat, WUNTRACED);
+		if (chld != -1) {
+			change_chld_stat(ctx, chld, stat);
+			start_freed_slots(ctx);
+		}
+		else if (errno == ECHILD) {
+			break;
+		}
+	}
+}
+
+/* Make the context's descriptors the child's stdin, stdout and stderr */
+static int dup_context_io(struct esh_context *ctx) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (ctx->fd[i] != i && dup2(ctx->fd[i], i) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Open what 'command' of pipeline '_pipe' redirects its stdin and
+ * stdout to: files, a here-document's memfd or coprocess pipes.  A
+ * %NAME target is coprocess NAME if there is one, else a file.  Sets
+ * fd[0] and fd[1] to the descriptors, or to -1 if not redirected, and
+ * own[i] if fd[i] is the caller's to close; coprocess pipes stay open,
+ * they are close-on-exec.  Returns -1 after printing an error. */
+static int open_redirections(struct esh_context *ctx, struct esh_command *command, struct esh_pipeline *_pipe, int fd[2], bool own[2]) {
+	fd[0] = fd[1] = -1;
+	own[0] = own[1] = true;
+	if (command->iored_input != NULL) {
+		if (command->iored_input[0] == '%'
+				&& (fd[0] = coproc_fd(ctx, command->iored_input + 1, _pipe, false)) >= 0) {
+			own[0] = false;
+		}
+		else if ((fd[0] = open(command->iored_input, O_RDONLY | O_CLOEXEC)) < 0) {
+			ctx_error(ctx, "execute: open failed\n");
+			return -1;
+		}
+	}
+	else if (command->iored_here != NULL) {
+		fd[0] = esh_sys_memfd_from_buffer("esh-heredoc",
+				command->iored_here, strlen(command->iored_here));
+		if (fd[0] < 0) {
+			ctx_error(ctx, "execute: memfd_create failed\n");
+			return -1;
+		}
+	}
+	if (command->iored_output != NULL) {
+		int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (command->append_to_output ? O_APPEND : O_TRUNC);
+		if (command->iored_output[0] == '%'
+				&& (fd[1] = coproc_fd(ctx, command->iored_output + 1, _pipe, true)) >= 0) {
+			own[1] = false;
+		}
+		else if ((fd[1] = open(command->iored_output, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) < 0) {
+			ctx_error(ctx, "execute: open failed\n");
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	if (fd[0] >= 0 && own[0]) {
+		close(fd[0]);
+	}
+	return -1;
+}
+
+/* Apply the redirections of 'command' of pipeline '_pipe' to the
+ * process's stdin and stdout.  Returns -1 after printing an error. */
+static int redirect(struct esh_context *ctx, struct esh_command *command, struct esh_pipeline *_pipe) {
+	int fd[2], i, rc = 0;
+	bool own[2];
+	if (open_redirections(ctx, command, _pipe, fd, own) < 0) {
+		return -1;
+	}
+	for (i = 0; i < 2; i++) {
+		if (fd[i] < 0) {
+			continue;
+		}
+		if (rc == 0 && dup2(fd[i], i) < 0) {
+			ctx_error(ctx, "execute: dup2 failed\n");
+			rc = -1;
+		}
+		if (own[i]) {
+			close(fd[i]);
+		}
+	}
+	return rc;
+}
+
+/* Make the child just forked for a group or a substitution a shell of
+ * its own: headless, without the parent's jobs or plugins, with its
+ * stdin, stdout and stderr in place.  Its last command may replace it. */
+static void become_subshell(struct esh_context *ctx) {
+	int i;
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	for (i = 0; i < 3; i++) {
+		ctx->fd[i] = i;
+	}
+	ctx->out = stdout;
+	ctx->err = stderr;
+	list_init(&ctx->jobs);
+	list_init(&ctx->finished);
+	list_init(&ctx->dead_coprocs);
+	ctx->plugins = &ctx->no_plugins;
+	ctx->jcount = 0;
+	ctx->job_slots = 0;
+	ctx->headless = true;
+	ctx->use_pgrps = false;
+	ctx->subshell = true;
+	ctx->tail_exec = true;
+	esh_signal_unblock(SIGCHLD);
+}
+
+/* Run group 'command' in the child forked for it.  Returns the exit
+ * status. */
+static int run_subshell(struct esh_context *ctx, struct esh_command *command) {
+	become_subshell(ctx);
+	int status = run_command_line(ctx, command->group);
+	if (ctx->exited) {
+		return ctx->exit_status;
+	}
+	return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/* Run brace group 'command' of pipeline '_pipe' in the shell itself.
+ * Its redirections apply to all of its pipelines: the process context
+ * moves them onto its own stdin and stdout while it runs, other
+ * contexts hand them to its commands and builtins instead.  If 'tail',
+ * its last pipeline is the last the shell runs.  Returns the wait
+ * status of its last foreground job. */
+static int run_group(struct esh_context *ctx, struct esh_command *command, struct esh_pipeline *_pipe, bool tail) {
+	int fd[2], saved[2] = { -1, -1 }, ctx_fd[2] = { ctx->fd[0], ctx->fd[1] }, i;
+	bool own[2], process = ctx->flags & ESH_CONTEXT_PROCESS, tail_exec = ctx->tail_exec;
+	FILE *out = ctx->out;
+
+	if (open_redirections(ctx, command, _pipe, fd, own) < 0) {
+		return W_EXITCODE(1, 0);
+	}
+	fflush(NULL);
+	for (i = 0; i < 2; i++) {
+		if (fd[i] < 0) {
+			continue;
+		}
+		if (process) {
+			saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+			dup2(fd[i], i);
+			ctx->fd[i] = i;
+		}
+		else {
+			ctx->fd[i] = fd[i];
+		}
+	}
+	if (fd[1] >= 0 && (!process || out != stdout)) {
+		int d = fcntl(fd[1], F_DUPFD_CLOEXEC, 3);
+		FILE *f = d < 0 ? NULL : fdopen(d, "w");
+		if (f != NULL) {
+			ctx->out = f;
+		}
+	}
+
+	ctx->tail_exec = tail;
+	int status = run_command_line(ctx, command->group);
+	ctx->tail_exec = tail_exec;
+
+	fflush(NULL);
+	if (ctx->out != out) {
+		fclose(ctx->out);
+		ctx->out = out;
+	}
+	for (i = 0; i < 2; i++) {
+		if (saved[i] >= 0) {
+			dup2(saved[i], i);
+			close(saved[i]);
+		}
+		ctx->fd[i] = ctx_fd[i];
+		if (fd[i] >= 0 && own[i]) {
+			close(fd[i]);
+		}
+	}
+	return status;
+}
+
+/* Fork and exec the commands of pipeline '_pipe', which must already
+ * be in the jobs list.  A foreground pipeline gets the terminal; the
+ * caller waits for it.
+ * SIGCHLD is restored to its previous state on return. */
+static void launch_pipeline(struct esh_context *ctx, struct esh_pipeline *_pipe) {
+	struct esh_plumbing plumbing;
+	bool was_blocked = esh_signal_block(SIGCHLD);
+	int outfd = -1;
+	if (_pipe->bg_job && _pipe->output == NULL && (ctx->flags & ESH_CONTEXT_PROCESS) && !ctx->subshell) {
+		_pipe->output = esh_output_open(_pipe->jid, &outfd);
+	}
+	esh_plumbing_init(&plumbing);
+	struct list_elem *c = list_begin(&_pipe->commands);
+	for (; c != list_end(&_pipe->commands); c = list_next(c)) {
+		if (list_entry(c, struct esh_command, elem)->group != NULL) {
+			/* a forked group exits through stdio; leave it nothing to repeat */
+			fflush(NULL);
+			break;
+		}
+	}
+	c = list_begin(&_pipe->commands);
+	for (; c != list_end(&_pipe->commands); c = list_next(c)) {
+		struct esh_command *command = list_entry(c, struct esh_command, elem);
+		bool last = c == list_rbegin(&_pipe->commands);
+		if (esh_plumbing_next(&plumbing, last) < 0) {
+			esh_sys_fatal_error("execute: pipe failed");
+		}
+
+		pid_t fork_pid = fork();
+
+		if (fork_pid < 0) {
+			//error
+			esh_plumbing_close(&plumbing);
+			esh_sys_fatal_error("execute: fork failed");
+		}
+		else if (fork_pid == 0) {
+			//child  process
+			fork_pid = getpid();
+			if (c == list_begin(&_pipe->commands)) {
+				_pipe->pgrp = fork_pid;
+			}
+			if (ctx->use_pgrps) {
+				setpgid(fork_pid, _pipe->pgrp);
+			}
+			command->pid = fork_pid;
+
+			if (dup_context_io(ctx) < 0 || esh_plumbing_child(&plumbing) < 0) {
+				esh_sys_fatal_error("execute: dup2 failed\n");
+			}
+			if (redirect(ctx, command, _pipe) < 0) {
+				exit(EXIT_FAILURE);
+			}
+			if (outfd >= 0) {
+				/* a captured job writes to its pipe, unless redirected */
+				if ((last && command->iored_output == NULL && dup2(outfd, 1) < 0)
+						|| dup2(outfd, 2) < 0) {
+					esh_sys_fatal_error("execute: dup2 failed\n");
+				}
+			}
+			if (_pipe->bg_job) {
+				/* by pid, so also for jobs without a process group */
+				_pipe->status = BACKGROUND;
+				esh_sched_background_self();
+			}
+			else {
+				_pipe->status = FOREGROUND;
+				give_terminal_to(ctx, _pipe->pgrp, ctx->termi);
+			}
+
+			if (_pipe->placement != NULL && esh_placement_apply(_pipe->placement) < 0) {
+				esh_sys_error("on: cannot apply placement: ");
+			}
+
+			if (command->group != NULL) {
+				exit(run_subshell(ctx, command));
+			}
+			if (command->argv[0] == NULL) {
+				/* substitutions expanded to nothing */
+				exit(EXIT_SUCCESS);
+			}
+			if (command->env != NULL) {
+				environ = esh_env_overlay(&ctx->env, command->env);
+			}
+			else if (!ctx->env.is_environ) {
+				environ = esh_env_envp(&ctx->env);
+			}
+			if (command->batch > 0) {
+				esh_batch_exec(command);
+			}
+			if (execvp(command->argv[0], command->argv) < 0) {
+				esh_sys_fatal_error("%s: command not found\n", command->argv[0]);
+			}
+		}
+		else if (fork_pid > 0) {
+			//parent process
+			if (c == list_begin(&_pipe->commands)) {
+				_pipe->pgrp = fork_pid;
+			}
+
+			command->pid = fork_pid;
+			if (ctx->use_pgrps) {
+				setpgid(fork_pid, _pipe->pgrp);
+			}
+
+			esh_plumbing_parent(&plumbing);
+
+			if (_pipe->bg_job) {
+				_pipe->status = BACKGROUND;
+				/* the child put itself into the class */
+				_pipe->sched = esh_bg_sched;
+				if (last) {
+					fprintf(ctx->out, "[%d] %d\n", _pipe->jid, _pipe->pgrp);
+				}
+			}
+			else {
+				_pipe->status = FOREGROUND;
+				_pipe->sched = esh_sched_normal;
+			}
+			if (last) {
+				plugins_pipeline_forked(ctx, _pipe);
+			}
+		}
+	}
+	if (outfd >= 0) {
+		close(outfd);
+	}
+	if (!was_blocked) {
+		esh_signal_unblock(SIGCHLD);
+	}
+}
+
+/* Return true if no job slot is free for another background job */
+static bool job_slots_full(struct esh_context *ctx) {
+	if (ctx->job_slots == 0) {
+		return false;
+	}
+
+	int running = 0;
+	struct list_elem * e = list_begin(&ctx->jobs);
+	for (; e != list_end(&ctx->jobs); e = list_next(e)) {
+		struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+		if (job->status == BACKGROUND && job->vjob == NULL) {
+			running++;
+		}
+	}
+	return running >= ctx->job_slots;
+}
+
+/* Start queued jobs, oldest first, while job slots are free.
+ * Called when the limit is raised, and by start_freed_slots. */
+static void start_queued_jobs(struct esh_context *ctx) {
+	struct list_elem * e = list_begin(&ctx->jobs);
+	for (; e != list_end(&ctx->jobs) && !job_slots_full(ctx); e = list_next(e)) {
+		struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+		if (job->status == QUEUED) {
+			job->status = BACKGROUND;
+			launch_pipeline(ctx, job);
+		}
+	}
+}
+
+/* Start queued jobs if a job ended or stopped since the last call.
+ * SIGCHLD is blocked. */
+static void start_freed_slots(struct esh_context *ctx) {
+	if (ctx->slots_freed) {
+		ctx->slots_freed = 0;
+		start_queued_jobs(ctx);
+	}
+}
+
+/* Add '_pipe' to the jobs list and launch it, or queue it if it is a
+ * background job and all job slots are taken.  SIGCHLD is blocked. */
+static void start_job(struct esh_context *ctx, struct esh_pipeline *_pipe) {
+	/* check before adding it, so that it does not take a slot itself */
+	bool queue = _pipe->bg_job && job_slots_full(ctx);
+	ctx->jcount++;
+	_pipe->jid = ctx->jcount;
+	list_push_back(&ctx->jobs, &_pipe->elem);
+	if (queue) {
+		_pipe->status = QUEUED;
+		fprintf(ctx->out, "[%d] queued\n", _pipe->jid);
+	}
+	else {
+		launch_pipeline(ctx, _pipe);
+	}
+}
+
+/* True if nothing would be left to report after '_pipe' ran in place
+ * of the shell: no other jobs or coprocesses, no job output waiting to
+ * be shown and no plugin that follows jobs */
+static bool can_tail_exec(struct esh_context *ctx, struct esh_pipeline *_pipe) {
+	bool was_blocked = esh_signal_block(SIGCHLD);
+	bool idle = list_empty(&ctx->jobs) && list_empty(&ctx->finished) && list_empty(&ctx->coprocs)
+			&& (ctx->subshell || !esh_output_stream_pending());
+	if (!was_blocked) {
+		esh_signal_unblock(SIGCHLD);
+	}
+	if (!idle) {
+		return false;
+	}
+	struct list_elem * e = list_begin(ctx->plugins);
+	for (; e != list_end(ctx->plugins); e = list_next(e)) {
+		struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+		if (plugin->pipeline_forked != NULL || plugin->command_status_change != NULL
+				|| plugin->command_status_batch != NULL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Exec 'command' of the one-command pipeline '_pipe' in place of the
+ * shell, without forking.  If it cannot be run, undo the redirections,
+ * the environment and the signal mask and return the wait status of a
+ * command that was not found; a placement stays applied. */
+static int exec_command(struct esh_context *ctx, struct esh_command *command, struct esh_pipeline *_pipe) {
+	int saved[3], i;
+	char **saved_environ = environ;
+	sigset_t none, mask;
+
+	fflush(NULL);
+	for (i = 0; i < 3; i++) {
+		saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+	}
+	if (dup_context_io(ctx) < 0) {
+		esh_sys_error("exec: dup2 failed\n");
+	}
+	else if (redirect(ctx, command, _pipe) == 0) {
+		if (_pipe->placement != NULL && esh_placement_apply(_pipe->placement) < 0) {
+			esh_sys_error("on: cannot apply placement: ");
+		}
+		if (command->env != NULL) {
+			environ = esh_env_overlay(&ctx->env, command->env);
+		}
+		else if (!ctx->env.is_environ) {
+			environ = esh_env_envp(&ctx->env);
+		}
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, &mask);
+		if (command->batch > 0) {
+			esh_batch_exec(command);
+		}
+		execvp(command->argv[0], command->argv);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		fprintf(stderr, "%s: command not found\n", command->argv[0]);
+		if (command->env != NULL) {
+			free(environ);
+		}
+		environ = saved_environ;
+	}
+	for (i = 0; i < 3; i++) {
+		if (saved[i] >= 0) {
+			dup2(saved[i], i);
+			close(saved[i]);
+		}
+	}
+	return W_EXITCODE(127, 0);
+}
+
+/* Make the redirections of 'command' the shell's own, for 'exec' without
+ * a command */
+static void exec_redirect(struct esh_context *ctx, struct esh_command *command, struct esh_pipeline *_pipe) {
+	if (!(ctx->flags & ESH_CONTEXT_PROCESS)) {
+		fprintf(ctx->err, "exec: cannot redirect the shell of this context\n");
+		return;
+	}
+	fflush(NULL);
+	redirect(ctx, command, _pipe);
+}
+
+/* Pass 'sig' on to virtual job 'job' as a request.  The job honors a
+ * stop at its next checkpoint, but counts as stopped at once, as a
+ * process does once the SIGCHLD handler sees it stop. */
+static void signal_vjob(struct esh_pipeline *job, int sig) {
+	esh_vjob_signal(job->vjob, sig);
+	if (sig == SIGSTOP || sig == SIGTSTP) {
+		job->status = STOPPED;
+	}
+}
+
+/* Send signal 'sig' to all processes of 'job': to its process group,
+ * or, without process groups, to each command that was started.
+ * Returns -1 if no process could be signaled. */
+static int signal_job(struct esh_context *ctx, struct esh_pipeline *job, int sig) {
+	if (job->vjob != NULL) {
+		signal_vjob(job, sig);
+		return 0;
+	}
+	if (ctx->use_pgrps) {
+		return killpg(job->pgrp, sig);
+	}
+
+	int sent = 0;
+	struct list_elem * e = list_begin(&job->commands);
+	for (; e != list_end(&job->commands); e = list_next(e)) {
+		struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+		if (cmd->pid > 0 && kill(cmd->pid, sig) == 0) {
+			sent++;
+		}
+	}
+	return sent > 0 ? 0 : -1;
+}
+
+/* Print what virtual job 'job', which is done, wrote; after a line
+ * with how it ended if 'header' */
+static void report_vjob(struct esh_context *ctx, struct esh_pipeline *job, bool header) {
+	int status = esh_vjob_status(job->vjob);
+	size_t len;
+	const char *text = esh_vjob_output(job->vjob, &len);
+	if (header) {
+		fprintf(ctx->out, "[%d] ", job->jid);
+		if (WIFSIGNALED(status)) {
+			fprintf(ctx->out, "Killed\t\t");
+		}
+		else if (WEXITSTATUS(status) != 0) {
+			fprintf(ctx->out, "Exit %d\t\t", WEXITSTATUS(status));
+		}
+		else {
+			fprintf(ctx->out, "Done\t\t");
+		}
+		fprintf(ctx->out, "(");
+		print_pipeline_words(ctx->out, job);
+		fprintf(ctx->out, ")\n");
+	}
+	fwrite(text, 1, len, ctx->out);
+	if (len > 0 && text[len - 1] != '\n') {
+		fprintf(ctx->out, "\n");
+	}
+	fflush(ctx->out);
+}
+
+/* Move virtual job 'job', which is done, to 'finished', as
+ * change_chld_stat does once all processes of a job exited, and queue
+ * its status for plugins.  SIGCHLD is blocked. */
+static void finish_vjob(struct esh_context *ctx, struct esh_pipeline *job) {
+	job->waitstatus = esh_vjob_status(job->vjob);
+	struct list_elem *c = list_begin(&job->commands);
+	for (; c != list_end(&job->commands); c = list_next(c)) {
+		struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+		cmd->exited = true;
+		esh_event_push(&ctx->events, cmd, job->waitstatus);
+	}
+	job->status = BACKGROUND;
+	list_remove(&job->elem);
+	list_push_back(&ctx->finished, &job->elem);
+	if (list_empty(&ctx->jobs)) {
+		ctx->jcount = 0;
+	}
+}
+
+/* Report the virtual jobs that are done and finish them.
+ * SIGCHLD is blocked. */
+static void reap_vjobs(struct esh_context *ctx) {
+	struct list_elem * e = list_begin(&ctx->jobs);
+	while (e != list_end(&ctx->jobs)) {
+		struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+		e = list_next(e);
+		if (job->vjob != NULL && esh_vjob_wait(job->vjob, 0)) {
+			report_vjob(ctx, job, true);
+			finish_vjob(ctx, job);
+		}
+	}
+}
+
+/* Wait until virtual job 'job', in the foreground, is done or stopped.
+ * The shell keeps the terminal, so ^C and ^Z come to the shell: they
+ * are held back meanwhile and passed on to the job as requests to end
+ * or to stop.  SIGCHLD is blocked. */
+static void vjob_wait(struct esh_context *ctx, struct esh_pipeline *job) {
+	if (ctx->headless) {
+		esh_vjob_wait(job->vjob, -1);
+		report_vjob(ctx, job, false);
+		finish_vjob(ctx, job);
+		return;
+	}
+
+	sigset_t keys, old;
+	sigemptyset(&keys);
+	sigaddset(&keys, SIGINT);
+	sigaddset(&keys, SIGTSTP);
+	sigprocmask(SIG_BLOCK, &keys, &old);
+	while (!esh_vjob_wait(job->vjob, 50)) {
+		struct timespec now = { 0, 0 };
+		int sig = sigtimedwait(&keys, NULL, &now);
+		if (sig == SIGTSTP) {
+			signal_vjob(job, SIGTSTP);
+			print_command(ctx, job, false);
+			break;
+		}
+		if (sig == SIGINT) {
+			fprintf(ctx->out, "\n");
+			signal_vjob(job, SIGINT);
+		}
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	if (job->status != STOPPED) {
+		report_vjob(ctx, job, false);
+		finish_vjob(ctx, job);
+	}
+}
+
+/** processes the builtin commands, or returns false if input is not builtin */
+static bool Process(struct esh_context *ctx, char** argv) {
+	if(strcmp(argv[0], "kill") == 0) {
+		//fprintf(ctx->out, "Kill: %s\n", argv[1]);
+		if(argv[1] == NULL) {
+            fprintf(ctx->err, "kill: usage: kill");
+            return true;
+		}
+		struct esh_pipeline *job = get_job_from_jid(ctx, atoi(argv[1]));
+		if (job != NULL && job->status == QUEUED) {
+			/* never forked; just drop it from the queue */
+			esh_signal_block(SIGCHLD);
+			list_remove(&job->elem);
+			esh_pipeline_free(job);
+			esh_signal_unblock(SIGCHLD);
+		}
+		else if( job != NULL) {
+            if (signal_job(ctx, job, SIGKILL) < 0) {
+                ctx_error(ctx, "-bash: kill: (%s) - Operation not permitted\n", argv[1]);
+            }
+		}
+		else {
+             ctx_error(ctx, "-bash: kill: (%s) - Operation not permitted\n", argv[1]);
+		}
+
+		return true;
+	}
+
+	else if (strcmp(argv[0], "jobs") == 0) {
+		if (argv[1] != NULL && strcmp(argv[1], "-o") == 0) {
+			if (argv[2] == NULL) {
+				fprintf(ctx->err, "usage: jobs -o %%N\n");
+				return true;
+			}
+			int jid = atoi(argv[2][0] == '%' ? argv[2] + 1 : argv[2]);
+			struct esh_pipeline *job = get_job_from_jid(ctx, jid);
+			struct esh_output *out = job != NULL ? job->output : NULL;
+			/* only the process context captures job output */
+			if (job == NULL && (ctx->flags & ESH_CONTEXT_PROCESS)) {
+				out = esh_output_find_retired(jid);
+			}
+			if (out == NULL) {
+				fprintf(ctx->err, "jobs: %s: no captured output\n", argv[2]);
+			}
+			else if (esh_output_print(ctx->out, out) < 0) {
+				ctx_error(ctx, "jobs: ");
+			}
+			return true;
+		}
+		struct list_elem * j = list_begin(&ctx->jobs);
+
+		for(; j != list_end(&ctx->jobs); j = list_next(j)){
+			struct esh_pipeline *Ljobs = list_entry(j, struct esh_pipeline, elem);
+			print_command(ctx, Ljobs, argv[1] != NULL && strcmp(argv[1], "-l") == 0);
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "bg") == 0) {
+		if (!list_empty(&ctx->jobs)) {
+			if (argv[1] == NULL) {
+				struct list_elem * j = list_rbegin(&ctx->jobs);
+				struct esh_pipeline *job = list_entry(j, struct esh_pipeline, elem);
+				if (job->status == QUEUED) {
+					fprintf(ctx->err, "bg: job %d is queued\n", job->jid);
+					return true;
+				}
+				job->status = BACKGROUND;
+				fprintf(ctx->out, "[%d]+", job->jid);
+				esh_pipeline_print(ctx->out, job);
+				fprintf(ctx->out, "\n");
+				esh_sched_background(job, ctx->use_pgrps);
+				if (signal_job(ctx, job, SIGCONT) < 0) {
+					ctx_error(ctx, "bg: kill failed\n");
+				}
+			}
+			else {
+				struct list_elem * j = list_begin(&ctx->jobs);
+				struct esh_pipeline *job;
+				int jid = atoi(argv[1]);
+				int found = 0;
+				for (; j != list_end(&ctx->jobs); j = list_next(j)) {
+					job = list_entry(j, struct esh_pipeline, elem);
+					if (job->jid == jid) {
+						found++;
+						break;
+					}
+				}
+				if (!found) {
+					//Job not there
+					fprintf(ctx->err, "bg: %d: no such job\n", jid);
+				}
+				else {
+					if (job->status == QUEUED) {
+						fprintf(ctx->err, "bg: job %d is queued\n", job->jid);
+						return true;
+					}
+					job->status = BACKGROUND;
+					fprintf(ctx->out, "[%d]+", job->jid);
+					esh_pipeline_print(ctx->out, job);
+					fprintf(ctx->out, "\n");
+					esh_sched_background(job, ctx->use_pgrps);
+					if (signal_job(ctx, job, SIGCONT) < 0) {
+						ctx_error(ctx, "bg: kill failed\n");
+					}
+				}
+			}
+		}
+		else {
+			fprintf(ctx->err, "-bash: bg: current: no such job\n");
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "fg") == 0) {
+		if (argv[1] == NULL) {
+			struct list_elem * j = list_rbegin(&ctx->jobs);
+			struct esh_pipeline *job = list_entry(j, struct esh_pipeline, elem);
+			if(list_empty(&ctx->jobs)) {
+				fprintf(ctx->err, "-bash: fg: current: no such job\n");
+			}
+			else {
+				esh_signal_block(SIGCHLD);
+				if (job->status == QUEUED) {
+					/* never forked; start it as a foreground job */
+					job->bg_job = false;
+					job->status = FOREGROUND;
+					print_command(ctx, job, false);
+					launch_pipeline(ctx, job);
+					job_wait(ctx, job);
+					give_terminal_to(ctx, getpgrp(), ctx->termi);
+					esh_signal_unblock(SIGCHLD);
+					return true;
+				}
+				if (job->vjob != NULL) {
+					job->status = FOREGROUND;
+					print_command(ctx, job, false);
+					signal_job(ctx, job, SIGCONT);
+					vjob_wait(ctx, job);
+					esh_signal_unblock(SIGCHLD);
+					return true;
+				}
+				job->status = FOREGROUND;
+				print_command(ctx, job, false);
+				give_terminal_to(ctx, job->pgrp, ctx->termi);
+				esh_sched_foreground(job, ctx->use_pgrps);
+				esh_output_foreground(job->output, true);
+				if (signal_job(ctx, job, SIGCONT) < 0) {
+					ctx_error(ctx, "bg: kill failed\n");
+				}
+				job_wait(ctx, job);
+				esh_output_foreground(job->output, false);
+
+				//list_remove(&job->elem);
+				esh_signal_unblock(SIGCHLD);
+			}
+
+		}
+		else {
+			struct list_elem * j = list_begin(&ctx->jobs);
+			struct esh_pipeline *job;
+			int jid = atoi(argv[1]);
+			int found = 0;
+			for (; j != list_end(&ctx->jobs); j = list_next(j)) {
+				job = list_entry(j, struct esh_pipeline, elem);
+				if (job->jid == jid) {
+					found++;
+					break;
+				}
+			}
+			if (!found) {
+				//Job not there
+				fprintf(ctx->err, "bg: %d: no such job\n", jid);
+			}
+			else {
+				//list_remove(&job->elem);
+
+				esh_signal_block(SIGCHLD);
+				if (job->status == QUEUED) {
+					/* never forked; start it as a foreground job */
+					job->bg_job = false;
+					job->status = FOREGROUND;
+					print_command(ctx, job, false);
+					launch_pipeline(ctx, job);
+					job_wait(ctx, job);
+					give_terminal_to(ctx, getpgrp(), ctx->termi);
+					esh_signal_unblock(SIGCHLD);
+					return true;
+				}
+				if (job->vjob != NULL) {
+					job->status = FOREGROUND;
+					print_command(ctx, job, false);
+					signal_job(ctx, job, SIGCONT);
+					vjob_wait(ctx, job);
+					esh_signal_unblock(SIGCHLD);
+					return true;
+				}
+				job->status = FOREGROUND;
+				print_command(ctx, job, false);
+				give_terminal_to(ctx, job->pgrp, ctx->termi);
+				esh_sched_foreground(job, ctx->use_pgrps);
+				esh_output_foreground(job->output, true);
+				if (signal_job(ctx, job, SIGCONT) < 0) {
+					ctx_error(ctx, "bg: kill failed\n");
+				}
+				job_wait(ctx, job);
+				esh_output_foreground(job->output, false);
+				esh_signal_unblock(SIGCHLD);
+			}
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "stop") == 0) {
+		if (argv[1] == NULL) {
+			fprintf(ctx->err, "usage: stop [jid]\n");
+		}
+		else {
+			struct esh_pipeline *job = get_job_from_jid(ctx, atoi(argv[1]));
+			if (job != NULL && job->status != QUEUED) {
+				signal_job(ctx, job, SIGSTOP);
+			}
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "jobslots") == 0) {
+		if (argv[1] == NULL) {
+			if (ctx->job_slots == 0) {
+				fprintf(ctx->out, "jobslots: unlimited\n");
+			}
+			else {
+				fprintf(ctx->out, "jobslots: %d\n", ctx->job_slots);
+			}
+		}
+		else {
+			esh_signal_block(SIGCHLD);
+			ctx->job_slots = atoi(argv[1]) > 0 ? atoi(argv[1]) : 0;
+			start_queued_jobs(ctx);
+			esh_signal_unblock(SIGCHLD);
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "bgsched") == 0) {
+		if (argv[1] == NULL) {
+			fprintf(ctx->out, "bgsched: ");
+			esh_sched_print(ctx->out, &esh_bg_sched);
+		}
+		else {
+			esh_sched_parse(ctx->err, argv + 1, &esh_bg_sched);
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "joboutput") == 0) {
+		if (argv[1] == NULL) {
+			fprintf(ctx->out, "joboutput: ");
+			esh_output_print_settings(ctx->out);
+		}
+		else {
+			esh_output_parse(ctx->err, argv + 1);
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "coproc") == 0) {
+		if (argv[1] == NULL || argv[2] == NULL) {
+			fprintf(ctx->err, "usage: coproc NAME command [args]\n");
+			return true;
+		}
+		if (get_coproc(ctx, argv[1]) != NULL) {
+			fprintf(ctx->err, "coproc: %s: coprocess exists\n", argv[1]);
+			return true;
+		}
+
+		struct coproc *cp = malloc(sizeof *cp);
+		if (cp == NULL) {
+			ctx_error(ctx, "coproc: malloc failed\n");
+			return true;
+		}
+		if (pipe2(cp->to, O_CLOEXEC) < 0) {
+			ctx_error(ctx, "coproc: pipe failed\n");
+			free(cp);
+			return true;
+		}
+		if (pipe2(cp->from, O_CLOEXEC) < 0) {
+			ctx_error(ctx, "coproc: pipe failed\n");
+			close(cp->to[0]);
+			close(cp->to[1]);
+			free(cp);
+			return true;
+		}
+		cp->name = strdup(argv[1]);
+
+		int argc = 0, i;
+		while (argv[argc + 2] != NULL) {
+			argc++;
+		}
+		char **cargv = malloc((argc + 1) * sizeof(char *));
+		for (i = 0; i < argc; i++) {
+			cargv[i] = strdup(argv[i + 2]);
+		}
+		cargv[argc] = NULL;
+
+		/* the coprocess reads from and writes to its own pipes */
+		size_t len = strlen(cp->name) + 2;
+		char *in = malloc(len), *out = malloc(len);
+		snprintf(in, len, "%%%s", cp->name);
+		snprintf(out, len, "%%%s", cp->name);
+		struct esh_pipeline *job = esh_pipeline_create(esh_command_create(cargv, in, out, false));
+		esh_pipeline_finish(job);
+		job->bg_job = true;
+		cp->job = job;
+
+		esh_signal_block(SIGCHLD);
+		list_push_back(&ctx->coprocs, &cp->elem);
+		ctx->jcount++;
+		job->jid = ctx->jcount;
+		list_push_back(&ctx->jobs, &job->elem);
+		job->status = BACKGROUND;
+		launch_pipeline(ctx, job);
+		close(cp->to[0]);
+		close(cp->from[1]);
+		esh_signal_unblock(SIGCHLD);
+		return true;
+	}
+	else if (strcmp(argv[0], "plugins") == 0) {
+		if (argv[1] == NULL) {
+			esh_hook_print(ctx->out);
+		}
+		else if (strcmp(argv[1], "budget") == 0 && argv[2] != NULL && argv[3] != NULL) {
+			if (!esh_hook_set_budget(argv[2], atof(argv[3]))) {
+				fprintf(ctx->err, "plugins: %s: no such plugin\n", argv[2]);
+			}
+		}
+		else {
+			fprintf(ctx->err, "usage: plugins [budget NAME MS]\n");
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "export") == 0) {
+		char **a = argv + 1;
+		if (*a == NULL) {
+			char **e = esh_env_envp(&ctx->env);
+			for (; *e != NULL; e++) {
+				fprintf(ctx->out, "export %s\n", *e);
+			}
+		}
+		for (; *a != NULL; a++) {
+			if (esh_env_is_assignment(*a)) {
+				esh_env_put(&ctx->env, *a);
+			}
+			else if (esh_env_get(&ctx->env, *a) == NULL) {
+				fprintf(ctx->err, "export: %s: not set\n", *a);
+			}
+		}
+		return true;
+	}
+	else if (strcmp(argv[0], "unset") == 0) {
+		char **a = argv + 1;
+		for (; *a != NULL; a++) {
+			esh_env_unset(&ctx->env, *a);
+		}
+		return true;
+	}
+	/* exit the shell; the caller decides how */
+	else if (strcmp(argv[0], "exit") == 0) {
+		ctx->exited = true;
+		ctx->exit_status = argv[1] != NULL ? atoi(argv[1]) : EXIT_SUCCESS;
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+
+/* Builtins that a command substitution made up only of builtins runs
+ * in the shell process, in the process context only.  They report on
+ * or act on the shell's own jobs, so $(jobs) lists them and the effect
+ * of $(kill %1) or $(bgsched batch) is kept, as no subshell is forked.
+ * Other builtins, e.g. coproc or export, run in the forked child. */
+static const char *subst_builtins[] = {
+	"kill", "jobs", "bg", "fg", "stop", "jobslots", "bgsched", "joboutput", NULL
+};
+
+/* True if 'cmd' can be run in the shell process itself */
+static bool is_nofork_builtin(struct esh_command *cmd) {
+	const char **b = subst_builtins;
+	if (cmd->iored_input || cmd->iored_output || cmd->iored_here || cmd->has_subst) {
+		return false;
+	}
+	for (; *b != NULL; b++) {
+		if (strcmp(cmd->argv[0], *b) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* True if argv word 'w' has quotes or a $(...) substitution to expand */
+static bool is_expanded_word(const char *w) {
+	return strpbrk(w, "'\"") != NULL || strstr(w, "$(") != NULL;
+}
+
+/* Make room for at least 'want' more bytes in arena 'buf' */
+static void arena_reserve(char **buf, size_t len, size_t *cap, size_t want) {
+	if (*cap - len >= want) {
+		return;
+	}
+	while (*cap - len < want) {
+		*cap = *cap ? 2 * *cap : 65536;
+	}
+	*buf = realloc(*buf, *cap);
+}
+
+/* Run command line 'text' of a $(...) substitution and append its
+ * standard output to arena 'buf'.
+ * If it consists of builtins only, the process context runs it in
+ * the shell process with stdout redirected to a memfd.  Otherwise it
+ * runs in one child whose stdout is a pipe, read with large reads.
+ * A single simple command is exec'd directly by that child. */
+static void capture_output(struct esh_context *ctx, char *text, char **buf, size_t *len, size_t *cap) {
+	struct esh_command_line *inner = ctx->parse(text);
+	if (inner == NULL) {
+		return;
+	}
+
+	/* other contexts share fd 1 with the rest of the process */
+	bool builtins_only = ctx->flags & ESH_CONTEXT_PROCESS;
+	bool simple = list_size(&inner->pipes) == 1;
+	struct list_elem *e = list_begin(&inner->pipes);
+	for (; e != list_end(&inner->pipes); e = list_next(e)) {
+		struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+		struct esh_command *cmd = list_entry(list_front(&pipe->commands), struct esh_command, elem);
+		if (list_size(&pipe->commands) != 1 || !is_nofork_builtin(cmd)) {
+			builtins_only = false;
+		}
+		if (list_size(&pipe->commands) != 1 || pipe->bg_job || cmd->group || cmd->iored_input
+				|| cmd->iored_output || cmd->iored_here || cmd->has_subst
+				|| strcmp(cmd->argv[0], "on") == 0 || is_nofork_builtin(cmd)
+				|| esh_env_is_assignment(cmd->argv[0])) {
+			simple = false;
+		}
+		char **w = cmd->argv;
+		for (; simple && *w != NULL; w++) {
+			if (esh_glob_is_pattern(*w) || is_expanded_word(*w)) {
+				simple = false;
+			}
+		}
+	}
+
+	if (builtins_only) {
+		int fd = memfd_create("esh-subst", MFD_CLOEXEC);
+		if (fd < 0) {
+			ctx_error(ctx, "$(): memfd_create failed: ");
+			esh_command_line_free(inner);
+			return;
+		}
+		fflush(stdout);
+		int saved = fcntl(1, F_DUPFD_CLOEXEC, 3);
+		dup2(fd, 1);
+		run_command_line(ctx, inner);
+		fflush(stdout);
+		dup2(saved, 1);
+		close(saved);
+
+		off_t size = lseek(fd, 0, SEEK_END);
+		arena_reserve(buf, *len, cap, size);
+		ssize_t n = size > 0 ? pread(fd, *buf + *len, size, 0) : 0;
+		if (n > 0) {
+			*len += n;
+		}
+		close(fd);
+		esh_command_line_free(inner);
+		return;
+	}
+
+	int p[2];
+	if (pipe2(p, O_CLOEXEC) < 0) {
+		ctx_error(ctx, "$(): pipe failed: ");
+		esh_command_line_free(inner);
+		return;
+	}
+	/* fewer, larger reads for big outputs */
+	fcntl(p[0], F_SETPIPE_SZ, 1 << 20);
+
+	bool was_blocked = esh_signal_block(SIGCHLD);
+	fflush(stdout);
+	fflush(ctx->out);
+	pid_t pid = fork();
+	if (pid < 0) {
+		esh_sys_fatal_error("$(): fork failed");
+	}
+	else if (pid == 0) {
+		dup2(p[1], 1);
+		ctx->fd[1] = 1;
+		if (dup_context_io(ctx) < 0) {
+			esh_sys_fatal_error("$(): dup2 failed");
+		}
+		become_subshell(ctx);
+		if (simple) {
+			struct esh_pipeline *pipe = list_entry(list_front(&inner->pipes), struct esh_pipeline, elem);
+			struct esh_command *cmd = list_entry(list_front(&pipe->commands), struct esh_command, elem);
+			/* other builtins run here, in the child */
+			if (Process(ctx, cmd->argv) || plugins_process_builtin(ctx, cmd)) {
+				fflush(stdout);
+				fflush(ctx->out);
+				exit(EXIT_SUCCESS);
+			}
+			if (!ctx->env.is_environ) {
+				environ = esh_env_envp(&ctx->env);
+			}
+			execvp(cmd->argv[0], cmd->argv);
+			esh_sys_fatal_error("%s: command not found\n", cmd->argv[0]);
+		}
+
+		run_command_line(ctx, inner);
+		exit(EXIT_SUCCESS);
+	}
+
+	close(p[1]);
+	for (;;) {
+		arena_reserve(buf, *len, cap, 65536);
+		ssize_t n = read(p[0], *buf + *len, *cap - *len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		*len += n;
+	}
+	close(p[0]);
+	waitpid(pid, NULL, 0);
+	if (!was_blocked) {
+		esh_signal_unblock(SIGCHLD);
+	}
+	esh_command_line_free(inner);
+}
+
+/* The ')' that closes the substitution whose text starts at 'p', or
+ * the end of the string.  Parentheses nest; quoted ones do not count. */
+static const char *subst_end(const char *p) {
+	int depth = 1;
+	char quote = 0;
+	for (; *p; p++) {
+		if (quote) {
+			if (*p == quote) {
+				quote = 0;
+			}
+		}
+		else if (*p == '\'' || *p == '"') {
+			quote = *p;
+		}
+		else if (*p == '(') {
+			depth++;
+		}
+		else if (*p == ')' && --depth == 0) {
+			break;
+		}
+	}
+	return p;
+}
+
+/* Words being built in an arena by expand_words */
+struct expansion {
+	char *buf;              /* the arena */
+	size_t len, cap;
+	size_t *words;          /* arena offsets of the words built so far */
+	size_t nwords, wcap;
+	bool open;              /* the last word is not terminated yet */
+};
+
+/* Start a word at the end of the arena unless one is open */
+static void open_word(struct expansion *x) {
+	if (x->open) {
+		return;
+	}
+	if (x->nwords == x->wcap) {
+		x->wcap = x->wcap ? 2 * x->wcap : 16;
+		x->words = realloc(x->words, x->wcap * sizeof *x->words);
+	}
+	x->words[x->nwords++] = x->len;
+	x->open = true;
+}
+
+/* Terminate the open word, if any */
+static void close_word(struct expansion *x) {
+	if (x->open) {
+		arena_reserve(&x->buf, x->len, &x->cap, 1);
+		x->buf[x->len++] = '\0';
+		x->open = false;
+	}
+}
+
+/* Split the output of a substitution, which is in the arena from
+ * offset 'from' on, into words at whitespace, in place.  Trailing
+ * newlines are dropped; the first word continues the open one, and the
+ * last one stays open.  With 'split' false the output is kept whole. */
+static void split_output(struct expansion *x, size_t from, bool split) {
+	size_t r, w = from, end = x->len;
+	while (end > from && x->buf[end - 1] == '\n') {
+		end--;
+	}
+	if (!split) {
+		x->len = end;
+		if (end > from) {
+			x->len = from;
+			open_word(x);
+			x->len = end;
+		}
+		return;
+	}
+	x->len = from;
+	for (r = from; r < end; r++) {
+		char c = x->buf[r];
+		if (strchr(" \t\n", c)) {
+			if (x->open) {
+				x->buf[w++] = '\0';
+				x->open = false;
+			}
+			continue;
+		}
+		if (!x->open) {
+			x->len = w;
+			open_word(x);
+		}
+		x->buf[w++] = c;
+	}
+	x->len = w;
+}
+
+/* Expand argv word 'w' into the arena: remove its quotes and replace
+ * its $(...) substitutions by their output.  Outside double quotes the
+ * output is split into words, except in a VAR=value assignment. */
+static void expand_word(struct esh_context *ctx, const char *w, struct expansion *x) {
+	bool assignment = esh_env_is_assignment(w);
+	char quote = 0;
+	while (*w) {
+		if (w[0] == '$' && w[1] == '(' && quote != '\'') {
+			const char *end = subst_end(w + 2);
+			char *text = strndup(w + 2, end - w - 2);
+			size_t from = x->len;
+			capture_output(ctx, text, &x->buf, &x->len, &x->cap);
+			free(text);
+			split_output(x, from, !quote && !assignment);
+			w = *end ? end + 1 : end;
+			continue;
+		}
+		if (quote ? *w == quote : *w == '\'' || *w == '"') {
+			/* '' and "" make a word even if empty */
+			open_word(x);
+			quote = quote ? 0 : *w;
+			w++;
+			continue;
+		}
+		open_word(x);
+		arena_reserve(&x->buf, x->len, &x->cap, 1);
+		x->buf[x->len++] = *w++;
+	}
+	close_word(x);
+}
+
+/* Replace the words of 'cmd' that have quotes or $(...) substitutions
+ * by their expansion, and glob patterns by the paths they match.
+ * All results go into one arena owned by the command; argv points
+ * into it. */
+static void expand_words(struct esh_context *ctx, struct esh_command *cmd) {
+	int argc = 0, i;
+	bool any = false;
+	while (cmd->argv[argc] != NULL) {
+		any = any || is_expanded_word(cmd->argv[argc])
+			|| esh_glob_is_pattern(cmd->argv[argc]);
+		argc++;
+	}
+	if (!any) {
+		return;
+	}
+
+	enum { PLAIN, EXPANDED, GLOB } kind[argc];
+	struct expansion x = { .buf = NULL };
+	/* byte ranges of globs, ranges of x.words for the others */
+	size_t start[argc], end[argc];
+	bool leading = true;
+	for (i = 0; i < argc; i++) {
+		kind[i] = PLAIN;
+		/* VAR=value prefixes are not globbed */
+		leading = leading && esh_env_is_assignment(cmd->argv[i]);
+		if (is_expanded_word(cmd->argv[i])) {
+			start[i] = x.nwords;
+			expand_word(ctx, cmd->argv[i], &x);
+			end[i] = x.nwords;
+			kind[i] = EXPANDED;
+			continue;
+		}
+		start[i] = x.len;
+		if (!leading && esh_glob_is_pattern(cmd->argv[i])
+				&& esh_glob(cmd->argv[i], &x.buf, &x.len, &x.cap) > 0) {
+			kind[i] = GLOB;
+		}
+		end[i] = x.len;
+	}
+
+	/* at most one glob path per two bytes */
+	char **argv = malloc((argc + x.nwords + x.len / 2 + 2) * sizeof(char *));
+	int n = 0;
+	for (i = 0; i < argc; i++) {
+		size_t k;
+		if (kind[i] == PLAIN) {
+			argv[n++] = cmd->argv[i];
+			continue;
+		}
+		else if (kind[i] == GLOB) {
+			/* one NUL terminated path each */
+			char *p = x.buf + start[i], *q = x.buf + end[i];
+			for (; p < q; p += strlen(p) + 1) {
+				argv[n++] = p;
+			}
+		}
+		else {
+			for (k = start[i]; k < end[i]; k++) {
+				argv[n++] = x.buf + x.words[k];
+			}
+		}
+		if (!cmd->pipeline->mapped) {
+			free(cmd->argv[i]);
+		}
+	}
+	argv[n] = NULL;
+	free(x.words);
+
+	if (!cmd->pipeline->mapped) {
+		free(cmd->argv);
+	}
+	if (x.buf == NULL) {
+		/* nothing was expanded into it; keep an arena to mark argv as ours */
+		x.buf = malloc(1);
+	}
+	cmd->argv = argv;
+	cmd->subst_arena = x.buf;
+	cmd->subst_arena_size = x.len;
+	cmd->has_subst = false;
+}
+
+/* Move the leading VAR=value words of 'cmd' from argv to cmd->env */
+static void split_assignments(struct esh_command *cmd) {
+	int n = 0, argc;
+	while (cmd->argv[n] != NULL && esh_env_is_assignment(cmd->argv[n])) {
+		n++;
+	}
+	if (n == 0) {
+		return;
+	}
+	for (argc = n; cmd->argv[argc] != NULL; argc++) {
+	}
+
+	cmd->env = malloc((n + 1) * sizeof(char *));
+	memcpy(cmd->env, cmd->argv, n * sizeof(char *));
+	cmd->env[n] = NULL;
+	memmove(cmd->argv, cmd->argv + n, (argc - n + 1) * sizeof(char *));
+}
+
+/* Remove the first 'n' words of 'cmd'.  Words in a script's image or
+ * in the substitution arena are not the command's to free. */
+static void drop_words(struct esh_command *cmd, int n) {
+	int argc, i;
+	char *arena = cmd->subst_arena;
+	for (i = 0; i < n; i++) {
+		char *w = cmd->argv[i];
+		if (!cmd->pipeline->mapped
+				&& (arena == NULL || w < arena || w >= arena + cmd->subst_arena_size)) {
+			free(w);
+		}
+	}
+	for (argc = n; cmd->argv[argc] != NULL; argc++) {
+	}
+	memmove(cmd->argv, cmd->argv + n, (argc - n + 1) * sizeof(char *));
+}
+
+/* Handle a 'batch' prefix of 'cmd'; returns false after an error */
+static bool split_batch(struct esh_command *cmd) {
+	int n;
+	if (cmd->argv[0] == NULL || strcmp(cmd->argv[0], "batch") != 0) {
+		return true;
+	}
+	cmd->batch = esh_batch_from_argv(cmd->argv, &n);
+	if (cmd->batch > 0) {
+		drop_words(cmd, n);
+	}
+	return cmd->batch > 0;
+}
+
+/* Run the pipelines of command line 'cline', removing them from it.
+ * Builtins run in the shell; other pipelines become jobs.  Returns
+ * the wait status of the last foreground job. */
+static int run_command_line(struct esh_context *ctx, struct esh_command_line *cline) {
+	int status = 0;
+	while (!list_empty(&cline->pipes) && !ctx->exited) {
+		struct esh_pipeline *_pipe = list_entry(list_pop_front(&cline->pipes), struct esh_pipeline, elem);
+		bool ok = true;
+		struct list_elem *c = list_begin(&_pipe->commands);
+		for (; c != list_end(&_pipe->commands); c = list_next(c)) {
+			struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+			expand_words(ctx, cmd);
+			ok = split_batch(cmd) && ok;
+			split_assignments(cmd);
+		}
+		if (!ok) {
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+
+		struct esh_command *first = list_entry(list_front(&_pipe->commands), struct esh_command, elem);
+		if (first->argv[0] == NULL && first->env != NULL && list_size(&_pipe->commands) == 1) {
+			/* plain VAR=value sets the variable */
+			char **a = first->env;
+			for (; *a != NULL; a++) {
+				esh_env_put(&ctx->env, *a);
+			}
+		}
+		if (first->argv[0] == NULL) {
+			/* nothing left after expansion */
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+		/* A brace group on its own runs in the shell, and so does a
+		 * subshell that is the last thing the process runs */
+		bool tail = ctx->tail_exec && list_empty(&cline->pipes);
+		if (first->group != NULL && list_size(&_pipe->commands) == 1 && !_pipe->bg_job
+				&& (!first->subshell || (tail && (ctx->flags & ESH_CONTEXT_PROCESS) && can_tail_exec(ctx, _pipe)))) {
+			status = run_group(ctx, first, _pipe, tail);
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+		bool exec = false;
+		if (strcmp(first->argv[0], "exec") == 0) {
+			/* the command replaces the shell, see below */
+			exec = true;
+			drop_words(first, 1);
+			if (first->argv[0] == NULL) {
+				exec_redirect(ctx, first, _pipe);
+				esh_pipeline_free(_pipe);
+				continue;
+			}
+			if (!split_batch(first)) {
+				esh_pipeline_free(_pipe);
+				continue;
+			}
+		}
+		if (strcmp(first->argv[0], "on") == 0) {
+			int n;
+			_pipe->placement = esh_placement_from_argv(first->argv, &n);
+			if (_pipe->placement != NULL) {
+				drop_words(first, n);
+			}
+			if (_pipe->placement != NULL && first->argv[0] == NULL) {
+				fprintf(ctx->err, "on: missing command\n");
+			}
+			if (_pipe->placement == NULL || first->argv[0] == NULL) {
+				esh_pipeline_free(_pipe);
+				continue;
+			}
+			if (!split_batch(first)) {
+				esh_pipeline_free(_pipe);
+				continue;
+			}
+		}
+		if (plugins_process_pipeline(ctx, _pipe)) {
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+		/* builtins walk and change the jobs list, as does the SIGCHLD
+		 * handler; a job it unlinks mid-walk would derail the walk */
+		bool was_blocked = esh_signal_block(SIGCHLD);
+		bool builtin = Process(ctx, first->argv);
+		if (!was_blocked) {
+			esh_signal_unblock(SIGCHLD);
+		}
+		if (builtin || plugins_process_builtin(ctx, first)) {
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+		if (_pipe->placement == NULL && _pipe->bg_job && list_size(&_pipe->commands) > 1) {
+			_pipe->placement = esh_placement_default();
+		}
+
+		/* A lone foreground command runs in place of the shell if 'exec'
+		 * asked for it, or if it is the last thing the shell runs */
+		esh_signal_block(SIGCHLD);
+		if ((ctx->flags & ESH_CONTEXT_PROCESS) && !_pipe->bg_job
+				&& list_size(&_pipe->commands) == 1 && first->group == NULL
+				&& (exec || (tail && can_tail_exec(ctx, _pipe)))) {
+			status = exec_command(ctx, first, _pipe);
+			esh_signal_unblock(SIGCHLD);
+			esh_pipeline_free(_pipe);
+			continue;
+		}
+		start_job(ctx, _pipe);
+		if (!_pipe->bg_job) {
+			job_wait(ctx, _pipe);
+			give_terminal_to(ctx, getpgrp(), ctx->termi);
+			status = _pipe->waitstatus;
+		}
+		esh_signal_unblock(SIGCHLD);
+		esh_context_poll(ctx);
+	}
+	return status;
+}
+
+struct esh_context *
+esh_context_create(int flags)
+{
+    struct esh_context *ctx = calloc(1, sizeof *ctx);
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->flags = flags;
+    list_init(&ctx->jobs);
+    list_init(&ctx->finished);
+    list_init(&ctx->coprocs);
+    list_init(&ctx->dead_coprocs);
+    list_init(&ctx->no_plugins);
+    atomic_init(&ctx->events.head, 0);
+    atomic_init(&ctx->events.tail, 0);
+    atomic_init(&ctx->events.dropped, 0);
+    ctx->fd[0] = 0;
+    ctx->fd[1] = 1;
+    ctx->fd[2] = 2;
+    ctx->out = stdout;
+    ctx->err = stderr;
+    ctx->parse = esh_parse_command_line;
+
+    /* Without a controlling terminal, run headless */
+    ctx->headless = (flags & ESH_CONTEXT_HEADLESS) || !(flags & ESH_CONTEXT_PROCESS);
+    if (!ctx->headless && (ctx->termi = esh_sys_tty_init()) == NULL)
+        ctx->headless = true;
+    ctx->use_pgrps = !ctx->headless || (flags & ESH_CONTEXT_PGRPS);
+
+    bool process = flags & ESH_CONTEXT_PROCESS;
+    esh_env_init(&ctx->env, process);
+    if (process) {
+        assert(process_ctx == NULL);
+        process_ctx = ctx;
+        ctx->plugins = &esh_plugin_list;
+        esh_output_init();
+        esh_signal_sethandler(SIGCHLD, sigchld_handler);
+    } else {
+        ctx->plugins = &ctx->no_plugins;
+    }
+    return ctx;
+}
+
+void
+esh_context_destroy(struct esh_context *ctx)
+{
+    struct list_elem *e;
+
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    /* queued jobs would start as the others end */
+    for (e = list_begin(&ctx->jobs); e != list_end(&ctx->jobs); ) {
+        struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+        e = list_next(e);
+        if (job->status == QUEUED) {
+            list_remove(&job->elem);
+            esh_pipeline_free(job);
+        }
+    }
+    for (e = list_begin(&ctx->jobs); e != list_end(&ctx->jobs); e = list_next(e)) {
+        struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+        signal_job(ctx, job, SIGKILL);
+    }
+    while (!list_empty(&ctx->jobs)) {
+        struct esh_pipeline *job = list_entry(list_front(&ctx->jobs), struct esh_pipeline, elem);
+        if (job->vjob != NULL) {
+            /* it ends at its next checkpoint */
+            esh_vjob_wait(job->vjob, -1);
+            finish_vjob(ctx, job);
+            continue;
+        }
+        pid_t pid = running_pid(job);
+        int status;
+        if (pid == 0 || waitpid(pid, &status, 0) < 0) {
+            /* reaped elsewhere, or never started */
+            list_remove(&job->elem);
+            list_push_back(&ctx->finished, &job->elem);
+            continue;
+        }
+        change_chld_stat(ctx, pid, status);
+    }
+    deliver_events(ctx);
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+
+    if (process_ctx == ctx) {
+        signal(SIGCHLD, SIG_DFL);
+        process_ctx = NULL;
+    }
+    esh_env_destroy(&ctx->env);
+    if (ctx->out != stdout)
+        fclose(ctx->out);
+    if (ctx->err != stderr)
+        fclose(ctx->err);
+    free(ctx);
+}
+
+/* A stream writing to a copy of 'fd', buffered as 'mode', or 'std'
+ * if it cannot be opened */
+static FILE *
+open_stream(int fd, int mode, FILE *std)
+{
+    int d = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    FILE *f = d < 0 ? NULL : fdopen(d, "w");
+    if (f == NULL) {
+        if (d >= 0)
+            close(d);
+        return std;
+    }
+    setvbuf(f, NULL, mode, 0);
+    return f;
+}
+
+void
+esh_context_set_io(struct esh_context *ctx, int in, int out, int err)
+{
+    ctx->fd[0] = in;
+    ctx->fd[1] = out;
+    ctx->fd[2] = err;
+    if (ctx->out != stdout)
+        fclose(ctx->out);
+    if (ctx->err != stderr)
+        fclose(ctx->err);
+    ctx->out = out != 1 ? open_stream(out, _IOLBF, stdout) : stdout;
+    ctx->err = err != 2 ? open_stream(err, _IONBF, stderr) : stderr;
+}
+
+void
+esh_context_set_job_slots(struct esh_context *ctx, int slots)
+{
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    ctx->job_slots = slots > 0 ? slots : 0;
+    start_queued_jobs(ctx);
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+}
+
+void
+esh_context_set_parser(struct esh_context *ctx,
+                       struct esh_command_line *(*parse)(char *))
+{
+    ctx->parse = parse;
+}
+
+struct esh_command_line *
+esh_context_parse(struct esh_context *ctx, const char *line)
+{
+    char *copy = strdup(line);
+    struct esh_command_line *cline = ctx->parse(copy);
+    free(copy);
+    return cline;
+}
+
+int
+esh_context_run(struct esh_context *ctx, struct esh_command_line *cline)
+{
+    int status = run_command_line(ctx, cline);
+    fflush(ctx->out);
+    return status;
+}
+
+int
+esh_context_run_last(struct esh_context *ctx, struct esh_command_line *cline)
+{
+    ctx->tail_exec = true;
+    int status = esh_context_run(ctx, cline);
+    ctx->tail_exec = false;
+    return status;
+}
+
+struct esh_pipeline *
+esh_context_launch(struct esh_context *ctx, struct esh_pipeline *pipe)
+{
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    start_job(ctx, pipe);
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+    return pipe;
+}
+
+int
+esh_context_wait(struct esh_context *ctx, struct esh_pipeline *job)
+{
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    bool fg = job->status == FOREGROUND;
+    if (job->vjob != NULL)
+        vjob_wait(ctx, job);
+    else
+        job_wait(ctx, job);
+    if (fg && job->vjob == NULL)
+        give_terminal_to(ctx, getpgrp(), ctx->termi);
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+    return job->waitstatus;
+}
+
+int
+esh_context_submit(struct esh_context *ctx, struct esh_pipeline *pipe,
+                   esh_vjob_fn fn, void *arg)
+{
+    struct esh_vjob *vjob = esh_vjob_start(fn, arg);
+    if (vjob == NULL)
+        return -1;
+
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    esh_pipeline_ref(pipe);
+    pipe->vjob = vjob;
+    ctx->jcount++;
+    pipe->jid = ctx->jcount;
+    list_push_back(&ctx->jobs, &pipe->elem);
+    int jid = pipe->jid;
+    if (pipe->bg_job) {
+        pipe->status = BACKGROUND;
+        fprintf(ctx->out, "[%d] virtual\n", jid);
+    } else {
+        pipe->status = FOREGROUND;
+        vjob_wait(ctx, pipe);
+    }
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+    return jid;
+}
+
+bool
+esh_context_vjobs_done(struct esh_context *ctx)
+{
+    bool done = false;
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    struct list_elem *e = list_begin(&ctx->jobs);
+    for (; e != list_end(&ctx->jobs) && !done; e = list_next(e)) {
+        struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
+        done = job->vjob != NULL && esh_vjob_wait(job->vjob, 0);
+    }
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+    return done;
+}
+
+void
+esh_context_poll(struct esh_context *ctx)
+{
+    bool was_blocked = esh_signal_block(SIGCHLD);
+    if (!(ctx->flags & ESH_CONTEXT_PROCESS))
+        reap_children(ctx);
+    reap_vjobs(ctx);
+    start_freed_slots(ctx);
+    if (!was_blocked)
+        esh_signal_unblock(SIGCHLD);
+    deliver_events(ctx);
+}
+
+bool
+esh_context_exited(struct esh_context *ctx, int *status)
+{
+    if (ctx->exited && status != NULL)
+        *status = ctx->exit_status;
+    return ctx->exited;
+}
+
+struct list *
+esh_context_jobs(struct esh_context *ctx)
+{
+    return &ctx->jobs;
+}
+
+unsigned long
+esh_context_dropped_events(struct esh_context *ctx)
+{
+    return esh_event_dropped(&ctx->events);
+}
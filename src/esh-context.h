@@ -0,0 +1,111 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Shell contexts.
+ *
+ * A context holds the state of one shell: its jobs and coprocesses,
+ * its environment, its queue of status events and its settings.  The
+ * esh binary runs a single process context, which owns what there is
+ * only one of per process: the controlling terminal, the SIGCHLD
+ * handler (reaping with waitpid(-1)), 'environ', the loaded plugins
+ * and the capture of job output.
+ *
+ * A program linking libesh.a may create any number of other contexts,
+ * and drive each from a thread of its own.  Such a context is headless,
+ * reaps only its own children, by pid, keeps a private copy of the
+ * environment, runs no plugins and writes builtin output to its own
+ * descriptor.  The host must not reap children with waitpid(-1).
+ * Process-wide settings (bgsched, joboutput) and plugin hook budgets
+ * stay shared.
+ */
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct esh_pipeline;
+struct esh_command_line;
+struct esh_vjob;
+struct list;
+
+/* Flags for esh_context_create */
+#define ESH_CONTEXT_PROCESS     1   /* the process context; at most one */
+#define ESH_CONTEXT_HEADLESS    2   /* no job control on a terminal */
+#define ESH_CONTEXT_PGRPS       4   /* headless, but still put each job in
+                                       its own process group */
+
+struct esh_context;
+
+/* Create a context.  A process context takes the terminal unless
+ * headless, or if stdin is not one, and installs the SIGCHLD handler. */
+struct esh_context * esh_context_create(int flags);
+
+/* Kill the context's remaining jobs, reap them and free the context.
+ * Virtual jobs are waited for until they honor the kill. */
+void esh_context_destroy(struct esh_context *ctx);
+
+/* Descriptors that the context's commands get as stdin, stdout and
+ * stderr; builtins write to 'out' and report errors to 'err'.  The
+ * default is 0, 1 and 2.  The context does not close them. */
+void esh_context_set_io(struct esh_context *ctx, int in, int out, int err);
+
+/* Run at most 'slots' background jobs at a time; 0 is unlimited */
+void esh_context_set_job_slots(struct esh_context *ctx, int slots);
+
+/* Parser used for $(...) substitutions; esh_parse_command_line by default */
+void esh_context_set_parser(struct esh_context *ctx,
+                            struct esh_command_line *(*parse)(char *));
+
+/* Parse 'line'.  Returns NULL after printing an error. */
+struct esh_command_line * esh_context_parse(struct esh_context *ctx,
+                                            const char *line);
+
+/* Run the pipelines of 'cline', removing them from it, as the shell
+ * runs a line typed at the prompt: words are expanded, builtins run
+ * in the context and other pipelines become jobs.  Foreground jobs
+ * are waited for.  Returns the wait status of the last one. */
+int esh_context_run(struct esh_context *ctx, struct esh_command_line *cline);
+
+/* Same for the last command line the process will run.  If its last
+ * pipeline is a single foreground command, and nothing would be left
+ * to report once it is done, the process context execs it in place of
+ * the shell rather than forking.  Returns only if it did not. */
+int esh_context_run_last(struct esh_context *ctx, struct esh_command_line *cline);
+
+/* Start 'pipe' as a job of the context without waiting for it, or
+ * queue it if it runs in the background and all job slots are taken.
+ * The context takes over the caller's reference.  Returns 'pipe',
+ * which stays valid until the job has finished and the next
+ * esh_context_poll; take a reference to keep it longer. */
+struct esh_pipeline * esh_context_launch(struct esh_context *ctx,
+                                         struct esh_pipeline *pipe);
+
+/* Wait until job 'job' has exited or stopped.  Returns the wait
+ * status of its last command. */
+int esh_context_wait(struct esh_context *ctx, struct esh_pipeline *job);
+
+/* Run 'fn(vjob, arg)' on a worker thread as a virtual job for 'pipe'
+ * (see esh-vjob.h): a job of the context with a jid but no processes.
+ * stop, bg, fg and kill post requests to it.  If 'pipe' runs in the
+ * background, returns at once, and esh_context_poll reports the job
+ * and what it wrote once it is done; otherwise waits until it is done
+ * or stopped.  Takes a reference to 'pipe'.  Returns the jid, or -1
+ * if the job could not be started. */
+int esh_context_submit(struct esh_context *ctx, struct esh_pipeline *pipe,
+                       int (*fn)(struct esh_vjob *, void *), void *arg);
+
+/* True if a virtual job is done, for esh_context_poll to report */
+bool esh_context_vjobs_done(struct esh_context *ctx);
+
+/* Reap the context's children that changed state, without blocking,
+ * report the virtual jobs that are done, deliver status events to
+ * plugins and free the jobs that finished */
+void esh_context_poll(struct esh_context *ctx);
+
+/* True once the 'exit' builtin ran; stores its status */
+bool esh_context_exited(struct esh_context *ctx, int *status);
+
+/* The jobs of the context, as a list of esh_pipeline */
+struct list * esh_context_jobs(struct esh_context *ctx);
+
+/* Status events dropped because the context's queue was full */
+unsigned long esh_context_dropped_events(struct esh_context *ctx);
@@ -0,0 +1,256 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Environment store.
+ *
+ * envp[] holds the variables in no particular order.  An open
+ * addressing table with linear probing maps names to 1 + their index
+ * in envp[]; 0 marks an empty bucket.  Unset moves the last variable
+ * into the freed slot and deletes by backward shifting, so there are
+ * no tombstones.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "esh-sys-utils.h"
+#include "esh-env.h"
+
+extern char **environ;
+
+/* Length of the NAME part of 'var' */
+static size_t
+name_len(const char *var)
+{
+    const char *eq = strchr(var, '=');
+    return eq ? (size_t)(eq - var) : strlen(var);
+}
+
+/* FNV-1a hash of the first 'len' bytes of 'name' */
+static size_t
+hash(const char *name, size_t len)
+{
+    size_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Bucket holding 'name', or the empty bucket where it would go */
+static size_t
+find(struct esh_env *env, const char *name, size_t len)
+{
+    size_t b = hash(name, len) & (env->nbuckets - 1);
+    while (env->buckets[b] != 0) {
+        const char *var = env->envp[env->buckets[b] - 1];
+        if (name_len(var) == len && strncmp(var, name, len) == 0) {
+            break;
+        }
+        b = (b + 1) & (env->nbuckets - 1);
+    }
+    return b;
+}
+
+static void
+rehash(struct esh_env *env, size_t n)
+{
+    size_t i;
+    free(env->buckets);
+    env->nbuckets = n;
+    env->buckets = calloc(env->nbuckets, sizeof *env->buckets);
+    if (env->buckets == NULL) {
+        esh_sys_fatal_error("env: out of memory\n");
+    }
+    for (i = 0; i < env->count; i++) {
+        env->buckets[find(env, env->envp[i], name_len(env->envp[i]))] = i + 1;
+    }
+}
+
+/* Append 'var', which the store takes ownership of */
+static void
+append(struct esh_env *env, char *var)
+{
+    if (env->count + 1 >= env->cap) {
+        env->cap = env->cap ? 2 * env->cap : 64;
+        env->envp = realloc(env->envp, env->cap * sizeof *env->envp);
+        if (env->envp == NULL) {
+            esh_sys_fatal_error("env: out of memory\n");
+        }
+    }
+    env->envp[env->count++] = var;
+    env->envp[env->count] = NULL;
+    if (env->is_environ) {
+        environ = env->envp;
+    }
+
+    /* keep the load factor below 1/2 */
+    if (2 * env->count >= env->nbuckets) {
+        rehash(env, env->nbuckets ? 2 * env->nbuckets : 128);
+    }
+    else {
+        env->buckets[find(env, var, name_len(var))] = env->count;
+    }
+}
+
+void
+esh_env_init(struct esh_env *env, bool is_environ)
+{
+    char **e;
+    env->count = 0;
+    env->cap = 64;
+    env->envp = calloc(env->cap, sizeof *env->envp);
+    env->buckets = NULL;
+    env->is_environ = false;
+    rehash(env, 128);
+    for (e = environ; e && *e; e++) {
+        if (strchr(*e, '=') != NULL && esh_env_get(env, *e) == NULL) {
+            append(env, strdup(*e));
+        }
+    }
+    if (is_environ) {
+        env->is_environ = true;
+        environ = env->envp;
+    }
+}
+
+void
+esh_env_destroy(struct esh_env *env)
+{
+    size_t i;
+    for (i = 0; i < env->count; i++) {
+        free(env->envp[i]);
+    }
+    free(env->envp);
+    free(env->buckets);
+}
+
+const char *
+esh_env_get(struct esh_env *env, const char *name)
+{
+    size_t len = name_len(name);
+    size_t b = find(env, name, len);
+    return env->buckets[b] ? env->envp[env->buckets[b] - 1] + len + 1 : NULL;
+}
+
+void
+esh_env_put(struct esh_env *env, const char *assignment)
+{
+    size_t len = name_len(assignment);
+    size_t b = find(env, assignment, len);
+    if (env->buckets[b] != 0) {
+        free(env->envp[env->buckets[b] - 1]);
+        env->envp[env->buckets[b] - 1] = strdup(assignment);
+    }
+    else {
+        append(env, strdup(assignment));
+    }
+}
+
+bool
+esh_env_unset(struct esh_env *env, const char *name)
+{
+    size_t len = name_len(name);
+    size_t b = find(env, name, len);
+    if (env->buckets[b] == 0) {
+        return false;
+    }
+
+    size_t slot = env->buckets[b] - 1;
+
+    /* backward shift deletion */
+    size_t i = b, j = b;
+    env->buckets[i] = 0;
+    for (;;) {
+        j = (j + 1) & (env->nbuckets - 1);
+        if (env->buckets[j] == 0) {
+            break;
+        }
+        const char *var = env->envp[env->buckets[j] - 1];
+        size_t k = hash(var, name_len(var)) & (env->nbuckets - 1);
+        /* leave j alone if its home k lies cyclically in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+        env->buckets[i] = env->buckets[j];
+        env->buckets[j] = 0;
+        i = j;
+    }
+
+    /* move the last variable into the freed slot */
+    free(env->envp[slot]);
+    if (slot != env->count - 1) {
+        char *last = env->envp[env->count - 1];
+        env->buckets[find(env, last, name_len(last))] = slot + 1;
+        env->envp[slot] = last;
+    }
+    env->envp[--env->count] = NULL;
+    return true;
+}
+
+char **
+esh_env_envp(struct esh_env *env)
+{
+    return env->envp;
+}
+
+size_t
+esh_env_count(struct esh_env *env)
+{
+    return env->count;
+}
+
+bool
+esh_env_is_assignment(const char *word)
+{
+    const char *p = word;
+    if (!(isalpha((unsigned char)*p) || *p == '_')) {
+        return false;
+    }
+    while (isalnum((unsigned char)*p) || *p == '_') {
+        p++;
+    }
+    return *p == '=';
+}
+
+char **
+esh_env_overlay(struct esh_env *env, char **assignments)
+{
+    size_t n = 0, extra = 0;
+    while (assignments[extra] != NULL) {
+        extra++;
+    }
+
+    char **copy = malloc((env->count + extra + 1) * sizeof *copy);
+    if (copy == NULL) {
+        return env->envp;
+    }
+    memcpy(copy, env->envp, env->count * sizeof *copy);
+    n = env->count;
+
+    char **a;
+    for (a = assignments; *a != NULL; a++) {
+        size_t len = name_len(*a);
+        size_t b = find(env, *a, len);
+        if (env->buckets[b] != 0) {
+            copy[env->buckets[b] - 1] = *a;
+            continue;
+        }
+        /* a new name may be given twice; the last one wins */
+        size_t i;
+        for (i = env->count; i < n; i++) {
+            if (strncmp(copy[i], *a, len + 1) == 0) {
+                break;
+            }
+        }
+        copy[i] = *a;
+        if (i == n) {
+            n++;
+        }
+    }
+    copy[n] = NULL;
+    return copy;
+}
@@ -0,0 +1,55 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Environment store.
+ *
+ * Holds a shell's environment as a ready-to-use, NULL terminated
+ * envp array of "NAME=value" strings plus a hash index from names to
+ * slots, so export and unset are O(1) and launching a command never
+ * rebuilds the environment.  The store of the process context keeps
+ * 'environ' pointing at its array; other stores are private copies
+ * that their commands get at exec.
+ *
+ * Per-command VAR=value prefixes are layered on top in the child by
+ * esh_env_overlay; commands without them simply inherit 'environ'.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct esh_env {
+    char **envp;            /* NULL terminated */
+    size_t count, cap;      /* cap includes the NULL */
+    size_t *buckets;
+    size_t nbuckets;        /* power of 2 */
+    bool is_environ;        /* keep 'environ' pointing at envp */
+};
+
+/* Copy the current 'environ' into 'env'; if 'is_environ', take it over */
+void esh_env_init(struct esh_env *env, bool is_environ);
+
+/* Free the variables of 'env' */
+void esh_env_destroy(struct esh_env *env);
+
+/* Value of 'name', or NULL if unset */
+const char *esh_env_get(struct esh_env *env, const char *name);
+
+/* Set 'name' from an assignment "NAME=value" */
+void esh_env_put(struct esh_env *env, const char *assignment);
+
+/* Remove 'name'; returns false if it was not set */
+bool esh_env_unset(struct esh_env *env, const char *name);
+
+/* The current environment, NULL terminated */
+char **esh_env_envp(struct esh_env *env);
+
+/* Number of variables */
+size_t esh_env_count(struct esh_env *env);
+
+/* True if 'word' has the form NAME=value with a valid NAME */
+bool esh_env_is_assignment(const char *word);
+
+/* Return a new envp with the NULL terminated list of assignments
+ * applied to the environment.  The strings are shared, only the
+ * pointer array is copied.  Meant to be used in the child. */
+char **esh_env_overlay(struct esh_env *env, char **assignments);
@@ -0,0 +1,105 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Delivery of child status changes to plugins.
+ *
+ * 'tail' is written only by the producer and 'head' only by the
+ * consumer.  The producer fills a slot before publishing it with a
+ * release store of 'tail'; the consumer reads slots only after an
+ * acquire load of 'tail', and frees them with a release store of
+ * 'head'.  The indices count up without wrapping into the ring, so
+ * tail - head is the number of queued events.
+ *
+ * Each queued event holds a reference to its command's pipeline, so
+ * a job that finished is not freed before plugins have seen it.
+ */
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "esh.h"
+#include "esh-events.h"
+#include "esh-hooks.h"
+
+/* events handed to plugins per call */
+#define DELIVER_BATCH   64
+
+void
+esh_event_push(struct esh_event_ring *r, struct esh_command *cmd, int waitstatus)
+{
+    size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (t - h == ESH_EVENT_RING) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    esh_pipeline_ref(cmd->pipeline);
+    r->slots[t & (ESH_EVENT_RING - 1)].cmd = cmd;
+    r->slots[t & (ESH_EVENT_RING - 1)].waitstatus = waitstatus;
+    atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+}
+
+size_t
+esh_event_pop(struct esh_event_ring *r, struct esh_status_event *out, size_t max)
+{
+    size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t n = 0;
+    for (; h + n != t && n < max; n++)
+        out[n] = r->slots[(h + n) & (ESH_EVENT_RING - 1)];
+    atomic_store_explicit(&r->head, h + n, memory_order_release);
+    return n;
+}
+
+unsigned long
+esh_event_dropped(struct esh_event_ring *r)
+{
+    return atomic_load_explicit(&r->dropped, memory_order_relaxed);
+}
+
+void
+esh_event_deliver(struct esh_event_ring *r, struct list *plugins)
+{
+    struct esh_status_event batch[DELIVER_BATCH];
+    struct esh_pipeline *held[DELIVER_BATCH];
+    size_t n, i;
+
+    while ((n = esh_event_pop(r, batch, DELIVER_BATCH)) > 0) {
+        size_t popped = n;
+        for (i = 0; i < n; i++)
+            held[i] = batch[i].cmd->pipeline;
+
+        struct list_elem * e = list_begin(plugins);
+        for (; e != list_end(plugins); e = list_next(e)) {
+            struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+
+            struct esh_hook_timer t;
+            if (plugin->command_status_batch != NULL) {
+                esh_hook_begin(&t);
+                plugin->command_status_batch(batch, n);
+                esh_hook_end(&t, plugin, ESH_HOOK_STATUS);
+                continue;
+            }
+            if (plugin->command_status_change == NULL)
+                continue;
+
+            /* a plugin returning true hides the event from later ones */
+            size_t k = 0;
+            for (i = 0; i < n; i++) {
+                esh_hook_begin(&t);
+                bool stop = plugin->command_status_change(batch[i].cmd, batch[i].waitstatus);
+                esh_hook_end(&t, plugin, ESH_HOOK_STATUS);
+                if (!stop)
+                    batch[k++] = batch[i];
+            }
+            n = k;
+        }
+        for (i = 0; i < popped; i++)
+            esh_pipeline_free(held[i]);
+    }
+
+    unsigned long d = esh_event_dropped(r);
+    if (d != r->dropped_reported) {
+        fprintf(stderr, "esh: %lu child status events dropped\n", d - r->dropped_reported);
+        r->dropped_reported = d;
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Delivery of child status changes to plugins.
+ *
+ * The reaper (the SIGCHLD handler, or whoever reaps a context's
+ * children) pushes each status change into the context's lock-free
+ * single-producer, single-consumer ring.  The main loop drains the
+ * ring and hands the events to plugins in batches, so plugins never
+ * run in signal context and a slow plugin does not delay reaping.
+ * If the ring is full, events are dropped and counted.
+ */
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Needs esh.h for struct esh_status_event */
+struct list;
+
+/* Capacity of the ring; a power of 2 */
+#define ESH_EVENT_RING  1024
+
+struct esh_event_ring {
+    struct esh_status_event slots[ESH_EVENT_RING];
+    atomic_size_t head, tail;
+    atomic_ulong dropped;
+    unsigned long dropped_reported;
+};
+
+/* Queue a status change, taking a reference to cmd's pipeline.
+ * Async-signal-safe; the only producer. */
+void esh_event_push(struct esh_event_ring *r, struct esh_command *cmd,
+                    int waitstatus);
+
+/* Move up to 'max' queued events to 'out'; returns how many.
+ * The only consumer. */
+size_t esh_event_pop(struct esh_event_ring *r, struct esh_status_event *out,
+                     size_t max);
+
+/* Deliver all queued events to the plugins on list 'plugins', then
+ * drop their pipeline references.  Must be called from the main loop,
+ * not a signal handler. */
+void esh_event_deliver(struct esh_event_ring *r, struct list *plugins);
+
+/* Number of events dropped because the ring was full */
+unsigned long esh_event_dropped(struct esh_event_ring *r);
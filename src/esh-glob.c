@@ -0,0 +1,561 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Pathname expansion.
+ *
+ * A directory listing is the NUL separated names of a directory plus
+ * their offsets and d_type, read with getdents64 into a 1 MB buffer.
+ * Up to MAX_LISTINGS listings are kept in LRU order.  A listing is
+ * reused if the directory's mtime did not change and the listing was
+ * read well after that mtime; a directory modified within the same
+ * timestamp tick as the read could otherwise be missed.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "list.h"
+#include "esh-glob.h"
+
+#define MAX_LISTINGS    64
+#define GETDENTS_BUF    (1 << 20)
+#define RACY_NSEC       (2 * 1000000000LL)  /* covers 1 s timestamps */
+
+/* as in getdents64(2) */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct listing {
+    struct list_elem elem;      /* in 'listings', most recent first */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    long long read_at;          /* CLOCK_REALTIME in ns when read */
+    char *names;                /* NUL separated */
+    size_t names_len, names_cap;
+    uint32_t *offsets;          /* of each name in 'names' */
+    unsigned char *types;       /* d_type of each name */
+    size_t count, cap;
+};
+
+/* per thread, for contexts run on threads of their own */
+static _Thread_local struct list listings;
+static _Thread_local bool listings_init;
+static _Thread_local size_t nlistings;
+static _Thread_local char *dents;       /* getdents64 buffer */
+
+/*
+ * Matcher.
+ */
+enum op_kind { OP_CHAR, OP_ANY, OP_CLASS, OP_STAR };
+
+struct op {
+    enum op_kind kind;
+    unsigned char c;            /* OP_CHAR */
+    uint8_t class[32];          /* OP_CLASS: bitmap of accepted bytes */
+};
+
+struct matcher {
+    struct op *ops;
+    int n;
+    bool has_meta;              /* false: component is a literal name */
+    bool dot;                   /* pattern starts with a literal '.' */
+    int min_len;                /* names shorter than this never match */
+    bool fixed_len;             /* no '*': names must be min_len long */
+    char *literal;              /* component without escapes */
+};
+
+static void
+class_set(uint8_t *class, unsigned char c)
+{
+    class[c >> 3] |= 1 << (c & 7);
+}
+
+static bool
+class_has(const uint8_t *class, unsigned char c)
+{
+    return class[c >> 3] & (1 << (c & 7));
+}
+
+/* Compile bracket expression at 'p' (just after '['); returns the
+ * position after ']', or NULL if it is not terminated */
+static const char *
+compile_class(const char *p, const char *end, struct op *op)
+{
+    bool negate = false;
+    memset(op->class, 0, sizeof op->class);
+    if (p < end && (*p == '!' || *p == '^')) {
+        negate = true;
+        p++;
+    }
+    const char *start = p;
+    while (p < end && (*p != ']' || p == start)) {
+        unsigned char lo = *p++, hi = lo;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            hi = p[1];
+            p += 2;
+        }
+        unsigned c;
+        for (c = lo; c <= hi; c++) {
+            class_set(op->class, c);
+        }
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    if (negate) {
+        int i;
+        for (i = 0; i < 32; i++) {
+            op->class[i] = ~op->class[i];
+        }
+    }
+    op->class[0] &= ~1;         /* never match NUL */
+    op->kind = OP_CLASS;
+    return p + 1;
+}
+
+static void
+compile(const char *pat, size_t len, struct matcher *m)
+{
+    const char *p = pat, *end = pat + len;
+    m->ops = malloc((len + 1) * sizeof *m->ops);
+    m->literal = malloc(len + 1);
+    m->n = 0;
+    m->has_meta = false;
+    m->min_len = 0;
+    m->fixed_len = true;
+    size_t lit = 0;
+
+    while (p < end) {
+        struct op *op = &m->ops[m->n];
+        const char *next;
+        if (*p == '*') {
+            /* consecutive stars are one */
+            if (m->n == 0 || m->ops[m->n - 1].kind != OP_STAR) {
+                op->kind = OP_STAR;
+                m->n++;
+            }
+            m->has_meta = true;
+            m->fixed_len = false;
+            p++;
+            continue;
+        }
+        if (*p == '?') {
+            op->kind = OP_ANY;
+            m->has_meta = true;
+            p++;
+        }
+        else if (*p == '[' && (next = compile_class(p + 1, end, op)) != NULL) {
+            m->has_meta = true;
+            p = next;
+        }
+        else {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+            }
+            op->kind = OP_CHAR;
+            op->c = *p;
+            m->literal[lit++] = *p++;
+        }
+        m->n++;
+        m->min_len++;
+    }
+    m->literal[lit] = '\0';
+    m->dot = m->n > 0 && m->ops[0].kind == OP_CHAR && m->ops[0].c == '.';
+}
+
+static bool
+step(const struct op *op, unsigned char c)
+{
+    switch (op->kind) {
+    case OP_CHAR:
+        return op->c == c;
+    case OP_ANY:
+        return true;
+    case OP_CLASS:
+        return class_has(op->class, c);
+    default:
+        return false;
+    }
+}
+
+/* Match 'name' of length 'len', backtracking only to the last star */
+static bool
+match(const struct matcher *m, const char *name, size_t len)
+{
+    if (len < (size_t)m->min_len || (m->fixed_len && len != (size_t)m->min_len)) {
+        return false;
+    }
+    if (name[0] == '.' && !m->dot) {
+        return false;
+    }
+
+    /* cheap reject on the literal tail, e.g. the ".log" of "*.log" */
+    int i = m->n;
+    const char *t = name + len;
+    while (i > 0 && m->ops[i - 1].kind == OP_CHAR) {
+        if ((unsigned char)*--t != m->ops[--i].c) {
+            return false;
+        }
+    }
+
+    int pi = 0, star_pi = -1;
+    const char *s = name, *end = name + len, *star_s = NULL;
+    while (s < end) {
+        if (pi < m->n && m->ops[pi].kind == OP_STAR) {
+            star_pi = ++pi;
+            star_s = s;
+        }
+        else if (pi < m->n && step(&m->ops[pi], *s)) {
+            pi++;
+            s++;
+        }
+        else if (star_pi >= 0) {
+            pi = star_pi;
+            s = ++star_s;
+        }
+        else {
+            return false;
+        }
+    }
+    while (pi < m->n && m->ops[pi].kind == OP_STAR) {
+        pi++;
+    }
+    return pi == m->n;
+}
+
+/*
+ * Directory listings.
+ */
+static long long
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+listing_free(struct listing *l)
+{
+    free(l->names);
+    free(l->offsets);
+    free(l->types);
+    free(l);
+}
+
+static void
+listing_add(struct listing *l, const char *name, unsigned char type)
+{
+    size_t n = strlen(name) + 1;
+    if (l->names_len + n > l->names_cap) {
+        while (l->names_len + n > l->names_cap) {
+            l->names_cap = l->names_cap ? 2 * l->names_cap : 4096;
+        }
+        l->names = realloc(l->names, l->names_cap);
+    }
+    if (l->count == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 256;
+        l->offsets = realloc(l->offsets, l->cap * sizeof *l->offsets);
+        l->types = realloc(l->types, l->cap);
+    }
+    memcpy(l->names + l->names_len, name, n);
+    l->offsets[l->count] = l->names_len;
+    l->types[l->count] = type;
+    l->names_len += n;
+    l->count++;
+}
+
+/* Read directory 'fd' into 'l' */
+static bool
+listing_read(struct listing *l, int fd)
+{
+    if (dents == NULL && (dents = malloc(GETDENTS_BUF)) == NULL) {
+        return false;
+    }
+    l->names_len = l->count = 0;
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, dents, GETDENTS_BUF);
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        long pos = 0;
+        while (pos < n) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(dents + pos);
+            pos += d->d_reclen;
+            if (strcmp(d->d_name, ".") != 0 && strcmp(d->d_name, "..") != 0) {
+                listing_add(l, d->d_name, d->d_type);
+            }
+        }
+    }
+}
+
+/* Listing of directory 'path', from the cache if still valid */
+static struct listing *
+get_listing(const char *path)
+{
+    if (!listings_init) {
+        list_init(&listings);
+        listings_init = true;
+    }
+
+    int fd = open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    long long mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    struct listing *l = NULL;
+    struct list_elem *e = list_begin(&listings);
+    for (; e != list_end(&listings); e = list_next(e)) {
+        struct listing *c = list_entry(e, struct listing, elem);
+        if (c->dev == st.st_dev && c->ino == st.st_ino) {
+            l = c;
+            list_remove(e);
+            break;
+        }
+    }
+
+    if (l != NULL && l->mtime.tv_sec == st.st_mtim.tv_sec
+            && l->mtime.tv_nsec == st.st_mtim.tv_nsec
+            && l->read_at - mtime >= RACY_NSEC) {
+        close(fd);
+        list_push_front(&listings, &l->elem);
+        return l;
+    }
+
+    if (l == NULL) {
+        if (nlistings == MAX_LISTINGS) {
+            listing_free(list_entry(list_pop_back(&listings), struct listing, elem));
+            nlistings--;
+        }
+        l = calloc(1, sizeof *l);
+        nlistings++;
+    }
+    l->dev = st.st_dev;
+    l->ino = st.st_ino;
+    l->mtime = st.st_mtim;
+    l->read_at = now_ns();
+    bool ok = listing_read(l, fd);
+    close(fd);
+    if (!ok) {
+        listing_free(l);
+        nlistings--;
+        return NULL;
+    }
+    list_push_front(&listings, &l->elem);
+    return l;
+}
+
+void
+esh_glob_flush_cache(void)
+{
+    while (listings_init && !list_empty(&listings)) {
+        listing_free(list_entry(list_pop_front(&listings), struct listing, elem));
+    }
+    nlistings = 0;
+}
+
+/*
+ * Expansion.
+ */
+struct glob_state {
+    struct matcher *comps;
+    int ncomps;
+    char *path;                 /* current prefix, grown as needed */
+    size_t path_cap;
+    char **buf;                 /* output arena */
+    size_t *len, *cap;
+    size_t matches;
+    bool trail;                 /* pattern ends in '/': directories only */
+};
+
+static void
+path_reserve(struct glob_state *g, size_t n)
+{
+    if (n > g->path_cap) {
+        while (n > g->path_cap) {
+            g->path_cap *= 2;
+        }
+        g->path = realloc(g->path, g->path_cap);
+    }
+}
+
+static void
+emit(struct glob_state *g, size_t plen)
+{
+    if (*g->cap - *g->len < plen + 1) {
+        while (*g->cap - *g->len < plen + 1) {
+            *g->cap = *g->cap ? 2 * *g->cap : 65536;
+        }
+        *g->buf = realloc(*g->buf, *g->cap);
+    }
+    memcpy(*g->buf + *g->len, g->path, plen);
+    (*g->buf)[*g->len + plen] = '\0';
+    *g->len += plen + 1;
+    g->matches++;
+}
+
+static _Thread_local const char *sort_names;
+
+static int
+cmp_offsets(const void *a, const void *b)
+{
+    return strcmp(sort_names + *(const uint32_t *)a, sort_names + *(const uint32_t *)b);
+}
+
+/* Expand components 'c' onward below prefix path[0..plen).
+ * 'checked' is false if the prefix ends in literal components whose
+ * existence has not been verified. */
+static void
+expand(struct glob_state *g, int c, size_t plen, bool checked)
+{
+    struct stat st;
+
+    /* literal components are appended without reading directories */
+    while (c < g->ncomps && !g->comps[c].has_meta) {
+        size_t n = strlen(g->comps[c].literal);
+        path_reserve(g, plen + n + 2);
+        memcpy(g->path + plen, g->comps[c].literal, n);
+        plen += n;
+        if (++c < g->ncomps) {
+            g->path[plen++] = '/';
+        }
+        checked = false;
+    }
+    g->path[plen] = '\0';
+    if (c == g->ncomps) {
+        if (checked || lstat(g->path, &st) == 0) {
+            emit(g, plen);
+        }
+        return;
+    }
+
+    struct listing *l = get_listing(g->path);
+    if (l == NULL) {
+        return;
+    }
+
+    /* matching names, sorted; copied since recursion may evict 'l' */
+    uint32_t *hits = malloc(l->count * sizeof *hits + 1);
+    size_t nhits = 0, i;
+    for (i = 0; i < l->count; i++) {
+        const char *name = l->names + l->offsets[i];
+        size_t n = (i + 1 < l->count ? l->offsets[i + 1] : l->names_len) - l->offsets[i] - 1;
+        if (!match(&g->comps[c], name, n)) {
+            continue;
+        }
+        /* later components need a directory */
+        if ((c + 1 < g->ncomps || g->trail) && l->types[i] != DT_DIR && l->types[i] != DT_LNK
+                && l->types[i] != DT_UNKNOWN) {
+            continue;
+        }
+        hits[nhits++] = l->offsets[i];
+    }
+    char *names = l->names;
+    if (c + 1 < g->ncomps) {
+        names = malloc(l->names_len + 1);
+        memcpy(names, l->names, l->names_len);
+    }
+    sort_names = names;
+    qsort(hits, nhits, sizeof *hits, cmp_offsets);
+
+    for (i = 0; i < nhits; i++) {
+        const char *name = names + hits[i];
+        size_t n = strlen(name);
+        path_reserve(g, plen + n + 2);
+        memcpy(g->path + plen, name, n);
+        if (c + 1 == g->ncomps && !g->trail) {
+            emit(g, plen + n);
+            continue;
+        }
+        g->path[plen + n] = '\0';
+        if (stat(g->path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        g->path[plen + n] = '/';
+        if (c + 1 == g->ncomps) {
+            emit(g, plen + n + 1);
+            continue;
+        }
+        expand(g, c + 1, plen + n + 1, true);
+    }
+    if (names != l->names) {
+        free(names);
+    }
+    free(hits);
+}
+
+bool
+esh_glob_is_pattern(const char *word)
+{
+    return strpbrk(word, "*?[") != NULL;
+}
+
+size_t
+esh_glob(const char *pattern, char **buf, size_t *len, size_t *cap)
+{
+    struct glob_state g = {
+        .buf = buf, .len = len, .cap = cap,
+        .path_cap = strlen(pattern) + 256,
+    };
+    g.path = malloc(g.path_cap);
+    g.comps = malloc((strlen(pattern) / 2 + 1) * sizeof *g.comps);
+
+    /* split into components; an absolute pattern starts at "/" */
+    size_t plen = 0;
+    const char *p = pattern;
+    g.trail = pattern[strlen(pattern) - 1] == '/';
+    if (*p == '/') {
+        g.path[plen++] = '/';
+    }
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        const char *slash = strchr(p, '/');
+        size_t n = slash ? (size_t)(slash - p) : strlen(p);
+        compile(p, n, &g.comps[g.ncomps++]);
+        p += n;
+    }
+
+    size_t saved = *len;
+    if (g.ncomps > 0) {
+        expand(&g, 0, plen, true);
+    }
+    if (g.matches == 0) {
+        *len = saved;
+    }
+
+    int i;
+    for (i = 0; i < g.ncomps; i++) {
+        free(g.comps[i].ops);
+        free(g.comps[i].literal);
+    }
+    free(g.comps);
+    free(g.path);
+    return g.matches;
+}
@@ -0,0 +1,26 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Pathname expansion.
+ *
+ * Words containing *, ? or [...] are expanded to the sorted list of
+ * matching paths.  Directories are read with large getdents64 calls
+ * and their listings are cached, keyed by device, inode and mtime,
+ * across command lines, so repeated globs over a big directory do
+ * not re-read it.  Each path component is compiled once into a small
+ * matcher program instead of calling fnmatch per name.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* True if 'word' contains glob metacharacters */
+bool esh_glob_is_pattern(const char *word);
+
+/* Append the paths matching 'pattern' to the arena 'buf' of size 'cap'
+ * holding 'len' bytes, each terminated by a NUL, in sorted order.
+ * Returns the number of matches; 0 means the arena is unchanged. */
+size_t esh_glob(const char *pattern, char **buf, size_t *len, size_t *cap);
+
+/* Forget all cached directory listings */
+void esh_glob_flush_cache(void);
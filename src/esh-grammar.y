@@ -7,15 +7,13 @@
  * This is based on an assignment I did in 1993 as an undergraduate
  * student at Technische Universitaet Berlin.
  *
- * Known bugs: leaks memory when parse errors occur.
  */
 %{
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #define YYDEBUG	1
 int yydebug;
-void yyerror(const char *msg);
-int yylex(void);
 
 /*
  * Error messages, csh-style
@@ -24,9 +22,22 @@ int yylex(void);
 #define INVNUL  "Invalid null command."
 #define AMBINP  "Ambiguous input redirect."
 #define AMBOUT  "Ambiguous output redirect."
+#define SYNERR  "Syntax error."
 
 #include "esh.h"
 
+/* State of one parser.  The scanner reads from 'input' and keeps the
+ * offset of the token it read last, for error locations. */
+struct esh_parser {
+    void *scanner;          /* flex scanner (yyscan_t) */
+    const char *input;      /* rest of the line being parsed */
+    int pos;                /* offset of 'input' in the line */
+    int tok_start;          /* offset of the last token read */
+    struct esh_command_line *result;
+    const char *error;      /* message of the last failed parse, if any */
+    int error_column;       /* offset where it was found, or -1 */
+};
+
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
@@ -35,6 +46,11 @@ struct cmd_helper {
     char *iored_input;
     char *iored_output;
     bool append_to_output;
+    char *iored_here;       /* body of a here-string */
+    char *here_delim;       /* delimiter of a here-document */
+    bool has_subst;         /* true if a word is a $(...) substitution */
+    struct esh_command_line *group;     /* of a { list; } or ( list ) */
+    bool subshell;
 };
 
 /* Initialize cmd_helper and, optionally, set first argv */
@@ -49,10 +65,49 @@ init_cmd(struct cmd_helper *cmd, char *firstcmd,
     cmd->iored_output = iored_output;
     cmd->iored_input = iored_input;
     cmd->append_to_output = append_to_output;
+    cmd->iored_here = NULL;
+    cmd->here_delim = NULL;
+    cmd->has_subst = false;
+    cmd->group = NULL;
+    cmd->subshell = false;
+}
+
+/* True if cmd already has some form of input redirection */
+static bool
+has_input(struct cmd_helper *cmd)
+{
+    return cmd->iored_input || cmd->iored_here || cmd->here_delim;
 }
 
-/* print error message */
-static void p_error(char *msg);
+/* Free everything a cmd_helper holds */
+static void
+free_cmd(struct cmd_helper *cmd)
+{
+    char **w = obstack_base(&cmd->words);
+    char **end = (char **) obstack_next_free(&cmd->words);
+    for (; w < end; w++)
+        free(*w);
+    obstack_free(&cmd->words, NULL);
+    free(cmd->iored_input);
+    free(cmd->iored_output);
+    free(cmd->iored_here);
+    free(cmd->here_delim);
+    if (cmd->group)
+        esh_command_line_free(cmd->group);
+}
+
+/* Start a cmd_helper for a group of the pipelines in 'list'; its only
+ * word is the opening bracket */
+static void
+init_group(struct cmd_helper *cmd, struct esh_command_line *list, bool subshell)
+{
+    init_cmd(cmd, strdup(subshell ? "(" : "{"), NULL, NULL, false);
+    cmd->group = list;
+    cmd->subshell = subshell;
+}
+
+/* record error message */
+static void p_error(struct esh_parser *parser, char *msg);
 
 /* Convert cmd_helper to esh_command.
  * Ensures NULL-terminated argv[] array
@@ -69,23 +124,48 @@ make_esh_command(struct cmd_helper *cmd)
 
     if (*argv == NULL) {
         free(argv);
+        free(cmd->iored_input);
+        free(cmd->iored_output);
+        free(cmd->iored_here);
+        free(cmd->here_delim);
         return NULL; 
     }
 
-    return esh_command_create(argv,
+    struct esh_command *pcmd = esh_command_create(argv,
                               cmd->iored_input,
                               cmd->iored_output,
                               cmd->append_to_output);
+    pcmd->iored_here = cmd->iored_here;
+    pcmd->here_delim = cmd->here_delim;
+    pcmd->has_subst = cmd->has_subst;
+    pcmd->group = cmd->group;
+    pcmd->subshell = cmd->subshell;
+    return pcmd;
 }
 
-/* Called by parser when command line is complete */
-static void cmdline_complete(struct esh_command_line *);
+/* A here-string's body is the word followed by a newline */
+static char *
+make_here_string(char *word)
+{
+    size_t len = strlen(word);
+    char *body = malloc(len + 2);
+    memcpy(body, word, len);
+    body[len] = '\n';
+    body[len + 1] = '\0';
+    free(word);
+    return body;
+}
 
 /* work-around for bug in flex 2.31 and later */
-static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
+static void yyunput (int c,char *buf_ptr, void *yyscanner) __attribute__((unused));
 
 %}
 
+/* Reentrant: all state is in the parser and scanner passed along */
+%define api.pure full
+%parse-param {struct esh_parser *parser} {void *scanner}
+%lex-param {void *scanner}
+
 /* LALR stack types */
 %union {
   struct cmd_helper command;
@@ -99,13 +179,36 @@ static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
 %type <command> command
 %type <pipe> pipeline
 %type <cmdline> cmd_list
+%type <word> word
+
+/* Values popped when a parse error aborts the parse.  Actions that
+ * abort free their own right-hand side; bison does not. */
+%destructor { free_cmd(&$$); } <command>
+%destructor { esh_pipeline_free($$); } <pipe>
+%destructor { esh_command_line_free($$); } <cmdline>
+%destructor { free($$); } <word>
+
+%{
+int yylex(YYSTYPE *yylval, void *scanner);
+static void yyerror(struct esh_parser *parser, void *scanner, const char *msg);
+%}
 
 /* Terminals */
 %token <word> WORD
+%token <word> SUBST
 %token GREATER_GREATER 
+%token LESS_LESS LESS_LESS_LESS
+
+/* '}' right after a command is a word of it, as in 'echo }'; a group
+ * closes only after ';' or '&', as in '{ echo; }'.  So ending a
+ * pipeline (after its first command or after a '|') ranks below
+ * shifting a '}' */
+%precedence PIPELINE_END
+%precedence '}'
+%expect 0
 
 %%
-cmd_line: cmd_list { cmdline_complete($1); }
+cmd_line: cmd_list { parser->result = $1; }
 
 cmd_list:	/* Null Command */ { $$ = esh_command_line_create_empty(); }
 |		pipeline { 
@@ -137,99 +240,247 @@ cmd_list:	/* Null Command */ { $$ = esh_command_line_create_empty(); }
             list_push_back(&$$->pipes, &$3->elem);
         }
 
-pipeline: command {
+pipeline: command %prec PIPELINE_END {
             struct esh_command * pcmd = make_esh_command(&$1);
-            if (pcmd == NULL) { p_error(INVNUL); YYABORT; }
+            if (pcmd == NULL) { p_error(parser, INVNUL); YYABORT; }
             $$ = esh_pipeline_create(pcmd);
 		}
-|		pipeline '|' command {
+|		pipeline '|' command %prec PIPELINE_END {
 		    /* Error: 'ls >x | wc' */
             struct esh_command * last;
             last = list_entry(list_back(&$1->commands), 
                               struct esh_command, elem);
-		    if (last->iored_output) { p_error(AMBOUT); YYABORT; }
+		    if (last->iored_output) {
+                p_error(parser, AMBOUT);
+                esh_pipeline_free($1);
+                free_cmd(&$3);
+                YYABORT;
+            }
 
 		    /* Error: 'ls | <x wc' */
-		    if ($3.iored_input) { p_error(AMBINP); YYABORT; }
+		    if (has_input(&$3)) {
+                p_error(parser, AMBINP);
+                esh_pipeline_free($1);
+                free_cmd(&$3);
+                YYABORT;
+            }
 
             struct esh_command * pcmd = make_esh_command(&$3);
-            if (pcmd == NULL) { p_error(INVNUL); YYABORT; }
+            if (pcmd == NULL) {
+                p_error(parser, INVNUL);
+                esh_pipeline_free($1);
+                YYABORT;
+            }
 
             list_push_back(&$1->commands, &pcmd->elem);
             pcmd->pipeline = $1;
             $$ = $1;
 		}
-|		'|' error 	   { p_error(INVNUL); YYABORT; }
-|		pipeline '|' error { p_error(INVNUL); YYABORT; }
+|		'|' error 	   { p_error(parser, INVNUL); $$ = NULL; YYABORT; }
+|		pipeline '|' error { p_error(parser, INVNUL); esh_pipeline_free($1); $$ = NULL; YYABORT; }
 
 command:   WORD { 
             init_cmd(&$$, $1, NULL, NULL, false);
         }
+|		'{' cmd_list '}' {
+            if (list_empty(&$2->pipes)) {
+                p_error(parser, INVNUL);
+                esh_command_line_free($2);
+                YYABORT;
+            }
+            init_group(&$$, $2, false);
+        }
+|		'(' cmd_list ')' {
+            if (list_empty(&$2->pipes)) {
+                p_error(parser, INVNUL);
+                esh_command_line_free($2);
+                YYABORT;
+            }
+            init_group(&$$, $2, true);
+        }
+|		SUBST { 
+            init_cmd(&$$, $1, NULL, NULL, false);
+            $$.has_subst = true;
+        }
 |		input   
 |		output
-|		command WORD {
+|		command word {
+            /* Error: '{ ls; } foo' */
+            if ($1.group) {
+                p_error(parser, SYNERR);
+                free_cmd(&$1);
+                free($2);
+                YYABORT;
+            }
+            $$ = $1;
+            obstack_ptr_grow(&$$.words, $2);
+		}
+|		command SUBST {
+            if ($1.group) {
+                p_error(parser, SYNERR);
+                free_cmd(&$1);
+                free($2);
+                YYABORT;
+            }
             $$ = $1;
             obstack_ptr_grow(&$$.words, $2);
+            $$.has_subst = true;
 		}
 |		command input {
-            obstack_free(&$2.words, NULL);
             /* Error: ambiguous redirect 'a <b <c' */
-            if($1.iored_input)   { p_error(AMBINP); YYABORT; }
+            if (has_input(&$1)) {
+                p_error(parser, AMBINP);
+                free_cmd(&$1);
+                free_cmd(&$2);
+                YYABORT;
+            }
+            obstack_free(&$2.words, NULL);
             $$ = $1; 
             $$.iored_input = $2.iored_input;
+            $$.iored_here = $2.iored_here;
+            $$.here_delim = $2.here_delim;
 		}
 |		command output {
-            obstack_free(&$2.words, NULL);
             /* Error: ambiguous redirect 'a >b >c' */
-            if ($1.iored_output) { p_error(AMBOUT); YYABORT; }
+            if ($1.iored_output) {
+                p_error(parser, AMBOUT);
+                free_cmd(&$1);
+                free_cmd(&$2);
+                YYABORT;
+            }
+            obstack_free(&$2.words, NULL);
             $$ = $1; 
             $$.iored_output = $2.iored_output;
             $$.append_to_output = $2.append_to_output;
 		}
 
+/* Braces are words, except where they open or close a group */
+word:	WORD
+|		'{'     { $$ = strdup("{"); }
+|		'}'     { $$ = strdup("}"); }
+
 input:	'<' WORD { 
-            init_cmd(&$$, NULL, $2, NULL, false);
+            init_cmd(&$$, NULL, esh_word_unquote($2), NULL, false);
+        }
+|		LESS_LESS WORD { 
+            init_cmd(&$$, NULL, NULL, NULL, false);
+            $$.here_delim = esh_word_unquote($2);
         }
-|		'<' error	  { p_error(MISRED); YYABORT; }
+|		LESS_LESS_LESS WORD { 
+            init_cmd(&$$, NULL, NULL, NULL, false);
+            $$.iored_here = make_here_string(esh_word_unquote($2));
+        }
+|		'<' error	  { p_error(parser, MISRED); memset(&$$, 0, sizeof $$); YYABORT; }
+|		LESS_LESS error	  { p_error(parser, MISRED); memset(&$$, 0, sizeof $$); YYABORT; }
+|		LESS_LESS_LESS error { p_error(parser, MISRED); memset(&$$, 0, sizeof $$); YYABORT; }
 
 output:	'>' WORD { 
-            init_cmd(&$$, NULL, NULL, $2, false);
+            init_cmd(&$$, NULL, NULL, esh_word_unquote($2), false);
         }
 |		GREATER_GREATER WORD { 
-            init_cmd(&$$, NULL, NULL, $2, true);
+            init_cmd(&$$, NULL, NULL, esh_word_unquote($2), true);
         }
 		/* Error: missing redirect */
-|		'>' error 	  { p_error(MISRED); YYABORT; }
-|		GREATER_GREATER error { p_error(MISRED); YYABORT; }
+|		'>' error 	  { p_error(parser, MISRED); memset(&$$, 0, sizeof $$); YYABORT; }
+|		GREATER_GREATER error { p_error(parser, MISRED); memset(&$$, 0, sizeof $$); YYABORT; }
 
 %%
-static char * inputline;    /* currently processed input line */
+#define YY_EXTRA_TYPE struct esh_parser *
 #define YY_INPUT(buf,result,max_size) \
     { \
-        result = *inputline ? (buf[0] = *inputline++, 1) : YY_NULL; \
+        size_t n = strnlen(yyextra->input, max_size); \
+        memcpy(buf, yyextra->input, n); \
+        yyextra->input += n; \
+        result = n ? n : YY_NULL; \
     }
+#define YY_USER_ACTION \
+    if (yytext[0] != ' ' && yytext[0] != '\t') \
+        yyextra->tok_start = yyextra->pos; \
+    yyextra->pos += yyleng;
 
 #define YY_NO_UNPUT
 #define YY_NO_INPUT
 #include "lex.yy.c"
 
 static void
-p_error(char *msg) 
+p_error(struct esh_parser *parser, char *msg) 
 { 
-    /* print error */
-    fprintf(stderr, "%s\n", msg); 
+    /* record error; where it was found, unless the parser said */
+    parser->error = msg;
+    if (parser->error_column < 0)
+        parser->error_column = parser->tok_start;
+}
+
+/* do not use default error handling since errors are handled above;
+ * just note where the parse went wrong. */
+static void 
+yyerror(struct esh_parser *parser, void *scanner, const char *msg)
+{
+    parser->error_column = parser->tok_start;
+}
+
+struct esh_parser *
+esh_parser_create(void)
+{
+    struct esh_parser *parser = calloc(1, sizeof *parser);
+    if (parser == NULL)
+        return NULL;
+    if (yylex_init_extra(parser, &parser->scanner) != 0) {
+        free(parser);
+        return NULL;
+    }
+    return parser;
+}
+
+void
+esh_parser_destroy(struct esh_parser *parser)
+{
+    yylex_destroy(parser->scanner);
+    free(parser);
+}
+
+/* 
+ * parse a commandline with 'parser'.
+ */
+struct esh_command_line *
+esh_parse_command_line_r(struct esh_parser *parser, const char *line)
+{
+    parser->input = line;
+    parser->pos = parser->tok_start = 0;
+    parser->result = NULL;
+    parser->error = NULL;
+    parser->error_column = -1;
+    /* drop what is left of the previous line */
+    yyrestart(NULL, parser->scanner);
+
+    int error = yyparse(parser, parser->scanner);
+
+    return error ? NULL : parser->result;
+}
+
+const char *
+esh_parser_error(struct esh_parser *parser, int *column)
+{
+    if (column != NULL)
+        *column = parser->error_column;
+    return parser->error != NULL ? parser->error : SYNERR;
 }
 
-extern int yyparse (void);
+/* Each thread that uses esh_parse_command_line gets a parser of its own,
+ * freed when the thread exits */
+static pthread_key_t parser_key;
+static pthread_once_t parser_once = PTHREAD_ONCE_INIT;
 
-/* do not use default error handling since errors are handled above. */
-void 
-yyerror(const char *msg) { }
+static void
+free_parser(void *parser)
+{
+    esh_parser_destroy(parser);
+}
 
-static struct esh_command_line * commandline;
-static void cmdline_complete(struct esh_command_line *cline)
+static void
+parser_key_create(void)
 {
-    commandline = cline;
+    pthread_key_create(&parser_key, free_parser);
 }
 
 /* 
@@ -238,10 +489,17 @@ static void cmdline_complete(struct esh_command_line *cline)
 struct esh_command_line *
 esh_parse_command_line(char * line)
 {
-    inputline = line;
-    commandline = NULL;
-
-    int error = yyparse();
+    pthread_once(&parser_once, parser_key_create);
+    struct esh_parser *parser = pthread_getspecific(parser_key);
+    if (parser == NULL) {
+        if ((parser = esh_parser_create()) == NULL)
+            return NULL;
+        pthread_setspecific(parser_key, parser);
+    }
 
-    return error ? NULL : commandline;
+    struct esh_command_line *cline = esh_parse_command_line_r(parser, line);
+    /* print error */
+    if (cline == NULL && parser->error != NULL)
+        fprintf(stderr, "%s\n", parser->error); 
+    return cline;
 }
@@ -0,0 +1,184 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Cost accounting for plugin hooks.
+ *
+ * Statistics live in the shell, not in struct esh_plugin, whose
+ * layout belongs to the plugins.  There are few plugins, so they are
+ * found by a linear search that moves the hit to the front.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "esh.h"
+#include "esh-hooks.h"
+
+#define NBUCKETS    64      /* bucket b counts calls of < 2^b ns */
+
+struct hook_stats {
+    unsigned long calls;
+    long long wall_ns;
+    long long cpu_ns;
+    long long max_ns;
+    unsigned long hist[NBUCKETS];
+};
+
+struct plugin_info {
+    struct list_elem elem;
+    struct esh_plugin *plugin;
+    char *path;
+    char *name;                 /* file name without directory and .so */
+    long long load_ns;
+    long long budget_ns;        /* 0 if none */
+    struct hook_stats hooks[ESH_HOOK_MAX];
+};
+
+static const char *hook_names[ESH_HOOK_MAX] = {
+    [ESH_HOOK_INIT] = "init",
+    [ESH_HOOK_RAW_CMDLINE] = "process_raw_cmdline",
+    [ESH_HOOK_PIPELINE] = "process_pipeline",
+    [ESH_HOOK_BUILTIN] = "process_builtin",
+    [ESH_HOOK_PROMPT] = "make_prompt",
+    [ESH_HOOK_FORKED] = "pipeline_forked",
+    [ESH_HOOK_STATUS] = "command_status",
+};
+
+static struct list infos;
+static bool infos_init;
+
+static long long
+ns(const struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static struct plugin_info *
+get_info(struct esh_plugin *plugin)
+{
+    if (!infos_init) {
+        list_init(&infos);
+        infos_init = true;
+    }
+    struct list_elem *e = list_begin(&infos);
+    for (; e != list_end(&infos); e = list_next(e)) {
+        struct plugin_info *info = list_entry(e, struct plugin_info, elem);
+        if (info->plugin == plugin) {
+            if (e != list_begin(&infos)) {
+                list_remove(e);
+                list_push_front(&infos, e);
+            }
+            return info;
+        }
+    }
+
+    /* a plugin we did not see being loaded */
+    struct plugin_info *info = calloc(1, sizeof *info);
+    info->plugin = plugin;
+    info->path = strdup("?");
+    info->name = strdup("?");
+    list_push_back(&infos, &info->elem);
+    return info;
+}
+
+void
+esh_hook_loaded(struct esh_plugin *plugin, const char *path, long long load_ns)
+{
+    struct plugin_info *info = get_info(plugin);
+    free(info->path);
+    free(info->name);
+    info->path = strdup(path);
+    const char *base = strrchr(path, '/');
+    info->name = strdup(base ? base + 1 : path);
+    char *dot = strstr(info->name, ".so");
+    if (dot != NULL)
+        *dot = '\0';
+    info->load_ns = load_ns;
+}
+
+void
+esh_hook_begin(struct esh_hook_timer *timer)
+{
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+}
+
+void
+esh_hook_end(struct esh_hook_timer *timer, struct esh_plugin *plugin, enum esh_hook hook)
+{
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+
+    long long w = ns(&wall) - ns(&timer->wall);
+    struct plugin_info *info = get_info(plugin);
+    struct hook_stats *s = &info->hooks[hook];
+    s->calls++;
+    s->wall_ns += w;
+    s->cpu_ns += ns(&cpu) - ns(&timer->cpu);
+    if (w > s->max_ns)
+        s->max_ns = w;
+    int b = w > 0 ? 64 - __builtin_clzll(w) : 0;
+    s->hist[b < NBUCKETS ? b : NBUCKETS - 1]++;
+
+    if (info->budget_ns > 0 && w > info->budget_ns)
+        fprintf(stderr, "esh: plugin %s: %s took %.3f ms (budget %.3f ms)\n",
+                info->name, hook_names[hook], w / 1e6, info->budget_ns / 1e6);
+}
+
+/* Upper bound in ns of the 'p' quantile of 's' */
+static long long
+percentile(struct hook_stats *s, double p)
+{
+    unsigned long want = (unsigned long)(p * s->calls), seen = 0;
+    int b;
+    for (b = 0; b < NBUCKETS; b++) {
+        seen += s->hist[b];
+        if (seen > want)
+            break;
+    }
+    long long bound = b == 0 ? 0 : 1LL << b;
+    return bound < s->max_ns ? bound : s->max_ns;
+}
+
+void
+esh_hook_print(FILE *out)
+{
+    struct list_elem * e = list_begin(&esh_plugin_list);
+    for (; e != list_end(&esh_plugin_list); e = list_next(e)) {
+        struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+        struct plugin_info *info = get_info(plugin);
+        int h;
+
+        fprintf(out, "%s  rank %d  loaded in %.3f ms  %s", info->name, plugin->rank,
+                info->load_ns / 1e6, info->path);
+        if (info->budget_ns > 0)
+            fprintf(out, "  budget %.3f ms", info->budget_ns / 1e6);
+        fprintf(out, "\n");
+        for (h = 0; h < ESH_HOOK_MAX; h++) {
+            struct hook_stats *s = &info->hooks[h];
+            if (s->calls == 0)
+                continue;
+            fprintf(out, "    %-20s %8lu calls  wall %10.3f ms  cpu %10.3f ms"
+                    "  p50 <%9.3f ms  p99 <%9.3f ms  max %9.3f ms\n",
+                    hook_names[h], s->calls, s->wall_ns / 1e6, s->cpu_ns / 1e6,
+                    percentile(s, 0.5) / 1e6, percentile(s, 0.99) / 1e6,
+                    s->max_ns / 1e6);
+        }
+    }
+}
+
+bool
+esh_hook_set_budget(const char *name, double ms)
+{
+    struct list_elem * e = list_begin(&esh_plugin_list);
+    for (; e != list_end(&esh_plugin_list); e = list_next(e)) {
+        struct plugin_info *info = get_info(list_entry(e, struct esh_plugin, elem));
+        if (strcmp(info->name, name) == 0) {
+            info->budget_ns = (long long)(ms * 1e6);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Cost accounting for plugin hooks.
+ *
+ * Every call into a plugin is timed, both wall clock (CLOCK_MONOTONIC)
+ * and CPU time of the calling thread (CLOCK_THREAD_CPUTIME_ID, so that
+ * virtual jobs busy on worker threads are not charged to the hook),
+ * and added to per-plugin, per-hook totals and a log2 histogram from
+ * which percentiles are estimated.  The cost is two pairs of
+ * clock_gettime calls per hook call.  The 'plugins' builtin
+ * shows the numbers; a plugin may be given a time budget, and calls
+ * over it are reported on stderr.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+struct esh_plugin;
+
+enum esh_hook {
+    ESH_HOOK_INIT,
+    ESH_HOOK_RAW_CMDLINE,
+    ESH_HOOK_PIPELINE,
+    ESH_HOOK_BUILTIN,
+    ESH_HOOK_PROMPT,
+    ESH_HOOK_FORKED,
+    ESH_HOOK_STATUS,
+    ESH_HOOK_MAX
+};
+
+/* Start of a hook call */
+struct esh_hook_timer {
+    struct timespec wall;
+    struct timespec cpu;
+};
+
+/* Record that 'plugin' was loaded from 'path', which took 'load_ns' */
+void esh_hook_loaded(struct esh_plugin *plugin, const char *path, long long load_ns);
+
+/* Time a call of hook 'hook' of 'plugin': begin before, end after */
+void esh_hook_begin(struct esh_hook_timer *timer);
+void esh_hook_end(struct esh_hook_timer *timer, struct esh_plugin *plugin, enum esh_hook hook);
+
+/* Print rank, path, load time and hook costs of all plugins to 'out' */
+void esh_hook_print(FILE *out);
+
+/* Warn when a hook call of plugin 'name' takes longer than 'ms';
+ * 0 removes the budget.  Returns false if there is no such plugin. */
+bool esh_hook_set_budget(const char *name, double ms);
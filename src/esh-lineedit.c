@@ -0,0 +1,483 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * A small line editor.
+ *
+ * The line is kept in one growing buffer with the cursor as an index.
+ * After each key the whole line is redrawn: carriage return, prompt,
+ * the visible part of the line, clear to end of line, and cursor
+ * positioning, all in a single write.  Lines wider than the terminal
+ * scroll horizontally around the cursor.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "esh-sys-utils.h"
+#include "esh-lineedit.h"
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define IDLE_MS 100
+#define REDRAW (-2)     /* from next_byte: the idle hook wrote */
+
+static char ** complete_filename(const char *line, int start, int end);
+
+esh_lineedit_completer esh_lineedit_complete = complete_filename;
+int (*esh_lineedit_idle_hook)(void);
+
+static char *history[ESH_LINEEDIT_HISTORY];
+static int history_len;
+
+/* Input buffered from fd 0 */
+static char inbuf[4096];
+static size_t inpos, inlen;
+
+/* Output batched for one write */
+struct outbuf {
+    char *buf;
+    size_t len, cap;
+};
+
+static void
+out_append(struct outbuf *o, const char *s, size_t n)
+{
+    if (o->len + n > o->cap) {
+        while (o->len + n > o->cap)
+            o->cap = o->cap ? 2 * o->cap : 256;
+        o->buf = realloc(o->buf, o->cap);
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static void
+out_flush(struct outbuf *o)
+{
+    size_t off = 0;
+    while (off < o->len) {
+        ssize_t n = write(STDOUT_FILENO, o->buf + off, o->len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    o->len = 0;
+}
+
+/* Next input byte, or -1 on end of file.  If 'idle' is set, the idle
+ * hook runs while no input arrives; REDRAW if it wrote to the terminal. */
+static int
+next_byte(bool idle)
+{
+    while (inpos == inlen) {
+        if (idle && esh_lineedit_idle_hook != NULL) {
+            struct pollfd p = { .fd = STDIN_FILENO, .events = POLLIN };
+            int r = poll(&p, 1, IDLE_MS);
+            if (r == 0 || (r < 0 && errno == EINTR)) {
+                if (esh_lineedit_idle_hook() != 0)
+                    return REDRAW;
+                continue;
+            }
+        }
+        ssize_t n = read(STDIN_FILENO, inbuf, sizeof inbuf);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        inpos = 0;
+        inlen = n;
+    }
+    return (unsigned char)inbuf[inpos++];
+}
+
+/* Line being edited */
+struct line {
+    char *buf;
+    int len, cap;
+    int pos;                    /* cursor */
+    const char *prompt;
+    int plen;
+    int hist;                   /* history entry shown, or history_len */
+    char *saved;                /* the new line while browsing history */
+    struct outbuf out;
+};
+
+static void
+line_reserve(struct line *l, int n)
+{
+    if (l->len + n + 1 > l->cap) {
+        while (l->len + n + 1 > l->cap)
+            l->cap *= 2;
+        l->buf = realloc(l->buf, l->cap);
+    }
+}
+
+static void
+line_insert(struct line *l, const char *s, int n)
+{
+    line_reserve(l, n);
+    memmove(l->buf + l->pos + n, l->buf + l->pos, l->len - l->pos);
+    memcpy(l->buf + l->pos, s, n);
+    l->len += n;
+    l->pos += n;
+    l->buf[l->len] = '\0';
+}
+
+static void
+line_delete(struct line *l, int from, int to)
+{
+    memmove(l->buf + from, l->buf + to, l->len - to);
+    l->len -= to - from;
+    if (l->pos > to)
+        l->pos -= to - from;
+    else if (l->pos > from)
+        l->pos = from;
+    l->buf[l->len] = '\0';
+}
+
+static void
+line_set(struct line *l, const char *s)
+{
+    l->len = l->pos = 0;
+    l->buf[0] = '\0';
+    line_insert(l, s, strlen(s));
+}
+
+static int
+columns(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+        return 80;
+    return ws.ws_col;
+}
+
+static void
+refresh(struct line *l)
+{
+    int width = columns() - l->plen - 1;
+    int start = 0, n = l->len;
+    if (width < 1)
+        width = 1;
+    if (l->pos >= width)
+        start = l->pos - width + 1;
+    if (n - start > width)
+        n = start + width;
+
+    char seq[32];
+    out_append(&l->out, "\r", 1);
+    out_append(&l->out, l->prompt, l->plen);
+    out_append(&l->out, l->buf + start, n - start);
+    out_append(&l->out, "\x1b[K\r", 4);
+    int col = l->plen + l->pos - start;
+    if (col > 0)
+        out_append(&l->out, seq, snprintf(seq, sizeof seq, "\x1b[%dC", col));
+    out_flush(&l->out);
+}
+
+static void
+history_add(const char *s)
+{
+    if (*s == '\0')
+        return;
+    if (history_len > 0 && strcmp(history[history_len - 1], s) == 0)
+        return;
+    if (history_len == ESH_LINEEDIT_HISTORY) {
+        free(history[0]);
+        memmove(history, history + 1, (history_len - 1) * sizeof *history);
+        history_len--;
+    }
+    history[history_len++] = strdup(s);
+}
+
+/* Show history entry 'h' (history_len is the line being typed) */
+static void
+history_show(struct line *l, int h)
+{
+    if (h < 0 || h > history_len || h == l->hist)
+        return;
+    if (l->hist == history_len) {
+        free(l->saved);
+        l->saved = strdup(l->buf);
+    }
+    l->hist = h;
+    line_set(l, h == history_len ? l->saved : history[h]);
+}
+
+/* Longest common prefix of the candidates */
+static int
+common_prefix(char **c)
+{
+    int n = strlen(c[0]), i, k;
+    for (i = 1; c[i] != NULL; i++) {
+        for (k = 0; k < n && c[i][k] == c[0][k]; k++)
+            ;
+        n = k;
+    }
+    return n;
+}
+
+static void
+complete(struct line *l)
+{
+    if (esh_lineedit_complete == NULL)
+        return;
+
+    int start = l->pos;
+    while (start > 0 && l->buf[start - 1] != ' ')
+        start--;
+    char **c = esh_lineedit_complete(l->buf, start, l->pos);
+    if (c == NULL || c[0] == NULL) {
+        out_append(&l->out, "\a", 1);
+        out_flush(&l->out);
+        free(c);
+        return;
+    }
+
+    int word = l->pos - start, i;
+    int n = common_prefix(c);
+    if (n < word || strncmp(c[0], l->buf + start, word) != 0) {
+        /* candidates that do not begin with the word: a lone one
+         * replaces it, several are only listed */
+        if (c[1] == NULL) {
+            line_delete(l, start, l->pos);
+            word = 0;
+        }
+        else
+            n = word;
+    }
+    if (c[1] == NULL) {
+        line_insert(l, c[0] + word, n - word);
+        if (n == 0 || c[0][n - 1] != '/')
+            line_insert(l, " ", 1);
+    }
+    else if (n > word) {
+        line_insert(l, c[0] + word, n - word);
+    }
+    else {
+        /* nothing to add: list the candidates below the line */
+        out_append(&l->out, "\r\n", 2);
+        for (i = 0; c[i] != NULL; i++) {
+            out_append(&l->out, c[i], strlen(c[i]));
+            out_append(&l->out, c[i + 1] ? "  " : "\r\n", 2);
+        }
+    }
+    for (i = 0; c[i] != NULL; i++)
+        free(c[i]);
+    free(c);
+    refresh(l);
+}
+
+/* Complete the word as a file name in its directory */
+static char **
+complete_filename(const char *line, int start, int end)
+{
+    char *word = strndup(line + start, end - start);
+    char *slash = strrchr(word, '/');
+    const char *base = slash ? slash + 1 : word;
+    char *dir = slash ? strndup(word, slash - word + 1) : strdup("");
+
+    DIR *d = opendir(*dir ? dir : ".");
+    char **c = NULL;
+    int n = 0, cap = 0;
+    struct dirent *e;
+    while (d != NULL && (e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, base, strlen(base)) != 0)
+            continue;
+        if (e->d_name[0] == '.' && base[0] != '.')
+            continue;
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+            continue;
+
+        char *cand = malloc(strlen(dir) + strlen(e->d_name) + 2);
+        sprintf(cand, "%s%s", dir, e->d_name);
+        struct stat st;
+        if (e->d_type == DT_DIR || ((e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+                    && stat(cand, &st) == 0 && S_ISDIR(st.st_mode)))
+            strcat(cand, "/");
+        if (n + 2 > cap) {
+            cap = cap ? 2 * cap : 16;
+            c = realloc(c, cap * sizeof *c);
+        }
+        c[n++] = cand;
+        c[n] = NULL;
+    }
+    if (d != NULL)
+        closedir(d);
+    free(dir);
+    free(word);
+    return c;
+}
+
+/* Read a line without editing */
+static char *
+read_plain(void)
+{
+    size_t len = 0, cap = 128;
+    char *s = malloc(cap);
+    int ch;
+    while ((ch = next_byte(false)) != -1 && ch != '\n') {
+        if (len + 2 > cap)
+            s = realloc(s, cap *= 2);
+        s[len++] = ch;
+    }
+    if (ch == -1 && len == 0) {
+        free(s);
+        return NULL;
+    }
+    s[len] = '\0';
+    return s;
+}
+
+/* Handle an escape sequence; returns false if it is not known */
+static bool
+escape(struct line *l)
+{
+    int a = next_byte(false), b = next_byte(false);
+    if (a != '[' && a != 'O')
+        return false;
+    if (b >= '0' && b <= '9') {
+        if (next_byte(false) != '~')
+            return false;
+        if (b == '1' || b == '7')
+            l->pos = 0;
+        else if (b == '4' || b == '8')
+            l->pos = l->len;
+        else if (b == '3' && l->pos < l->len)
+            line_delete(l, l->pos, l->pos + 1);
+        return true;
+    }
+    switch (b) {
+    case 'A': history_show(l, l->hist - 1); break;
+    case 'B': history_show(l, l->hist + 1); break;
+    case 'C': if (l->pos < l->len) l->pos++; break;
+    case 'D': if (l->pos > 0) l->pos--; break;
+    case 'H': l->pos = 0; break;
+    case 'F': l->pos = l->len; break;
+    default: return false;
+    }
+    return true;
+}
+
+size_t
+esh_lineedit_buffered(void)
+{
+    return inlen - inpos;
+}
+
+char *
+esh_lineedit_readline(const char *prompt)
+{
+    struct termios saved;
+    if (!isatty(STDIN_FILENO) || esh_sys_tty_raw(STDIN_FILENO, &saved) == -1) {
+        if (prompt != NULL) {
+            fputs(prompt, stdout);
+            fflush(stdout);
+        }
+        return read_plain();
+    }
+
+    struct line l = {
+        .cap = 128,
+        .prompt = prompt ? prompt : "",
+        .plen = prompt ? strlen(prompt) : 0,
+        .hist = history_len,
+    };
+    l.buf = malloc(l.cap);
+    l.buf[0] = '\0';
+    fflush(stdout);
+    refresh(&l);
+
+    bool eof = false;
+    for (;;) {
+        int ch = next_byte(true);
+        if (ch == REDRAW) {
+            refresh(&l);
+            continue;
+        }
+        if (ch == -1 || (ch == KEY_CTRL('D') && l.len == 0)) {
+            eof = true;
+            break;
+        }
+        if (ch == '\r' || ch == '\n')
+            break;
+
+        switch (ch) {
+        case KEY_CTRL('C'):
+            /* abandon the line, leaving it on the screen marked with ^C */
+            l.pos = l.len;
+            refresh(&l);
+            out_append(&l.out, "^C", 2);
+            l.len = l.pos = 0;
+            l.buf[0] = '\0';
+            goto done;
+        case KEY_CTRL('A'): l.pos = 0; break;
+        case KEY_CTRL('E'): l.pos = l.len; break;
+        case KEY_CTRL('B'): if (l.pos > 0) l.pos--; break;
+        case KEY_CTRL('F'): if (l.pos < l.len) l.pos++; break;
+        case KEY_CTRL('P'): history_show(&l, l.hist - 1); break;
+        case KEY_CTRL('N'): history_show(&l, l.hist + 1); break;
+        case KEY_CTRL('K'): line_delete(&l, l.pos, l.len); break;
+        case KEY_CTRL('U'): line_delete(&l, 0, l.pos); break;
+        case KEY_CTRL('D'):
+            if (l.pos < l.len)
+                line_delete(&l, l.pos, l.pos + 1);
+            break;
+        case KEY_CTRL('H'):
+        case 127:
+            if (l.pos > 0)
+                line_delete(&l, l.pos - 1, l.pos);
+            break;
+        case KEY_CTRL('W'): {
+            int from = l.pos;
+            while (from > 0 && l.buf[from - 1] == ' ')
+                from--;
+            while (from > 0 && l.buf[from - 1] != ' ')
+                from--;
+            line_delete(&l, from, l.pos);
+            break;
+        }
+        case KEY_CTRL('L'):
+            out_append(&l.out, "\x1b[H\x1b[2J", 7);
+            break;
+        case '\t':
+            complete(&l);
+            continue;
+        case 27:
+            if (!escape(&l))
+                continue;
+            break;
+        default:
+            if (ch >= ' ') {
+                char c = ch;
+                line_insert(&l, &c, 1);
+            }
+            break;
+        }
+        refresh(&l);
+    }
+    l.pos = l.len;
+    refresh(&l);
+done:
+    out_append(&l.out, "\r\n", 2);
+    out_flush(&l.out);
+    esh_sys_tty_unraw(STDIN_FILENO, &saved);
+
+    free(l.saved);
+    free(l.out.buf);
+    if (eof && l.len == 0) {
+        free(l.buf);
+        return NULL;
+    }
+    history_add(l.buf);
+    return l.buf;
+}
@@ -0,0 +1,36 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * A small line editor, usable instead of GNU readline through
+ * shell.readline.  It supports cursor movement and the common emacs
+ * editing keys, an in-memory history (up/down, ^P/^N) and completion
+ * with Tab through a callback.  Each screen update is assembled in a
+ * buffer and written with one write(2).
+ *
+ * If stdin is not a terminal, lines are read without editing.
+ */
+
+#include <stddef.h>
+
+/* Completion callback: return a malloc'd, NULL terminated array of
+ * malloc'd candidates for the word line[start..end), or NULL.
+ * Candidates are meant to begin with the word; a single one that does
+ * not replaces the word, and several that do not all begin with it are
+ * only listed.  The default completes file names. */
+typedef char ** (*esh_lineedit_completer)(const char *line, int start, int end);
+extern esh_lineedit_completer esh_lineedit_complete;
+
+/* If set, called about every 100 ms while waiting for input; returns
+ * non-zero if it wrote to the terminal, and the line is redrawn */
+extern int (*esh_lineedit_idle_hook)(void);
+
+/* Read a line like readline(3): returns a malloc'd line without the
+ * newline, or NULL on end of file.  Non-empty lines are added to
+ * the history. */
+char * esh_lineedit_readline(const char *prompt);
+
+/* Bytes read from stdin but not yet returned as lines */
+size_t esh_lineedit_buffered(void);
+
+/* Maximum number of history entries kept */
+#define ESH_LINEEDIT_HISTORY 1000
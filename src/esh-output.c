@@ -0,0 +1,441 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Output of background jobs.
+ *
+ * Every capture is on the 'outputs' list: live ones in the order
+ * their jobs started, then retired ones in the order their jobs
+ * finished.  The SIGIO handler only reads pipes and fills rings; the
+ * list itself, and 'shown' while a job is not in the foreground, are
+ * changed by the main loop only, with SIGIO blocked.
+ *
+ * 'written' counts every byte read from a job's pipe; the ring holds
+ * the last 'cap' of them, the byte at offset o being at buf[o % cap].
+ * 'shown' is how far the output has been copied to the terminal, and
+ * 'line_end' the offset just past the last newline read.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+
+#include "list.h"
+#include "esh-output.h"
+#include "esh-sys-utils.h"
+
+struct esh_output {
+    struct list_elem elem;      /* in 'outputs' */
+    int jid;
+    int fd;                     /* read end of the job's pipe, -1 at EOF */
+    char *buf;                  /* ring of 'cap' bytes */
+    size_t cap;
+    uint64_t written;
+    uint64_t shown;
+    uint64_t line_end;
+    uint64_t skipped;           /* overwritten before being shown */
+    bool stream;
+    bool foreground;
+    bool retired;
+};
+
+enum esh_output_mode esh_output_mode = ESH_OUTPUT_OFF;
+size_t esh_output_size = ESH_OUTPUT_SIZE;
+
+static struct list outputs;
+static int nretired;
+
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+/* True if the terminal takes more output without blocking */
+static bool
+terminal_ready(void)
+{
+    struct pollfd p = { .fd = STDOUT_FILENO, .events = POLLOUT };
+    return poll(&p, 1, 0) == 1 && (p.revents & POLLOUT);
+}
+
+static void
+ring_append(struct esh_output *out, const char *data, size_t n)
+{
+    if (n > out->cap) {
+        data += n - out->cap;
+        out->written += n - out->cap;
+        n = out->cap;
+    }
+    size_t at = out->written % out->cap;
+    size_t first = n < out->cap - at ? n : out->cap - at;
+    memcpy(out->buf + at, data, first);
+    memcpy(out->buf, data + first, n - first);
+    out->written += n;
+}
+
+/* Copy 'len' bytes from offset 'from', which must still be in the ring */
+static void
+ring_copy(struct esh_output *out, uint64_t from, size_t len, char *dst)
+{
+    size_t at = from % out->cap;
+    size_t first = len < out->cap - at ? len : out->cap - at;
+    memcpy(dst, out->buf + at, first);
+    memcpy(dst + first, out->buf, len - first);
+}
+
+/* Offset of the oldest byte still in the ring */
+static uint64_t
+ring_start(struct esh_output *out)
+{
+    return out->written > out->cap ? out->written - out->cap : 0;
+}
+
+static void
+sigio_handler(int sig, siginfo_t *info, void *_ctxt)
+{
+    esh_output_drain();
+}
+
+void
+esh_output_init(void)
+{
+    list_init(&outputs);
+    esh_signal_sethandler(SIGIO, sigio_handler);
+}
+
+struct esh_output *
+esh_output_open(int jid, int *wfd)
+{
+    int fds[2];
+
+    if (esh_output_mode == ESH_OUTPUT_OFF)
+        return NULL;
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return NULL;
+    /* SIGIO to the shell whenever data arrives or the job is done */
+    if (fcntl(fds[0], F_SETOWN, getpid()) < 0
+        || fcntl(fds[0], F_SETFL, O_NONBLOCK | O_ASYNC) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+
+    struct esh_output *out = calloc(1, sizeof *out);
+    if (out == NULL || (out->buf = malloc(esh_output_size)) == NULL) {
+        free(out);
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    out->cap = esh_output_size;
+    out->jid = jid;
+    out->fd = fds[0];
+    out->stream = esh_output_mode == ESH_OUTPUT_STREAM;
+
+    bool was_blocked = esh_signal_block(SIGIO);
+    list_push_back(&outputs, &out->elem);
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+
+    *wfd = fds[1];
+    return out;
+}
+
+void
+esh_output_drain(void)
+{
+    char tmp[4096];
+    int saved_errno = errno;
+
+    struct list_elem *e = list_begin(&outputs);
+    for (; e != list_end(&outputs); e = list_next(e)) {
+        struct esh_output *out = list_entry(e, struct esh_output, elem);
+        while (out->fd >= 0) {
+            ssize_t n = read(out->fd, tmp, sizeof tmp);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                break;          /* EAGAIN: nothing more for now */
+            if (n == 0) {
+                close(out->fd);
+                out->fd = -1;
+                break;
+            }
+            char *nl = memrchr(tmp, '\n', n);
+            if (nl != NULL)
+                out->line_end = out->written + (nl - tmp) + 1;
+            ring_append(out, tmp, n);
+            if (out->foreground) {
+                write_all(STDOUT_FILENO, tmp, n);
+                out->shown = out->written;
+            }
+        }
+    }
+    errno = saved_errno;
+}
+
+/* True if 'out' has something to show: complete lines, a last line
+ * without newline after the job is done, or a ring full of one line */
+static bool
+stream_ready(struct esh_output *out)
+{
+    return out->stream && !out->foreground && out->written > out->shown
+        && (out->line_end > out->shown || out->fd < 0
+            || out->written - out->shown >= out->cap);
+}
+
+bool
+esh_output_stream_pending(void)
+{
+    bool pending = false;
+    bool was_blocked = esh_signal_block(SIGIO);
+    struct list_elem *e = list_begin(&outputs);
+    for (; e != list_end(&outputs) && !pending; e = list_next(e))
+        pending = stream_ready(list_entry(e, struct esh_output, elem));
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+    return pending;
+}
+
+/* Show what is ready of one streamed job; stops early, leaving the
+ * rest for later, when the terminal is not ready. */
+static void
+stream_one(struct esh_output *out)
+{
+    char prefix[32];
+    int plen = snprintf(prefix, sizeof prefix, "[%d] ", out->jid);
+
+    bool was_blocked = esh_signal_block(SIGIO);
+    if (out->shown < ring_start(out)) {
+        out->skipped += ring_start(out) - out->shown;
+        out->shown = ring_start(out);
+    }
+    uint64_t from = out->shown;
+    size_t len = out->written - from;
+    bool done = out->fd < 0;
+    bool full = len >= out->cap;
+    char *text = malloc(len + 1);
+    if (text != NULL)
+        ring_copy(out, from, len, text);
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+
+    /* out of memory: leave it all for a later try */
+    char *line = text != NULL ? malloc(plen + len + 64) : NULL;
+    if (line == NULL) {
+        free(text);
+        return;
+    }
+
+    /* write with SIGIO open, so jobs are drained while the terminal is slow */
+    size_t pos = 0;
+    if (out->skipped > 0 && terminal_ready()) {
+        int n = snprintf(line, plen + len + 64, "%s... %llu bytes not shown\n",
+                         prefix, (unsigned long long) out->skipped);
+        write_all(STDOUT_FILENO, line, n);
+        out->skipped = 0;
+    }
+    while (pos < len && out->skipped == 0) {
+        char *nl = memchr(text + pos, '\n', len - pos);
+        size_t end = nl != NULL ? (size_t) (nl - text) + 1 : len;
+        if (nl == NULL && !done && !full)
+            break;
+        if (!terminal_ready())
+            break;
+        memcpy(line, prefix, plen);
+        memcpy(line + plen, text + pos, end - pos);
+        size_t n = plen + end - pos;
+        if (nl == NULL)
+            line[n++] = '\n';
+        write_all(STDOUT_FILENO, line, n);
+        pos = end;
+    }
+    free(line);
+    free(text);
+
+    was_blocked = esh_signal_block(SIGIO);
+    if (!out->foreground && out->shown == from)
+        out->shown = from + pos;
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+}
+
+void
+esh_output_stream(void)
+{
+    fflush(stdout);
+    struct list_elem *e = list_begin(&outputs);
+    for (; e != list_end(&outputs); e = list_next(e)) {
+        struct esh_output *out = list_entry(e, struct esh_output, elem);
+        if (stream_ready(out) || (out->stream && out->skipped > 0))
+            stream_one(out);
+    }
+}
+
+int
+esh_output_print(FILE *f, struct esh_output *out)
+{
+    bool was_blocked = esh_signal_block(SIGIO);
+    esh_output_drain();
+    uint64_t from = ring_start(out);
+    size_t len = out->written - from;
+    char *text = malloc(len + 1);
+    if (text != NULL)
+        ring_copy(out, from, len, text);
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+    if (text == NULL)
+        return -1;
+
+    if (from > 0)
+        fprintf(f, "[%d] ... first %llu bytes dropped\n", out->jid,
+                (unsigned long long) from);
+    fwrite(text, 1, len, f);
+    if (len > 0 && text[len - 1] != '\n')
+        fprintf(f, "\n");
+    free(text);
+    return 0;
+}
+
+void
+esh_output_foreground(struct esh_output *out, bool fg)
+{
+    if (out == NULL)
+        return;
+
+    bool was_blocked = esh_signal_block(SIGIO);
+    if (fg) {
+        esh_output_drain();
+        /* a streamed job's pending output comes first, unprefixed */
+        if (out->stream) {
+            uint64_t from = out->shown > ring_start(out) ? out->shown : ring_start(out);
+            size_t len = out->written - from;
+            char *text = malloc(len + 1);
+            if (text != NULL) {
+                ring_copy(out, from, len, text);
+                fflush(stdout);
+                write_all(STDOUT_FILENO, text, len);
+                free(text);
+            }
+        }
+        out->shown = out->written;
+        out->skipped = 0;
+    }
+    out->foreground = fg;
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+}
+
+void
+esh_output_retire(struct esh_output *out)
+{
+    struct list_elem *e;
+
+    bool was_blocked = esh_signal_block(SIGIO);
+    out->foreground = false;
+    /* job ids are reused; keep only the latest of each */
+    for (e = list_begin(&outputs); e != list_end(&outputs); ) {
+        struct esh_output *old = list_entry(e, struct esh_output, elem);
+        e = list_next(e);
+        if (old->retired && old->jid == out->jid)
+            esh_output_close(old);
+    }
+    list_remove(&out->elem);
+    list_push_back(&outputs, &out->elem);
+    out->retired = true;
+    nretired++;
+
+    /* drop the oldest; this bounds memory even if streamed output
+     * never gets shown */
+    for (e = list_begin(&outputs);
+         nretired > ESH_OUTPUT_RETIRED && e != list_end(&outputs); ) {
+        struct esh_output *old = list_entry(e, struct esh_output, elem);
+        e = list_next(e);
+        if (old->retired)
+            esh_output_close(old);
+    }
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+}
+
+struct esh_output *
+esh_output_find_retired(int jid)
+{
+    struct list_elem *e = list_rbegin(&outputs);
+    for (; e != list_rend(&outputs); e = list_prev(e)) {
+        struct esh_output *out = list_entry(e, struct esh_output, elem);
+        if (out->retired && out->jid == jid)
+            return out;
+    }
+    return NULL;
+}
+
+void
+esh_output_close(struct esh_output *out)
+{
+    bool was_blocked = esh_signal_block(SIGIO);
+    list_remove(&out->elem);
+    if (out->retired)
+        nretired--;
+    if (!was_blocked)
+        esh_signal_unblock(SIGIO);
+
+    if (out->fd >= 0)
+        close(out->fd);
+    free(out->buf);
+    free(out);
+}
+
+static const char *mode_names[] = { "off", "capture", "stream" };
+
+bool
+esh_output_parse(FILE *err, char **argv)
+{
+    enum esh_output_mode mode = esh_output_mode;
+    size_t size = esh_output_size;
+
+    for (; *argv; argv++) {
+        int m;
+        if (strncmp(*argv, "size=", 5) == 0) {
+            char *end;
+            long v = strtol(*argv + 5, &end, 10);
+            if (*end != '\0' || v < 256)
+                goto bad;
+            size = v;
+            continue;
+        }
+        for (m = 0; m <= ESH_OUTPUT_STREAM; m++)
+            if (strcmp(*argv, mode_names[m]) == 0)
+                break;
+        if (m > ESH_OUTPUT_STREAM)
+            goto bad;
+        mode = m;
+    }
+    esh_output_mode = mode;
+    esh_output_size = size;
+    return true;
+
+bad:
+    fprintf(err, "joboutput: invalid setting '%s'\n"
+            "usage: joboutput [off|capture|stream] [size=BYTES]\n", *argv);
+    return false;
+}
+
+void
+esh_output_print_settings(FILE *f)
+{
+    fprintf(f, "%s size=%zu\n", mode_names[esh_output_mode], esh_output_size);
+}
@@ -0,0 +1,84 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Output of background jobs.
+ *
+ * With 'joboutput capture' or 'joboutput stream', a background job
+ * writes its stdout (unless redirected) and its stderr into a pipe of
+ * its own rather than to the terminal.  A SIGIO handler drains the
+ * pipes into a bounded ring buffer per job, overwriting the oldest
+ * output when the ring is full, so a job never blocks on output,
+ * whatever the terminal is doing.  'jobs -o N' prints what job N's
+ * ring holds, also for the last few jobs that finished.  In stream
+ * mode, the main loop also copies new complete lines to the terminal,
+ * each prefixed with "[N] ", as long as the terminal takes them
+ * without blocking.  A job brought to the foreground writes straight
+ * through to the terminal.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+enum esh_output_mode {
+    ESH_OUTPUT_OFF,             /* background jobs share the terminal */
+    ESH_OUTPUT_CAPTURE,         /* keep their output for 'jobs -o' */
+    ESH_OUTPUT_STREAM,          /* and copy it to the terminal, prefixed */
+};
+
+/* Set with 'joboutput'; apply to jobs started afterwards */
+extern enum esh_output_mode esh_output_mode;
+extern size_t esh_output_size;
+
+/* Default ring size per job */
+#define ESH_OUTPUT_SIZE         (64 * 1024)
+
+/* Output of the most recently finished jobs kept for 'jobs -o' */
+#define ESH_OUTPUT_RETIRED      16
+
+struct esh_output;
+
+/* Set up, and install the SIGIO handler */
+void esh_output_init(void);
+
+/* Start capturing the output of job 'jid' under the current mode.
+ * Stores the write end of the job's pipe, for its processes, in *wfd;
+ * the caller closes it once they are forked.  Returns NULL if the
+ * mode is off or on error. */
+struct esh_output * esh_output_open(int jid, int *wfd);
+
+/* Read what is pending on all pipes into their rings.
+ * Async-signal-safe; the SIGIO handler. */
+void esh_output_drain(void);
+
+/* True if a streamed job has output not yet shown */
+bool esh_output_stream_pending(void);
+
+/* Copy new complete lines of streamed jobs to the terminal, while it
+ * can take them without blocking.  Call from the main loop. */
+void esh_output_stream(void);
+
+/* Print everything the ring of 'out' holds to 'f'.  Returns -1 if
+ * out of memory. */
+int esh_output_print(FILE *f, struct esh_output *out);
+
+/* Let the output of a job through to the terminal while it is in the
+ * foreground, or capture it again */
+void esh_output_foreground(struct esh_output *out, bool fg);
+
+/* The job of 'out' finished; keep its output for 'jobs -o' */
+void esh_output_retire(struct esh_output *out);
+
+/* Output of the most recently finished job 'jid', or NULL */
+struct esh_output * esh_output_find_retired(int jid);
+
+/* Stop capturing and free 'out' */
+void esh_output_close(struct esh_output *out);
+
+/* Parse the arguments of 'joboutput': off, capture or stream, and
+ * optionally size=BYTES.  Returns false after printing an error to
+ * 'err'. */
+bool esh_output_parse(FILE *err, char **argv);
+
+/* Print the settings to 'f' in the form accepted by esh_output_parse */
+void esh_output_print_settings(FILE *f);
@@ -0,0 +1,299 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Parsing large inputs in parallel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "esh.h"
+#include "esh-parse.h"
+
+/* Chunks per thread, so that threads that finish early take more */
+#define CHUNKS_PER_THREAD   8
+
+/* No smaller chunks than this, in bytes */
+#define MIN_CHUNK           (64 * 1024)
+
+/* A piece of the input, starting at a line, and what parsing it gave */
+struct chunk {
+    const char *start, *end;
+    size_t nlines;
+    struct esh_command_line **clines;   /* with ESH_PARSE_KEEP */
+    size_t clines_cap;
+    struct esh_parse_error *errors;     /* line numbers within the chunk */
+    size_t nerrors, errors_cap;
+};
+
+/* One batch at a time */
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The worker pool, and the chunks of the current batch */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static int pool_size;           /* workers started */
+static int pool_active;         /* workers the batch may use */
+static struct chunk *pool_chunks;
+static size_t pool_nchunks, pool_next, pool_left;
+static int pool_flags;
+
+/* Record the error of the line just parsed */
+static void
+add_error(struct chunk *chunk, struct esh_parser *parser)
+{
+    if (chunk->nerrors == chunk->errors_cap) {
+        chunk->errors_cap = chunk->errors_cap ? 2 * chunk->errors_cap : 16;
+        chunk->errors = realloc(chunk->errors,
+                                chunk->errors_cap * sizeof *chunk->errors);
+    }
+    struct esh_parse_error *e = &chunk->errors[chunk->nerrors++];
+    e->line = chunk->nlines;
+    e->msg = esh_parser_error(parser, &e->column);
+}
+
+/* Parse the lines of 'chunk' one by one, copying each into 'line' */
+static void
+parse_chunk(struct esh_parser *parser, struct chunk *chunk, int flags,
+            char **line, size_t *cap)
+{
+    const char *p = chunk->start, *end = chunk->end;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        size_t n = eol - p;
+        if (n + 1 > *cap)
+            *line = realloc(*line, *cap = n + 1);
+        memcpy(*line, p, n);
+        (*line)[n] = '\0';
+        p = eol < end ? eol + 1 : end;
+        chunk->nlines++;
+
+        struct esh_command_line *cline = NULL;
+        /* skip comments, including a #! line */
+        if ((*line)[strspn(*line, " \t")] != '#') {
+            cline = esh_parse_command_line_r(parser, *line);
+            if (cline == NULL)
+                add_error(chunk, parser);
+        }
+
+        if (!(flags & ESH_PARSE_KEEP)) {
+            if (cline != NULL)
+                esh_command_line_free(cline);
+            continue;
+        }
+        if (chunk->nlines > chunk->clines_cap) {
+            chunk->clines_cap = chunk->clines_cap ? 2 * chunk->clines_cap : 256;
+            chunk->clines = realloc(chunk->clines,
+                                    chunk->clines_cap * sizeof *chunk->clines);
+        }
+        chunk->clines[chunk->nlines - 1] = cline;
+    }
+}
+
+/* What a worker is started with; its parser is made by pool_grow, so
+ * that a failure is seen by esh_parse_batch */
+struct worker_start {
+    int index;
+    struct esh_parser *parser;
+};
+
+/* A worker: parse chunks of whatever batch is current, forever */
+static void *
+worker(void *arg)
+{
+    struct worker_start *start = arg;
+    int index = start->index;
+    struct esh_parser *parser = start->parser;
+    char *line = NULL;
+    size_t cap = 0;
+
+    free(start);
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (index >= pool_active || pool_next == pool_nchunks)
+            pthread_cond_wait(&pool_work, &pool_lock);
+        struct chunk *chunk = &pool_chunks[pool_next++];
+        int flags = pool_flags;
+        pthread_mutex_unlock(&pool_lock);
+
+        parse_chunk(parser, chunk, flags, &line, &cap);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_left == 0)
+            pthread_cond_signal(&pool_done);
+    }
+    return NULL;
+}
+
+/* Keep the pool usable in a child forked while a worker held its lock;
+ * the child has no workers. */
+static void
+pool_prepare(void)
+{
+    pthread_mutex_lock(&pool_lock);
+}
+
+static void
+pool_parent(void)
+{
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void
+pool_child(void)
+{
+    pthread_mutex_init(&pool_lock, NULL);
+    pthread_mutex_init(&batch_lock, NULL);
+    pool_size = 0;
+}
+
+/* Start workers until there are 'n'; returns how many there are, with
+ * errno set if that is fewer.  Workers block all signals, so that
+ * handlers run on the shell's thread only. */
+static int
+pool_grow(int n)
+{
+    if (pool_size == 0)
+        pthread_atfork(pool_prepare, pool_parent, pool_child);
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    while (pool_size < n) {
+        struct worker_start *start = malloc(sizeof *start);
+        struct esh_parser *parser = esh_parser_create();
+        if (start == NULL || parser == NULL) {
+            free(start);
+            if (parser != NULL)
+                esh_parser_destroy(parser);
+            errno = ENOMEM;
+            break;
+        }
+        start->index = pool_size;
+        start->parser = parser;
+
+        pthread_t t;
+        int rc = pthread_create(&t, NULL, worker, start);
+        if (rc != 0) {
+            free(start);
+            esh_parser_destroy(parser);
+            errno = rc;
+            break;
+        }
+        pthread_detach(t);
+        pool_size++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return pool_size;
+}
+
+/* Split 'text' into at most 'n' chunks that start at a line */
+static size_t
+split_chunks(const char *text, size_t len, size_t n, struct chunk *chunks)
+{
+    const char *p = text, *end = text + len;
+    size_t i = 0;
+    while (p < end) {
+        const char *next = text + len * (i + 1) / n;
+        if (next <= p)
+            next = p + 1;
+        if (next < end) {
+            const char *eol = memchr(next - 1, '\n', end - (next - 1));
+            next = eol != NULL ? eol + 1 : end;
+        }
+        memset(&chunks[i], 0, sizeof chunks[i]);
+        chunks[i].start = p;
+        chunks[i].end = i + 1 < n ? next : end;
+        p = chunks[i++].end;
+    }
+    return i;
+}
+
+int
+esh_parse_batch(const char *text, size_t len, int nthreads, int flags,
+                struct esh_parse_batch *batch)
+{
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+
+    size_t n = nthreads * CHUNKS_PER_THREAD;
+    if (n > len / MIN_CHUNK + 1)
+        n = len / MIN_CHUNK + 1;
+    struct chunk *chunks = malloc(n * sizeof *chunks);
+    if (chunks == NULL)
+        return -1;
+    n = split_chunks(text, len, n, chunks);
+
+    pthread_mutex_lock(&batch_lock);
+    pthread_mutex_lock(&pool_lock);
+    if (pool_grow(nthreads) == 0) {
+        int err = errno;
+        pthread_mutex_unlock(&pool_lock);
+        pthread_mutex_unlock(&batch_lock);
+        free(chunks);
+        errno = err;
+        return -1;
+    }
+    pool_active = nthreads;
+    pool_chunks = chunks;
+    pool_nchunks = pool_left = n;
+    pool_next = 0;
+    pool_flags = flags;
+    pthread_cond_broadcast(&pool_work);
+    while (pool_left > 0)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pool_nchunks = pool_next = 0;
+    pool_chunks = NULL;
+    pthread_mutex_unlock(&pool_lock);
+    pthread_mutex_unlock(&batch_lock);
+
+    /* number lines across chunks */
+    size_t i, nlines = 0, nerrors = 0;
+    for (i = 0; i < n; i++) {
+        nlines += chunks[i].nlines;
+        nerrors += chunks[i].nerrors;
+    }
+    batch->nlines = nlines;
+    batch->nerrors = nerrors;
+    batch->errors = malloc((nerrors + 1) * sizeof *batch->errors);
+    batch->clines = NULL;
+    if (flags & ESH_PARSE_KEEP)
+        batch->clines = malloc((nlines + 1) * sizeof *batch->clines);
+
+    size_t line = 0, e = 0, k;
+    for (i = 0; i < n; i++) {
+        struct chunk *c = &chunks[i];
+        for (k = 0; k < c->nerrors; k++) {
+            batch->errors[e] = c->errors[k];
+            batch->errors[e++].line += line;
+        }
+        if (flags & ESH_PARSE_KEEP)
+            memcpy(batch->clines + line, c->clines, c->nlines * sizeof *c->clines);
+        line += c->nlines;
+        free(c->errors);
+        free(c->clines);
+    }
+    free(chunks);
+    return 0;
+}
+
+void
+esh_parse_batch_free(struct esh_parse_batch *batch)
+{
+    size_t i;
+    for (i = 0; batch->clines != NULL && i < batch->nlines; i++) {
+        if (batch->clines[i] != NULL)
+            esh_command_line_free(batch->clines[i]);
+    }
+    free(batch->clines);
+    free(batch->errors);
+}
@@ -0,0 +1,50 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Parsing large inputs in parallel.
+ *
+ * esh_parse_batch splits its input at line boundaries into chunks and
+ * parses them on a pool of worker threads, each with a reentrant
+ * parser (esh_parse_command_line_r) of its own.  Lines are parsed one
+ * at a time, as typed at the prompt; comment lines are skipped, and
+ * here-document bodies are not read.  Errors are reported per line,
+ * with the column where they were found, rather than printed.
+ *
+ * The workers are started on first use and kept for later batches, so
+ * the pipelines and commands they allocate come from slab caches that
+ * stay in use.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct esh_command_line;
+
+/* A line that did not parse */
+struct esh_parse_error {
+    size_t line;            /* 1-based line number */
+    int column;             /* 0-based offset of the offending token,
+                               or -1 if unknown */
+    const char *msg;        /* static message */
+};
+
+struct esh_parse_batch {
+    size_t nlines;          /* lines in the input */
+    struct esh_command_line **clines;   /* with ESH_PARSE_KEEP, the parsed
+                                           lines, in order; NULL for comments
+                                           and lines with errors */
+    struct esh_parse_error *errors;     /* in line order */
+    size_t nerrors;
+};
+
+/* Flags for esh_parse_batch */
+#define ESH_PARSE_KEEP      1   /* keep the parsed lines; else just check */
+
+/* Parse the 'len' bytes of 'text' on 'nthreads' threads, or one per
+ * online CPU if 0.  Returns 0, or -1 with errno set if no thread or
+ * memory could be had. */
+int esh_parse_batch(const char *text, size_t len, int nthreads, int flags,
+                    struct esh_parse_batch *batch);
+
+/* Free the errors and, if kept, the parsed lines of 'batch' */
+void esh_parse_batch_free(struct esh_parse_batch *batch);
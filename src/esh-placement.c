@@ -0,0 +1,283 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * CPU and NUMA placement of jobs.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "esh-placement.h"
+
+#define MAX_NODES   (8 * sizeof(unsigned long))
+#define MAX_DOMAINS 64
+
+/* Cache domains: sets of the CPUs the shell may run on that share a
+ * last-level cache, found on first use.  Pipelines are placed on them
+ * in turn. */
+static pthread_once_t domains_once = PTHREAD_ONCE_INIT;
+static cpu_set_t domains[MAX_DOMAINS];
+static int ndomains;
+static atomic_uint next_domain;
+
+/* Parse a list such as "0-3,8,10-11", calling 'add' for each member.
+ * Returns false if the list is malformed or a member is >= limit. */
+static bool
+parse_list(const char *list, int limit, void (*add)(int, void *), void *aux)
+{
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0)
+            return false;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return false;
+        }
+        if (hi >= limit)
+            return false;
+        for (; lo <= hi; lo++)
+            add(lo, aux);
+
+        if (*end != ',' && *end != '\0')
+            return false;
+        p = *end ? end + 1 : end;
+    }
+    return p != list;
+}
+
+static void
+add_cpu(int cpu, void *aux)
+{
+    CPU_SET(cpu, (cpu_set_t *) aux);
+}
+
+static void
+add_node(int node, void *aux)
+{
+    *(unsigned long *) aux |= 1UL << node;
+}
+
+/* Where sysfs is: ESH_SYSFS_ROOT if set, so that tests can describe
+ * a machine of their own, else /sys */
+static const char *
+sysfs_root(void)
+{
+    const char *root = getenv("ESH_SYSFS_ROOT");
+    return root != NULL ? root : "/sys";
+}
+
+/* Add the CPUs in the list in sysfs file 'path' to 'cpus' */
+static bool
+read_cpu_list(const char *path, cpu_set_t *cpus)
+{
+    char list[1024];
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    bool ok = fgets(list, sizeof list, f) != NULL;
+    fclose(f);
+    list[strcspn(list, "\n")] = '\0';
+    return ok && parse_list(list, CPU_SETSIZE, add_cpu, cpus);
+}
+
+/* Add the CPUs local to each node in 'nodes' to 'cpus' */
+static bool
+add_node_cpus(unsigned long nodes, cpu_set_t *cpus)
+{
+    int node;
+    for (node = 0; node < MAX_NODES; node++) {
+        if (!(nodes & (1UL << node)))
+            continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof path,
+                 "%s/devices/system/node/node%d/cpulist", sysfs_root(), node);
+        if (!read_cpu_list(path, cpus))
+            return false;
+    }
+    return true;
+}
+
+/* Add the CPUs that share the last-level cache of 'cpu' to 'cpus' */
+static bool
+add_llc_cpus(int cpu, cpu_set_t *cpus)
+{
+    char path[PATH_MAX];
+    int index, level, llc = -1, llc_level = 0;
+
+    for (index = 0; ; index++) {
+        snprintf(path, sizeof path, "%s/devices/system/cpu/cpu%d/cache/index%d/level",
+                 sysfs_root(), cpu, index);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+            break;
+        if (fscanf(f, "%d", &level) == 1 && level > llc_level) {
+            llc = index;
+            llc_level = level;
+        }
+        fclose(f);
+    }
+    if (llc < 0)
+        return false;
+
+    snprintf(path, sizeof path, "%s/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+             sysfs_root(), cpu, llc);
+    return read_cpu_list(path, cpus);
+}
+
+/* Split the CPUs the shell may run on into cache domains.  If any
+ * cannot be told, there are none. */
+static void
+find_domains(void)
+{
+    cpu_set_t allowed, seen;
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == -1)
+        return;
+    CPU_ZERO(&seen);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || CPU_ISSET(cpu, &seen))
+            continue;
+
+        cpu_set_t llc;
+        CPU_ZERO(&llc);
+        if (ndomains == MAX_DOMAINS || !add_llc_cpus(cpu, &llc)) {
+            ndomains = 0;
+            return;
+        }
+        CPU_AND(&llc, &llc, &allowed);
+        CPU_SET(cpu, &llc);
+        CPU_OR(&seen, &seen, &llc);
+        domains[ndomains++] = llc;
+    }
+}
+
+/* Write 'cpus' as a list such as "0-3,8" */
+static void
+format_list(const cpu_set_t *cpus, char *buf, size_t size)
+{
+    const char *sep = "";
+    int cpu, n;
+    for (cpu = 0; cpu < CPU_SETSIZE && size > 1; cpu++) {
+        if (!CPU_ISSET(cpu, cpus))
+            continue;
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+        if (last == cpu)
+            n = snprintf(buf, size, "%s%d", sep, cpu);
+        else
+            n = snprintf(buf, size, "%s%d-%d", sep, cpu, last);
+        sep = ",";
+        if (n < 0 || n >= size)
+            break;
+        buf += n;
+        size -= n;
+        cpu = last;
+    }
+}
+
+/* Parse an 'on' prefix and its key=value words at the start of argv */
+struct esh_placement *
+esh_placement_from_argv(char **argv, int *nwords)
+{
+    struct esh_placement *placement = calloc(1, sizeof *placement);
+    char *desc = placement->desc;
+    size_t left = sizeof placement->desc;
+    int i;
+
+    CPU_ZERO(&placement->cpus);
+    for (i = 1; argv[i] != NULL && strchr(argv[i], '='); i++) {
+        char *word = argv[i];
+        if (strncmp(word, "cpus=", 5) == 0) {
+            if (!parse_list(word + 5, CPU_SETSIZE, add_cpu, &placement->cpus))
+                goto bad;
+            placement->has_cpus = true;
+        } else if (strncmp(word, "node=", 5) == 0) {
+            if (!parse_list(word + 5, MAX_NODES, add_node, &placement->nodes))
+                goto bad;
+            placement->has_nodes = true;
+        } else {
+            goto bad;
+        }
+
+        int n = snprintf(desc, left, "%s%s", i > 1 ? " " : "", word);
+        if (n > 0 && n < left) {
+            desc += n;
+            left -= n;
+        }
+    }
+
+    if (i == 1) {
+        fprintf(stderr, "usage: on [cpus=LIST] [node=LIST] command\n");
+        free(placement);
+        return NULL;
+    }
+
+    /* Without an explicit CPU list, run on the CPUs local to the nodes */
+    if (placement->has_nodes && !placement->has_cpus) {
+        if (!add_node_cpus(placement->nodes, &placement->cpus)) {
+            fprintf(stderr, "on: cannot determine CPUs of node(s)\n");
+            free(placement);
+            return NULL;
+        }
+        placement->has_cpus = true;
+    }
+
+    *nwords = i;
+    return placement;
+
+bad:
+    fprintf(stderr, "on: invalid placement '%s'\n", argv[i]);
+    free(placement);
+    return NULL;
+}
+
+/* Apply a placement to the calling process */
+int
+esh_placement_apply(struct esh_placement *placement)
+{
+    if (placement->has_cpus
+        && sched_setaffinity(0, sizeof placement->cpus, &placement->cpus) == -1)
+        return -1;
+
+    if (placement->has_nodes
+        && syscall(SYS_set_mempolicy, MPOL_BIND,
+                   &placement->nodes, MAX_NODES + 1) == -1)
+        return -1;
+
+    return 0;
+}
+
+/* The placement of a pipeline of several commands that was given none */
+struct esh_placement *
+esh_placement_default(void)
+{
+    pthread_once(&domains_once, find_domains);
+    if (ndomains < 2)
+        return NULL;
+
+    struct esh_placement *placement = calloc(1, sizeof *placement);
+    if (placement == NULL)
+        return NULL;
+    placement->cpus = domains[atomic_fetch_add(&next_domain, 1) % ndomains];
+    placement->has_cpus = true;
+    strcpy(placement->desc, "auto cpus=");
+    format_list(&placement->cpus, placement->desc + strlen(placement->desc),
+                sizeof placement->desc - strlen(placement->desc));
+    return placement;
+}
@@ -0,0 +1,46 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * CPU and NUMA placement of jobs, as requested with the 'on' prefix:
+ *
+ *      on cpus=0-7 node=0 cmd | cmd2
+ *
+ * Every command of the pipeline is bound to the same CPU set, so the
+ * stages of one job run on nearby cores.
+ *
+ * A background pipeline of several commands that has no 'on' prefix
+ * is placed by default: on the CPUs that share a last-level cache, one
+ * such cache domain after the other for successive pipelines.  This
+ * happens only where the CPUs the shell may use span several domains.
+ * Foreground pipelines are left where the shell is, so an interactive
+ * command may use every CPU.  A pipeline given an 'on' prefix runs
+ * where that prefix says instead.
+ */
+
+#include <stdbool.h>
+#include <sched.h>
+
+struct esh_placement {
+    cpu_set_t cpus;             /* CPUs the job may run on */
+    bool has_cpus;              /* True if cpus= or node= was given */
+    unsigned long nodes;        /* Bit mask of NUMA nodes to allocate from */
+    bool has_nodes;             /* True if node= was given */
+    char desc[64];              /* Placement as typed, for 'jobs -l' */
+};
+
+/* Parse an 'on' prefix and its key=value words at the start of argv,
+ * and set *nwords to the number of words they take; the caller removes
+ * them.  Returns a malloc'd placement, or NULL after printing an error. */
+struct esh_placement * esh_placement_from_argv(char **argv, int *nwords);
+
+/* Apply a placement to the calling process.
+ * Meant to be called in the child before exec.
+ * Returns -1 and sets errno on failure. */
+int esh_placement_apply(struct esh_placement *placement);
+
+/* Return a malloc'd placement for a background pipeline of several
+ * commands that was given none: the next cache domain.  Returns NULL
+ * if the shell's CPUs are all in one domain, or if the domains cannot
+ * be told.  The domains are read from the sysfs under ESH_SYSFS_ROOT,
+ * if set, once. */
+struct esh_placement * esh_placement_default(void);
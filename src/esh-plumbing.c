@@ -0,0 +1,81 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Pipe plumbing between the commands of a pipeline.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "esh-plumbing.h"
+
+/* Close fd if open and mark it closed */
+static void
+close_fd(int *fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/* Make 'target' a copy of 'fd' that survives exec.  dup2 does nothing
+ * if the two are equal, so clear close-on-exec explicitly then. */
+static int
+move_fd(int fd, int target)
+{
+    if (fd == target)
+        return fcntl(fd, F_SETFD, 0);
+
+    return dup2(fd, target) == -1 ? -1 : 0;
+}
+
+/* Prepare plumbing for a new pipeline */
+void
+esh_plumbing_init(struct esh_plumbing *p)
+{
+    p->read_end = -1;
+    p->pipe[0] = p->pipe[1] = -1;
+}
+
+/* Create the pipe to the next command, unless this is the last one */
+int
+esh_plumbing_next(struct esh_plumbing *p, bool last)
+{
+    if (last)
+        return 0;
+
+    return pipe2(p->pipe, O_CLOEXEC);
+}
+
+/* In the child: connect stdin and stdout to this command's pipe ends.
+ * All pipe fds are close-on-exec, so nothing else needs closing. */
+int
+esh_plumbing_child(struct esh_plumbing *p)
+{
+    if (p->read_end != -1 && move_fd(p->read_end, 0) == -1)
+        return -1;
+
+    if (p->pipe[1] != -1 && move_fd(p->pipe[1], 1) == -1)
+        return -1;
+
+    return 0;
+}
+
+/* In the shell: close the ends now owned by the child */
+void
+esh_plumbing_parent(struct esh_plumbing *p)
+{
+    close_fd(&p->read_end);
+    close_fd(&p->pipe[1]);
+    p->read_end = p->pipe[0];
+    p->pipe[0] = -1;
+}
+
+/* In the shell: close any remaining pipe ends */
+void
+esh_plumbing_close(struct esh_plumbing *p)
+{
+    close_fd(&p->read_end);
+    close_fd(&p->pipe[0]);
+    close_fd(&p->pipe[1]);
+}
@@ -0,0 +1,43 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Pipe plumbing between the commands of a pipeline.
+ *
+ * The pipe feeding the next command is created just before each fork,
+ * with O_CLOEXEC, so at most one pipe (plus the read end left over
+ * from the previous command) is open in the shell at any time.  Each
+ * child gets exactly its two ends on stdin and stdout and inherits no
+ * other pipe fds; the shell closes its copies right after each fork.
+ * The work per command is constant, so long pipelines cost linear time.
+ *
+ * Usage, for each command:
+ *      esh_plumbing_next(&p, is_last);
+ *      fork();
+ *      child:  esh_plumbing_child(&p);
+ *      parent: esh_plumbing_parent(&p);
+ */
+
+#include <stdbool.h>
+
+struct esh_plumbing {
+    int read_end;       /* stdin of the next command, or -1 */
+    int pipe[2];        /* pipe to the command after that, or -1 */
+};
+
+/* Prepare plumbing for a new pipeline */
+void esh_plumbing_init(struct esh_plumbing *p);
+
+/* Create the pipe from the command about to be forked to the command
+ * after it, unless it is the last command.  Returns -1 on error. */
+int esh_plumbing_next(struct esh_plumbing *p, bool last);
+
+/* In the child: connect stdin and stdout to this command's pipe ends.
+ * Returns -1 on error. */
+int esh_plumbing_child(struct esh_plumbing *p);
+
+/* In the shell: close the ends now owned by the child and keep the
+ * read end for the next command. */
+void esh_plumbing_parent(struct esh_plumbing *p);
+
+/* In the shell: close any remaining pipe ends, e.g. when a fork failed */
+void esh_plumbing_close(struct esh_plumbing *p);
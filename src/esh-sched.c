@@ -0,0 +1,195 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Scheduling classes for background jobs.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/ioprio.h>
+
+#include "esh.h"
+#include "esh-sched.h"
+
+struct esh_sched_class esh_bg_sched = {
+    .policy = SCHED_OTHER,
+    .nice = 0,
+    .ioclass = IOPRIO_CLASS_NONE,
+};
+
+const struct esh_sched_class esh_sched_normal = {
+    .policy = SCHED_OTHER,
+    .nice = 0,
+    .ioclass = IOPRIO_CLASS_NONE,
+};
+
+static const char *policy_names[] = {
+    [SCHED_OTHER] = "normal",
+    [SCHED_BATCH] = "batch",
+    [SCHED_IDLE] = "idle",
+};
+
+static const char *ioclass_names[] = {
+    [IOPRIO_CLASS_NONE] = "none",
+    [IOPRIO_CLASS_BE] = "be",
+    [IOPRIO_CLASS_IDLE] = "idle",
+};
+
+/* Return index of 'name' in 'names', or -1 */
+static int
+lookup(const char *name, const char **names, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (names[i] && strcmp(names[i], name) == 0)
+            return i;
+    return -1;
+}
+
+#define NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Parse 'bgsched' arguments such as "batch nice=5 io=idle" */
+bool
+esh_sched_parse(FILE *err, char **argv, struct esh_sched_class *class)
+{
+    struct esh_sched_class c = *class;
+    for (; *argv; argv++) {
+        int v;
+        if (strncmp(*argv, "nice=", 5) == 0) {
+            char *end;
+            c.nice = strtol(*argv + 5, &end, 10);
+            if (*end != '\0' || c.nice < 0 || c.nice > 19)
+                goto bad;
+        } else if (strncmp(*argv, "io=", 3) == 0) {
+            if ((v = lookup(*argv + 3, ioclass_names, NELEM(ioclass_names))) < 0)
+                goto bad;
+            c.ioclass = v;
+        } else {
+            if ((v = lookup(*argv, policy_names, NELEM(policy_names))) < 0)
+                goto bad;
+            c.policy = v;
+        }
+    }
+    *class = c;
+    return true;
+
+bad:
+    fprintf(err, "bgsched: invalid setting '%s'\n"
+            "usage: bgsched [normal|batch|idle] [nice=0-19] [io=none|be|idle]\n",
+            *argv);
+    return false;
+}
+
+/* Print a class in the form accepted by esh_sched_parse */
+void
+esh_sched_print(FILE *out, struct esh_sched_class *class)
+{
+    fprintf(out, "%s nice=%d io=%s\n", policy_names[class->policy],
+           class->nice, ioclass_names[class->ioclass]);
+}
+
+static int
+ioprio_set(int which, int who, int ioclass)
+{
+    return syscall(SYS_ioprio_set, which, who, IOPRIO_PRIO_VALUE(ioclass, 0));
+}
+
+/* Set the CPU policy of every process of a job; the kernel has no
+ * process group variant of sched_setscheduler(2).  A reaped process's
+ * pid may be someone else's by now, so it is skipped. */
+static void
+set_policy(struct esh_pipeline *pipe, int policy)
+{
+    struct sched_param param = { .sched_priority = 0 };
+    struct list_elem * e = list_begin(&pipe->commands);
+    for (; e != list_end(&pipe->commands); e = list_next(e)) {
+        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+        if (cmd->pid > 0 && !cmd->exited)
+            sched_setscheduler(cmd->pid, policy, &param);
+    }
+}
+
+/* Set the I/O class and the nice value of every process of a job:
+ * through its process group, or one process at a time */
+static void
+set_ioclass(struct esh_pipeline *pipe, bool by_pgrp, int ioclass)
+{
+    if (by_pgrp) {
+        ioprio_set(IOPRIO_WHO_PGRP, pipe->pgrp, ioclass);
+        return;
+    }
+    struct list_elem * e = list_begin(&pipe->commands);
+    for (; e != list_end(&pipe->commands); e = list_next(e)) {
+        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+        if (cmd->pid > 0 && !cmd->exited)
+            ioprio_set(IOPRIO_WHO_PROCESS, cmd->pid, ioclass);
+    }
+}
+
+static void
+set_nice(struct esh_pipeline *pipe, bool by_pgrp, int nice)
+{
+    if (by_pgrp) {
+        setpriority(PRIO_PGRP, pipe->pgrp, nice);
+        return;
+    }
+    struct list_elem * e = list_begin(&pipe->commands);
+    for (; e != list_end(&pipe->commands); e = list_next(e)) {
+        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+        if (cmd->pid > 0 && !cmd->exited)
+            setpriority(PRIO_PROCESS, cmd->pid, nice);
+    }
+}
+
+/* Put the calling process into the background class.
+ * Errors are ignored; a job that keeps normal priority still runs. */
+void
+esh_sched_background_self(void)
+{
+    struct sched_param param = { .sched_priority = 0 };
+
+    if (esh_bg_sched.policy != SCHED_OTHER)
+        sched_setscheduler(0, esh_bg_sched.policy, &param);
+    if (esh_bg_sched.ioclass != IOPRIO_CLASS_NONE)
+        ioprio_set(IOPRIO_WHO_PROCESS, 0, esh_bg_sched.ioclass);
+    if (esh_bg_sched.nice != 0)
+        setpriority(PRIO_PROCESS, 0, esh_bg_sched.nice);
+}
+
+/* Move all processes of a job from the class it is in into 'to' */
+static void
+move(struct esh_pipeline *pipe, bool by_pgrp, const struct esh_sched_class *to)
+{
+    struct esh_sched_class *from = &pipe->sched;
+    if (pipe->pgrp <= 0)
+        return;
+
+    if (to->policy != from->policy)
+        set_policy(pipe, to->policy);
+    if (to->ioclass != from->ioclass)
+        set_ioclass(pipe, by_pgrp, to->ioclass);
+    if (to->nice != from->nice)
+        set_nice(pipe, by_pgrp, to->nice);
+    *from = *to;
+}
+
+/* Move all processes of a job into the background class */
+void
+esh_sched_background(struct esh_pipeline *pipe, bool by_pgrp)
+{
+    move(pipe, by_pgrp, &esh_bg_sched);
+}
+
+/* Give a job normal priority again, undoing the class it was put into
+ * even if bgsched has changed it since.
+ * Without CAP_SYS_NICE (or a suitable RLIMIT_NICE), a raised nice
+ * value cannot be lowered again; the policy and I/O class can. */
+void
+esh_sched_foreground(struct esh_pipeline *pipe, bool by_pgrp)
+{
+    move(pipe, by_pgrp, &esh_sched_normal);
+}
@@ -0,0 +1,46 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Scheduling classes for background jobs.
+ *
+ * Background jobs run with a configurable CPU policy, nice value
+ * and I/O priority class, and get normal priority back when moved to
+ * the foreground.  The class is normal until set with the 'bgsched'
+ * builtin, e.g. 'bgsched batch io=idle': an idle I/O class can starve
+ * a job for as long as other I/O keeps the disk busy, so it is asked
+ * for, not assumed.
+ *
+ * A job is moved through its process group, or, in headless mode
+ * without -g, where it has none, process by process.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+struct esh_pipeline;
+struct esh_sched_class;     /* in esh.h */
+
+/* Class given to background jobs */
+extern struct esh_sched_class esh_bg_sched;
+
+/* Normal priority, the class of foreground jobs */
+extern const struct esh_sched_class esh_sched_normal;
+
+/* Parse 'bgsched' arguments such as "batch nice=5 io=idle" into class.
+ * Returns false after printing an error to 'err'. */
+bool esh_sched_parse(FILE *err, char **argv, struct esh_sched_class *class);
+
+/* Print a class to 'out' in the form accepted by esh_sched_parse */
+void esh_sched_print(FILE *out, struct esh_sched_class *class);
+
+/* Put the calling process into the background class.
+ * Meant to be called in the child before exec. */
+void esh_sched_background_self(void);
+
+/* Move all processes of a job into the background class, or back to
+ * normal priority.  'by_pgrp' is true if the job has a process group
+ * of its own.  Only what differs from the class the job is in, as
+ * recorded in pipe->sched, is changed. */
+void esh_sched_background(struct esh_pipeline *pipe, bool by_pgrp);
+void esh_sched_foreground(struct esh_pipeline *pipe, bool by_pgrp);
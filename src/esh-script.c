@@ -0,0 +1,719 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Running scripts from a precompiled cache.
+ *
+ * The cache file holds an image of the parsed trees, laid out exactly
+ * as in memory, except that each pointer holds an offset from the start
+ * of the file.  A relocation table lists where these pointers are; after
+ * mapping the file privately, adding the mapping's address to each of
+ * them yields ready-to-use structures.
+ *
+ * A cache file is not trusted: before it is used, every offset in it is
+ * checked against its size, and every tree it holds is walked to check
+ * that each pointer leads to an object wholly inside it.  A file that
+ * fails is ignored, and the script compiled again.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "esh.h"
+#include "esh-script.h"
+
+#define ESHC_MAGIC      "ESHC\0\0\0\1"
+
+/* Version of the layout of the file itself: header and tables */
+#define ESHC_LAYOUT     2
+
+/* Changes whenever the layout of the file or of the cached structures does */
+#define ESHC_ABI    ((uint64_t) ESHC_LAYOUT << 32 \
+                     | (sizeof(struct esh_command_line) \
+                        ^ sizeof(struct esh_pipeline) << 10 \
+                        ^ sizeof(struct esh_command) << 20))
+
+/* Deepest nesting of groups checked in a cache file; a script nested
+ * deeper is compiled on every run */
+#define ESHC_MAX_DEPTH  256
+
+struct eshc_header {
+    char magic[8];
+    uint64_t abi;
+    uint64_t mtime_sec, mtime_nsec;     /* of the script */
+    uint64_t size;                      /* of the script */
+    uint64_t hash;                      /* of the script's contents */
+    uint64_t nlines, lines;             /* offsets of command lines */
+    uint64_t nrelocs, relocs;           /* offsets of pointers */
+    uint64_t nerrors, errors;           /* parse errors */
+    char path[PATH_MAX];                /* script's canonical path */
+};
+
+/* A line of the script that did not parse */
+struct eshc_error {
+    uint64_t line;                      /* its number */
+    uint64_t msg;                       /* offset of the message */
+};
+
+struct esh_script {
+    char *base;                 /* mapped cache file or image in memory */
+    uint64_t *lines;            /* offsets of the command lines */
+    uint64_t nlines;
+    uint64_t next;              /* index of next command line to run */
+};
+
+/* An image under construction */
+struct image {
+    char *buf;
+    size_t len, cap;
+    uint64_t *relocs;
+    size_t nrelocs, relcap;
+};
+
+/* FNV-1a */
+static uint64_t
+hash_bytes(const char *p, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (len-- > 0)
+        h = (h ^ (unsigned char) *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Allocate 'size' zeroed, aligned bytes in img, return their offset */
+static size_t
+img_alloc(struct image *img, size_t size)
+{
+    size_t off = (img->len + 7) & ~(size_t) 7;
+    while (off + size > img->cap)
+        img->buf = realloc(img->buf, img->cap = img->cap ? 2 * img->cap : 4096);
+    memset(img->buf + img->len, 0, off + size - img->len);
+    img->len = off + size;
+    return off;
+}
+
+/* Make the pointer at offset 'field' point to offset 'target' (0: NULL) */
+static void
+img_ptr(struct image *img, size_t field, size_t target)
+{
+    *(uintptr_t *) (img->buf + field) = target;
+    if (target == 0)
+        return;
+
+    if (img->nrelocs == img->relcap)
+        img->relocs = realloc(img->relocs,
+            (img->relcap = img->relcap ? 2 * img->relcap : 256) * sizeof(uint64_t));
+    img->relocs[img->nrelocs++] = field;
+}
+
+static size_t
+img_string(struct image *img, const char *s)
+{
+    if (s == NULL)
+        return 0;
+
+    size_t off = img_alloc(img, strlen(s) + 1);
+    strcpy(img->buf + off, s);
+    return off;
+}
+
+/* Link the list_elems at offsets elems[0..n) into the list at 'list' */
+static void
+img_list(struct image *img, size_t list, size_t *elems, size_t n)
+{
+    size_t head = list + offsetof(struct list, head);
+    size_t tail = list + offsetof(struct list, tail);
+    size_t i;
+
+    img_ptr(img, head + offsetof(struct list_elem, next), n ? elems[0] : tail);
+    img_ptr(img, tail + offsetof(struct list_elem, prev), n ? elems[n - 1] : head);
+    for (i = 0; i < n; i++) {
+        img_ptr(img, elems[i] + offsetof(struct list_elem, prev),
+                i > 0 ? elems[i - 1] : head);
+        img_ptr(img, elems[i] + offsetof(struct list_elem, next),
+                i + 1 < n ? elems[i + 1] : tail);
+    }
+}
+
+#define FIELD(img, off, type, member) \
+        (((type *) ((img)->buf + (off)))->member)
+
+static size_t img_command_line(struct image *img, struct esh_command_line *cline);
+
+static size_t
+img_command(struct image *img, struct esh_command *cmd, size_t pipe)
+{
+    size_t c = img_alloc(img, sizeof(struct esh_command));
+    FIELD(img, c, struct esh_command, append_to_output) = cmd->append_to_output;
+    FIELD(img, c, struct esh_command, has_subst) = cmd->has_subst;
+    FIELD(img, c, struct esh_command, subshell) = cmd->subshell;
+
+    int argc = 0, i;
+    while (cmd->argv[argc])
+        argc++;
+    size_t argv = img_alloc(img, (argc + 1) * sizeof(char *));
+    for (i = 0; i < argc; i++)
+        img_ptr(img, argv + i * sizeof(char *), img_string(img, cmd->argv[i]));
+
+    img_ptr(img, c + offsetof(struct esh_command, argv), argv);
+    img_ptr(img, c + offsetof(struct esh_command, iored_input),
+            img_string(img, cmd->iored_input));
+    img_ptr(img, c + offsetof(struct esh_command, iored_output),
+            img_string(img, cmd->iored_output));
+    img_ptr(img, c + offsetof(struct esh_command, iored_here),
+            img_string(img, cmd->iored_here));
+    img_ptr(img, c + offsetof(struct esh_command, pipeline), pipe);
+    if (cmd->group != NULL)
+        img_ptr(img, c + offsetof(struct esh_command, group),
+                img_command_line(img, cmd->group));
+    return c;
+}
+
+static size_t
+img_pipeline(struct image *img, struct esh_pipeline *pipe)
+{
+    size_t p = img_alloc(img, sizeof(struct esh_pipeline));
+    FIELD(img, p, struct esh_pipeline, append_to_output) = pipe->append_to_output;
+    FIELD(img, p, struct esh_pipeline, bg_job) = pipe->bg_job;
+    FIELD(img, p, struct esh_pipeline, mapped) = true;
+    FIELD(img, p, struct esh_pipeline, refcount) = 1;
+
+    size_t n = list_size(&pipe->commands), i = 0;
+    size_t elems[n];
+    struct list_elem * e = list_begin(&pipe->commands);
+    for (; e != list_end(&pipe->commands); e = list_next(e)) {
+        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+        elems[i++] = img_command(img, cmd, p) + offsetof(struct esh_command, elem);
+    }
+    img_list(img, p + offsetof(struct esh_pipeline, commands), elems, n);
+
+    img_ptr(img, p + offsetof(struct esh_pipeline, iored_input),
+            img_string(img, pipe->iored_input));
+    img_ptr(img, p + offsetof(struct esh_pipeline, iored_output),
+            img_string(img, pipe->iored_output));
+    return p;
+}
+
+static size_t
+img_command_line(struct image *img, struct esh_command_line *cline)
+{
+    size_t l = img_alloc(img, sizeof(struct esh_command_line));
+    FIELD(img, l, struct esh_command_line, mapped) = true;
+
+    size_t n = list_size(&cline->pipes), i = 0;
+    size_t elems[n];
+    struct list_elem * e = list_begin(&cline->pipes);
+    for (; e != list_end(&cline->pipes); e = list_next(e)) {
+        struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+        elems[i++] = img_pipeline(img, pipe) + offsetof(struct esh_pipeline, elem);
+    }
+    img_list(img, l + offsetof(struct esh_command_line, pipes), elems, n);
+    return l;
+}
+
+/* Fill in the bodies of here-documents from the script's next lines.
+ * Returns the position after the last line consumed. */
+static char *
+read_here_documents(struct esh_command_line *cline, char *p, char *end,
+                    size_t *lineno)
+{
+    struct list_elem * e = list_begin(&cline->pipes);
+    for (; e != list_end(&cline->pipes); e = list_next(e)) {
+        struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+        struct list_elem * c = list_begin(&pipe->commands);
+        for (; c != list_end(&pipe->commands); c = list_next(c)) {
+            struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+            if (cmd->group != NULL)
+                p = read_here_documents(cmd->group, p, end, lineno);
+            if (cmd->here_delim == NULL)
+                continue;
+
+            char *body = p;
+            size_t dlen = strlen(cmd->here_delim);
+            while (p < end) {
+                char *eol = memchr(p, '\n', end - p);
+                if (eol == NULL)
+                    eol = end;
+                (*lineno)++;
+                if (eol - p == dlen && memcmp(p, cmd->here_delim, dlen) == 0) {
+                    cmd->iored_here = strndup(body, p - body);
+                    p = eol < end ? eol + 1 : end;
+                    goto next;
+                }
+                p = eol < end ? eol + 1 : end;
+            }
+            cmd->iored_here = strndup(body, p - body);
+        next:
+            free(cmd->here_delim);
+            cmd->here_delim = NULL;
+        }
+    }
+    return p;
+}
+
+/* Parse a script's text into an image, leaving room for the header.
+ * The default parser is run quietly, so that its messages go into the
+ * image; another parser reports errors as it will. */
+static void
+compile(struct image *img, char *text, size_t size,
+        struct esh_command_line * (* parse) (char *))
+{
+    size_t nlines = 0, cap = 64, lineno = 0;
+    uint64_t *lines = malloc(cap * sizeof *lines);
+    size_t nerrors = 0, errcap = 0;
+    struct eshc_error *errors = NULL;
+    char *p = text, *end = text + size;
+    struct esh_parser *parser = NULL;
+
+    if (parse == esh_parse_command_line)
+        parser = esh_parser_create();
+
+    img_alloc(img, sizeof(struct eshc_header));
+    while (p < end) {
+        char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        char *line = strndup(p, eol - p);
+        p = eol < end ? eol + 1 : end;
+        lineno++;
+
+        /* skip comments, including a #! line */
+        if (line[strspn(line, " \t")] == '#') {
+            free(line);
+            continue;
+        }
+
+        struct esh_command_line *cline = parser != NULL
+            ? esh_parse_command_line_r(parser, line) : parse(line);
+        free(line);
+        if (cline == NULL) {
+            if (nerrors == errcap)
+                errors = realloc(errors,
+                    (errcap = errcap ? 2 * errcap : 16) * sizeof *errors);
+            errors[nerrors].line = lineno;
+            errors[nerrors++].msg = img_string(img, parser != NULL
+                ? esh_parser_error(parser, NULL) : "syntax error");
+            continue;
+        }
+
+        p = read_here_documents(cline, p, end, &lineno);
+        if (!list_empty(&cline->pipes)) {
+            if (nlines == cap)
+                lines = realloc(lines, (cap *= 2) * sizeof *lines);
+            lines[nlines++] = img_command_line(img, cline);
+        }
+        esh_command_line_free(cline);
+    }
+
+    size_t l = img_alloc(img, nlines * sizeof *lines);
+    memcpy(img->buf + l, lines, nlines * sizeof *lines);
+    FIELD(img, 0, struct eshc_header, nlines) = nlines;
+    FIELD(img, 0, struct eshc_header, lines) = l;
+    free(lines);
+
+    size_t e = img_alloc(img, nerrors * sizeof *errors);
+    memcpy(img->buf + e, errors, nerrors * sizeof *errors);
+    FIELD(img, 0, struct eshc_header, nerrors) = nerrors;
+    FIELD(img, 0, struct eshc_header, errors) = e;
+    free(errors);
+    if (parser != NULL)
+        esh_parser_destroy(parser);
+
+    size_t r = img_alloc(img, img->nrelocs * sizeof(uint64_t));
+    memcpy(img->buf + r, img->relocs, img->nrelocs * sizeof(uint64_t));
+    FIELD(img, 0, struct eshc_header, nrelocs) = img->nrelocs;
+    FIELD(img, 0, struct eshc_header, relocs) = r;
+}
+
+/* Turn the offsets in a loaded image into pointers */
+static struct esh_script *
+relocate(char *base)
+{
+    struct eshc_header *h = (struct eshc_header *) base;
+    uint64_t *relocs = (uint64_t *) (base + h->relocs);
+    uint64_t i;
+
+    for (i = 0; i < h->nrelocs; i++)
+        *(uintptr_t *) (base + relocs[i]) += (uintptr_t) base;
+
+    struct esh_script *script = malloc(sizeof *script);
+    script->base = base;
+    script->lines = (uint64_t *) (base + h->lines);
+    script->nlines = h->nlines;
+    script->next = 0;
+    return script;
+}
+
+/* True if 'n' entries of 'size' bytes at offset 'off' lie in a file
+ * of 'file' bytes */
+static bool
+in_file(uint64_t file, uint64_t off, uint64_t n, size_t size)
+{
+    return off <= file && n <= (file - off) / size;
+}
+
+/* Check the relocation table of the image at 'base', before relocating:
+ * each pointer must lie between the header and the tables, which come
+ * last, and hold an offset into that part of the image */
+static bool
+check_relocs(char *base)
+{
+    struct eshc_header *h = (struct eshc_header *) base;
+    uint64_t *relocs = (uint64_t *) (base + h->relocs);
+    uint64_t end = h->lines, i;
+
+    if (h->errors < end)
+        end = h->errors;
+    if (h->relocs < end)
+        end = h->relocs;
+    for (i = 0; i < h->nrelocs; i++) {
+        if (relocs[i] % sizeof(uintptr_t) != 0 || relocs[i] < sizeof *h
+            || !in_file(end, relocs[i], 1, sizeof(uintptr_t))
+            || *(uintptr_t *) (base + relocs[i]) >= end)
+            return false;
+    }
+    return true;
+}
+
+/* Walking a relocated image.  'budget' bounds the objects visited, so
+ * that a cycle cannot make the walk endless. */
+struct check {
+    char *base;
+    size_t size;
+    size_t budget;
+    int depth;
+};
+
+/* True if 'p' points to 'size' aligned bytes inside the image */
+static bool
+check_object(struct check *c, const void *p, size_t size)
+{
+    uintptr_t off = (uintptr_t) p - (uintptr_t) c->base;
+    if (c->budget == 0 || (uintptr_t) p < (uintptr_t) c->base)
+        return false;
+    c->budget--;
+    return off % sizeof(void *) == 0 && in_file(c->size, off, 1, size);
+}
+
+/* True if 's' is NULL or a string that ends inside the image */
+static bool
+check_string(struct check *c, const char *s)
+{
+    uintptr_t off = (uintptr_t) s - (uintptr_t) c->base;
+    if (s == NULL)
+        return true;
+    return (uintptr_t) s >= (uintptr_t) c->base && off < c->size
+        && memchr(s, '\0', c->size - off) != NULL;
+}
+
+/* Check the list 'list', whose elements are member 'elem' of objects of
+ * 'size' bytes, and call 'fn' on each object */
+static bool
+check_list(struct check *c, struct list *list, size_t elem, size_t size,
+           bool (* fn) (struct check *, void *, void *), void *arg)
+{
+    struct list_elem *prev = &list->head, *e = list->head.next;
+
+    while (e != &list->tail) {
+        void *obj = (void *) ((uintptr_t) e - elem);
+        if (!check_object(c, obj, size) || e->prev != prev || !fn(c, obj, arg))
+            return false;
+        prev = e;
+        e = e->next;
+    }
+    return list->tail.prev == prev;
+}
+
+/* True if the 'size' bytes at 'p', one of the cached objects, are zero */
+static bool
+all_zero(const void *p, size_t size)
+{
+    static const union {
+        struct esh_command_line cline;
+        struct esh_pipeline pipe;
+        struct esh_command cmd;
+    } zero;
+    return memcmp(p, &zero, size) == 0;
+}
+
+static bool check_command_line(struct check *c, struct esh_command_line *cline);
+
+/* The check_* functions also check that the fields the image does not
+ * set, which hold the state of a running job, are zero as img_alloc
+ * left them: of a copy with the fields it sets cleared, all is zero */
+
+static bool
+check_command(struct check *c, void *obj, void *pipe)
+{
+    struct esh_command *cmd = obj, rest;
+    char **argv = cmd->argv;
+
+    memcpy(&rest, cmd, sizeof rest);
+    rest.argv = NULL;
+    rest.iored_input = rest.iored_output = rest.iored_here = NULL;
+    rest.append_to_output = rest.has_subst = rest.subshell = false;
+    rest.group = NULL;
+    rest.elem.prev = rest.elem.next = NULL;
+    rest.pipeline = NULL;
+
+    if (cmd->pipeline != pipe || !all_zero(&rest, sizeof rest)
+        || !check_string(c, cmd->iored_input)
+        || !check_string(c, cmd->iored_output)
+        || !check_string(c, cmd->iored_here)
+        || !check_object(c, argv, sizeof *argv))
+        return false;
+    for (; *argv != NULL; argv++) {
+        if (!check_string(c, *argv) || !check_object(c, argv + 1, sizeof *argv))
+            return false;
+    }
+    return cmd->group == NULL || check_command_line(c, cmd->group);
+}
+
+static bool
+check_pipeline(struct check *c, void *obj, void *arg)
+{
+    struct esh_pipeline *pipe = obj, rest;
+
+    memcpy(&rest, pipe, sizeof rest);
+    rest.commands.head.next = rest.commands.tail.prev = NULL;
+    rest.iored_input = rest.iored_output = NULL;
+    rest.append_to_output = rest.bg_job = rest.mapped = false;
+    rest.elem.prev = rest.elem.next = NULL;
+    atomic_store(&rest.refcount, 0);
+
+    return pipe->mapped && atomic_load(&pipe->refcount) == 1
+        && all_zero(&rest, sizeof rest)
+        && check_string(c, pipe->iored_input)
+        && check_string(c, pipe->iored_output)
+        && check_list(c, &pipe->commands, offsetof(struct esh_command, elem),
+                      sizeof(struct esh_command), check_command, pipe);
+}
+
+static bool
+check_command_line(struct check *c, struct esh_command_line *cline)
+{
+    struct esh_command_line rest;
+    if (c->depth == ESHC_MAX_DEPTH || !check_object(c, cline, sizeof *cline)
+        || !cline->mapped)
+        return false;
+
+    memcpy(&rest, cline, sizeof rest);
+    rest.pipes.head.next = rest.pipes.tail.prev = NULL;
+    rest.mapped = false;
+    if (!all_zero(&rest, sizeof rest))
+        return false;
+
+    c->depth++;
+    bool ok = check_list(c, &cline->pipes, offsetof(struct esh_pipeline, elem),
+                         sizeof(struct esh_pipeline), check_pipeline, NULL);
+    c->depth--;
+    return ok;
+}
+
+/* Check a relocated image: its command lines, and its parse errors */
+static bool
+check_script(struct esh_script *script, size_t size)
+{
+    struct eshc_header *h = (struct eshc_header *) script->base;
+    struct eshc_error *errors = (struct eshc_error *) (script->base + h->errors);
+    struct check c = { script->base, size, size / sizeof(void *), 0 };
+    uint64_t i;
+
+    for (i = 0; i < script->nlines; i++) {
+        if (script->lines[i] >= size
+            || !check_command_line(&c, (struct esh_command_line *)
+                                       (script->base + script->lines[i])))
+            return false;
+    }
+    for (i = 0; i < h->nerrors; i++) {
+        if (errors[i].msg >= size || !check_string(&c, script->base + errors[i].msg))
+            return false;
+    }
+    return true;
+}
+
+/* Name of the cache file for the script at canonical path 'path' */
+static bool
+cache_name(const char *path, char *name, size_t size)
+{
+    const char *dir = getenv("XDG_CACHE_HOME");
+    char buf[PATH_MAX];
+
+    if (dir == NULL || *dir == '\0') {
+        const char *home = getenv("HOME");
+        if (home == NULL)
+            return false;
+        snprintf(buf, sizeof buf, "%s/.cache", home);
+        dir = buf;
+    }
+    mkdir(dir, 0700);
+    snprintf(name, size, "%s/esh", dir);
+    mkdir(name, 0700);
+
+    int n = snprintf(name, size, "%s/esh/%016llx.eshc", dir,
+                     (unsigned long long) hash_bytes(path, strlen(path)));
+    return n > 0 && n < size;
+}
+
+/* Map the cache file 'name' if it is valid for the script */
+static struct esh_script *
+map_cache(const char *name, struct eshc_header *want)
+{
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    struct eshc_header h;
+    if (fstat(fd, &st) == -1 || read(fd, &h, sizeof h) != sizeof h
+        || memcmp(h.magic, want->magic, sizeof h.magic) != 0
+        || h.abi != want->abi
+        || h.mtime_sec != want->mtime_sec || h.mtime_nsec != want->mtime_nsec
+        || h.size != want->size || h.hash != want->hash
+        || memchr(h.path, '\0', sizeof h.path) == NULL
+        || strcmp(h.path, want->path) != 0
+        || h.relocs % sizeof(uint64_t) != 0
+        || !in_file(st.st_size, h.relocs, h.nrelocs, sizeof(uint64_t))
+        || h.lines % sizeof(uint64_t) != 0
+        || !in_file(st.st_size, h.lines, h.nlines, sizeof(uint64_t))
+        || h.errors % sizeof(uint64_t) != 0
+        || !in_file(st.st_size, h.errors, h.nerrors, sizeof(struct eshc_error))) {
+        close(fd);
+        return NULL;
+    }
+
+    /* private and writable: relocation and running jobs modify the
+     * mapped structures, copying only the pages they touch */
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    struct esh_script *script = NULL;
+    if (check_relocs(base)) {
+        script = relocate(base);
+        if (!check_script(script, st.st_size)) {
+            free(script);
+            script = NULL;
+        }
+    }
+    if (script == NULL)
+        munmap(base, st.st_size);
+    return script;
+}
+
+/* Write an image to cache file 'name', atomically */
+static void
+write_cache(const char *name, struct image *img)
+{
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof tmp, "%s.%d", name, getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return;
+
+    bool ok = write(fd, img->buf, img->len) == img->len;
+    if (close(fd) == 0 && ok && rename(tmp, name) == 0)
+        return;
+    unlink(tmp);
+}
+
+/* Open a script, compiling it into its cache file if needed */
+struct esh_script *
+esh_script_open(const char *path, struct esh_command_line * (* parse) (char *))
+{
+    struct eshc_header want;
+    memset(&want, 0, sizeof want);
+    memcpy(want.magic, ESHC_MAGIC, sizeof want.magic);
+    want.abi = ESHC_ABI;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || realpath(path, want.path) == NULL) {
+        perror(path);
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+
+    char *text = "";
+    if (st.st_size > 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    want.mtime_sec = st.st_mtim.tv_sec;
+    want.mtime_nsec = st.st_mtim.tv_nsec;
+    want.size = st.st_size;
+    want.hash = hash_bytes(text, st.st_size);
+
+    char name[PATH_MAX];
+    bool cacheable = cache_name(want.path, name, sizeof name);
+    struct esh_script *script = cacheable ? map_cache(name, &want) : NULL;
+    if (script == NULL) {
+        struct image img;
+        memset(&img, 0, sizeof img);
+        compile(&img, text, st.st_size, parse);
+        want.nlines = FIELD(&img, 0, struct eshc_header, nlines);
+        want.lines = FIELD(&img, 0, struct eshc_header, lines);
+        want.nrelocs = FIELD(&img, 0, struct eshc_header, nrelocs);
+        want.relocs = FIELD(&img, 0, struct eshc_header, relocs);
+        want.nerrors = FIELD(&img, 0, struct eshc_header, nerrors);
+        want.errors = FIELD(&img, 0, struct eshc_header, errors);
+        memcpy(img.buf, &want, sizeof want);
+        free(img.relocs);
+
+        if (cacheable)
+            write_cache(name, &img);
+
+        /* run from the image just built */
+        script = relocate(img.buf);
+    }
+
+    if (st.st_size > 0)
+        munmap(text, st.st_size);
+
+    /* from the image, so that runs from the cache report them too */
+    struct eshc_header *h = (struct eshc_header *) script->base;
+    struct eshc_error *errors = (struct eshc_error *) (script->base + h->errors);
+    uint64_t i;
+    for (i = 0; i < h->nerrors; i++)
+        fprintf(stderr, "%s:%llu: %s\n", path,
+                (unsigned long long) errors[i].line, script->base + errors[i].msg);
+    return script;
+}
+
+/* Return the script's next command line, or NULL at its end */
+struct esh_command_line *
+esh_script_next(struct esh_script *script)
+{
+    if (script->next == script->nlines)
+        return NULL;
+
+    return (struct esh_command_line *) (script->base + script->lines[script->next++]);
+}
+
+bool
+esh_script_at_end(struct esh_script *script)
+{
+    uint64_t i;
+    for (i = script->next; i < script->nlines; i++) {
+        struct esh_command_line *cline =
+            (struct esh_command_line *) (script->base + script->lines[i]);
+        if (!list_empty(&cline->pipes))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Running scripts from a precompiled cache.
+ *
+ * 'esh script' parses the script once and saves the resulting
+ * esh_command_line/esh_pipeline/esh_command trees in a cache file
+ * (.eshc), keyed by the script's path, mtime and content hash.
+ * Later runs mmap that file and execute straight from the mapped
+ * structures, with no parsing and no per-node malloc.  A cache file is
+ * checked before use, and compiled again if it does not pass.  Lines
+ * that do not parse are recorded in it too, so that every run reports
+ * them.
+ */
+
+#include <stdbool.h>
+
+struct esh_command_line;
+struct esh_script;
+
+/* Open a script, compiling it into its cache file if needed.
+ * 'parse' is used to parse the script's lines.
+ * Returns NULL after printing an error. */
+struct esh_script * esh_script_open(const char *path,
+                        struct esh_command_line * (* parse) (char *));
+
+/* Return the script's next command line, or NULL at its end.
+ * The command line and its pipelines are marked 'mapped'. */
+struct esh_command_line * esh_script_next(struct esh_script *script);
+
+/* True if the rest of the script has no command to run */
+bool esh_script_at_end(struct esh_script *script);
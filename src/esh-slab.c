@@ -0,0 +1,46 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Slab caches for objects of one size.
+ */
+#include <sys/mman.h>
+
+#include "esh-sys-utils.h"
+#include "esh-slab.h"
+
+#define CHUNK_SIZE  (64 * 1024)
+#define ALIGN       (sizeof(max_align_t))
+
+void *
+esh_slab_alloc(struct esh_slab *slab)
+{
+    void *obj = slab->free;
+    if (obj != NULL) {
+        slab->free = *(void **) obj;
+        slab->inuse++;
+        return obj;
+    }
+
+    size_t size = (slab->size + ALIGN - 1) & ~(ALIGN - 1);
+    if (slab->next == NULL || slab->end - slab->next < (ptrdiff_t) size) {
+        char *chunk = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED)
+            esh_sys_fatal_error("esh_slab_alloc: mmap");
+        slab->next = chunk;
+        slab->end = chunk + CHUNK_SIZE;
+        slab->chunks++;
+    }
+    obj = slab->next;
+    slab->next += size;
+    slab->inuse++;
+    return obj;
+}
+
+void
+esh_slab_free(struct esh_slab *slab, void *obj)
+{
+    *(void **) obj = slab->free;
+    slab->free = obj;
+    slab->inuse--;
+}
@@ -0,0 +1,31 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Slab caches for objects of one size.
+ *
+ * Objects are carved from 64 KiB chunks mapped with mmap(2), outside
+ * the malloc heap, and freed objects are kept on a free list for
+ * reuse.  Chunks are never returned, so a cache's footprint is its
+ * high-water mark.  esh allocates pipelines and commands this way, so
+ * the churn of many short jobs neither grows nor fragments the heap.
+ *
+ * Not thread- or signal-safe; give each thread caches of its own.
+ */
+
+#include <stddef.h>
+
+struct esh_slab {
+    size_t size;            /* object size */
+    void *free;             /* free list, linked through the objects */
+    char *next, *end;       /* unused rest of the newest chunk */
+    size_t chunks;          /* number of chunks mapped */
+    size_t inuse;           /* objects allocated */
+};
+
+#define ESH_SLAB_INITIALIZER(type) { .size = sizeof(type) }
+
+/* Allocate an object; exits on failure, like malloc in esh */
+void * esh_slab_alloc(struct esh_slab *slab);
+
+/* Return an object to its cache */
+void esh_slab_free(struct esh_slab *slab, void *obj);
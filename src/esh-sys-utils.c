@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 #include "esh-sys-utils.h"
 
@@ -26,9 +27,10 @@ static const char rcsid [] = "$Id: esh-sys-utils.c,v 1.6 2015/02/04 00:01:13 cs3
 static void 
 vesh_sys_error(char *fmt, va_list ap)
 {
-    char errmsg[1024];
+    char errbuf[1024];
 
-    strerror_r(errno, errmsg, sizeof errmsg);
+    /* GNU strerror_r; may return a static string instead of errbuf */
+    char *errmsg = strerror_r(errno, errbuf, sizeof errbuf);
     vfprintf(stderr, fmt, ap);
     fprintf(stderr, "%s\n", errmsg);
 }
@@ -66,20 +68,57 @@ esh_set_cloexec(int fd)
     return fcntl(fd, F_SETFD, oldflags | FD_CLOEXEC);
 }
 
+/* Create an anonymous in-memory file holding 'len' bytes from 'buf'.
+ * The file is sealed against further modification and rewound, so
+ * it can be handed to a child as its standard input.  Unlike a pipe,
+ * writing a large body never blocks.
+ * Returns the (close-on-exec) file descriptor, or -1 on error. */
+int
+esh_sys_memfd_from_buffer(const char *name, const char *buf, size_t len)
+{
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1)
+        return -1;
+
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+        buf += n;
+        len -= n;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+        goto fail;
+
+    if (lseek(fd, 0, SEEK_SET) == -1)
+        goto fail;
+
+    return fd;
+
+fail:
+    close(fd);
+    return -1;
+}
+
 static int terminal_fd = -1;           /* the controlling terminal */
 static struct termios saved_tty_state;  /* the state of the terminal when shell
                                            was started. */
 
-/* Initialize tty support.  Return pointer to saved initial terminal state */
+/* Initialize tty support.  Return pointer to saved initial terminal state,
+ * or NULL if there is no controlling terminal. */
 struct termios *
 esh_sys_tty_init(void)
 {
-    char *tty;
     assert(terminal_fd == -1 || !!!"esh_sys_tty_init already called");
 
-    terminal_fd = open(tty = ctermid(NULL), O_RDWR);
+    terminal_fd = open(ctermid(NULL), O_RDWR);
     if (terminal_fd == -1)
-        esh_sys_fatal_error("opening controlling terminal %s failed: ", tty);
+        return NULL;
 
     if (esh_set_cloexec(terminal_fd))
         esh_sys_fatal_error("cannot mark terminal fd FD_CLOEXEC");
@@ -117,6 +156,36 @@ retry:
     }
 }
 
+/* Put terminal 'fd' into raw mode for line editing */
+int
+esh_sys_tty_raw(int fd, struct termios *saved)
+{
+    struct termios raw;
+    if (tcgetattr(fd, saved) == -1)
+        return -1;
+
+    raw = *saved;
+    /* no echo, no canonical mode, no signals from ^C/^Z, no flow control */
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    while (tcsetattr(fd, TCSADRAIN, &raw) == -1) {
+        if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+/* Return terminal 'fd' to the settings saved by esh_sys_tty_raw */
+void
+esh_sys_tty_unraw(int fd, struct termios *saved)
+{
+    while (tcsetattr(fd, TCSADRAIN, saved) == -1 && errno == EINTR)
+        ;
+}
+
 /* Get a file descriptor that refers to controlling terminal */
 int 
 esh_sys_tty_getfd(void)
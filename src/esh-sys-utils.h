@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 #include <signal.h>
+#include <stddef.h>
 
 /* Print message to stderr, followed by information about current error. 
  * Use like 'printf' */
@@ -18,11 +19,16 @@ void esh_sys_fatal_error(char *fmt, ...);
 /* Set the 'close-on-exec' flag on fd, return error indicator */
 int esh_set_cloexec(int fd);
 
+/* Create a sealed, rewound in-memory file holding buf[0..len).
+ * Returns a close-on-exec fd, or -1 on error */
+int esh_sys_memfd_from_buffer(const char *name, const char *buf, size_t len);
+
 /* Get a file descriptor that refers to controlling terminal */
 int esh_sys_tty_getfd(void);
 
 /* Initialize tty support.  
- * Return pointer to static structure that saves initial state.
+ * Return pointer to static structure that saves initial state,
+ * or NULL if the process has no controlling terminal.
  * Restore this state via esh_sys_tty_restore() whenever the shell
  * takes back control of the terminal.
  */
@@ -36,6 +42,13 @@ void esh_sys_tty_save(struct termios *saved_tty_state);
  * This function is used when resuming a suspended job. */
 void esh_sys_tty_restore(struct termios *saved_tty_state);
 
+/* Put terminal 'fd' into raw mode for line editing, saving its
+ * previous settings in 'saved'.  Returns -1 if fd is not a terminal. */
+int esh_sys_tty_raw(int fd, struct termios *saved);
+
+/* Return terminal 'fd' to the settings saved by esh_sys_tty_raw */
+void esh_sys_tty_unraw(int fd, struct termios *saved);
+
 /* Return true if this signal is blocked */
 bool esh_signal_is_blocked(int sig);
 
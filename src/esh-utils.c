@@ -10,14 +10,25 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <limits.h>
+#include <time.h>
 
 #include "esh.h"
+#include "esh-hooks.h"
+#include "esh-slab.h"
+#include "esh-output.h"
+#include "esh-vjob.h"
+#include "esh-sched.h"
 
 static const char rcsid [] = "$Id: esh-utils.c,v 1.5 2011/03/29 15:46:28 cs3214 Exp $";
 
 /* List of loaded plugins */
 struct list esh_plugin_list;
 
+/* Pipelines and commands come and go with every job.  The caches are
+ * per thread; an object freed on another thread joins that thread's. */
+static _Thread_local struct esh_slab pipeline_slab = ESH_SLAB_INITIALIZER(struct esh_pipeline);
+static _Thread_local struct esh_slab command_slab = ESH_SLAB_INITIALIZER(struct esh_command);
+
 /* Create new command structure and initialize first command word,
  * and/or input or output redirect file. */
 struct esh_command *
@@ -26,12 +37,23 @@ esh_command_create(char ** argv,
                    char *iored_output,
                    bool append_to_output)
 {
-    struct esh_command *cmd = malloc(sizeof *cmd);
+    struct esh_command *cmd = esh_slab_alloc(&command_slab);
 
     cmd->iored_input = iored_input;
     cmd->iored_output = iored_output;
     cmd->argv = argv;
     cmd->append_to_output = append_to_output;
+    cmd->iored_here = NULL;
+    cmd->here_delim = NULL;
+    cmd->pid = 0;
+    cmd->has_subst = false;
+    cmd->subst_arena = NULL;
+    cmd->subst_arena_size = 0;
+    cmd->env = NULL;
+    cmd->batch = 0;
+    cmd->group = NULL;
+    cmd->subshell = false;
+    cmd->exited = false;
 
     return cmd;
 }
@@ -40,9 +62,17 @@ esh_command_create(char ** argv,
 struct esh_pipeline *
 esh_pipeline_create(struct esh_command *cmd)
 {
-    struct esh_pipeline *pipe = malloc(sizeof *pipe);
+    struct esh_pipeline *pipe = esh_slab_alloc(&pipeline_slab);
 
+    atomic_init(&pipe->refcount, 1);
     pipe->bg_job = false;
+    pipe->mapped = false;
+    pipe->pgrp = 0;
+    pipe->placement = NULL;
+    pipe->output = NULL;
+    pipe->waitstatus = 0;
+    pipe->vjob = NULL;
+    pipe->sched = esh_sched_normal;
     cmd->pipeline = pipe;
     list_init(&pipe->commands);
     list_push_back(&pipe->commands, &cmd->elem);
@@ -73,6 +103,7 @@ esh_command_line_create_empty(void)
     struct esh_command_line *cmdline = malloc(sizeof *cmdline);
 
     list_init(&cmdline->pipes);
+    cmdline->mapped = false;
     return cmdline;
 }
 
@@ -86,67 +117,73 @@ esh_command_line_create(struct esh_pipeline *pipe)
     return cmdline;
 }
 
-/* Print esh_command structure to stdout */
+/* Print esh_command structure to 'out' */
 void
-esh_command_print(struct esh_command *cmd)
+esh_command_print(FILE *out, struct esh_command *cmd)
 {
     char **p = cmd->argv;
 
-    printf("  Command:");
+    fprintf(out, "  Command:");
     while (*p)
-        printf(" %s", *p++);
+        fprintf(out, " %s", *p++);
 
-    printf("\n");
+    fprintf(out, "\n");
 
     if (cmd->iored_output)
-        printf("  stdout %ss to %s\n",
+        fprintf(out, "  stdout %ss to %s\n",
                 cmd->append_to_output ? "append" : "write",
                 cmd->iored_output);
 
     if (cmd->iored_input)
-        printf("  stdin reads from %s\n", cmd->iored_input);
+        fprintf(out, "  stdin reads from %s\n", cmd->iored_input);
+
+    if (cmd->here_delim)
+        fprintf(out, "  stdin reads here-document up to %s\n", cmd->here_delim);
+    else if (cmd->iored_here)
+        fprintf(out, "  stdin reads here-document of %zu bytes\n",
+                strlen(cmd->iored_here));
 }
 
-/* Print esh_pipeline structure to stdout */
+/* Print esh_pipeline structure to 'out' */
 void
-esh_pipeline_print(struct esh_pipeline *pipe)
+esh_pipeline_print(FILE *out, struct esh_pipeline *pipe)
 {
     int i = 1;
     struct list_elem * e = list_begin (&pipe->commands);
 
-    printf(" Pipeline\n");
+    fprintf(out, " Pipeline\n");
     for (; e != list_end (&pipe->commands); e = list_next (e)) {
         struct esh_command *cmd = list_entry(e, struct esh_command, elem);
 
-        printf("[%d]", i++);
-        if(pipe->status == BACKGROUND) {
-            printf("+ Running ");
-        }
-        if(pipe->status == BACKGROUND) {
-            printf("+ Stopped ");
+        fprintf(out, "[%d]", i++);
+        if(pipe->status == BACKGROUND) {
+            fprintf(out, "+ Running ");
+        }
+        if(pipe->status == BACKGROUND) {
+            fprintf(out, "+ Stopped ");
         }
-        esh_command_print(cmd);
+        esh_command_print(out, cmd);
     }
 
-    if (pipe->bg_job)
-        printf(" &\n");
-        printf("  - is a background job\n");
+    if (pipe->bg_job)
+        fprintf(out, " &\n");
+        fprintf(out, "  - is a background job\n");
 }
 
-/* Print esh_command_line structure to stdout */
+/* Print esh_command_line structure to 'out' */
 void
-esh_command_line_print(struct esh_command_line *cmdline)
+esh_command_line_print(FILE *out, struct esh_command_line *cmdline)
 {
     struct list_elem * e = list_begin (&cmdline->pipes);
 
-    printf("Command line\n");
+    fprintf(out, "Command line\n");
     for (; e != list_end (&cmdline->pipes); e = list_next (e)) {
         struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
 
-        printf(" ------------- \n");
-        esh_pipeline_print(pipe);
+        fprintf(out, " ------------- \n");
+        esh_pipeline_print(out, pipe);
     }
-    printf("==========================================\n");
+    fprintf(out, "==========================================\n");
 }
 
 /* Deallocation functions. */
@@ -160,7 +197,15 @@ esh_command_line_free(struct esh_command_line *cmdline)
         e = list_remove(e);
         esh_pipeline_free(pipe);
     }
-    free(cmdline);
+    if (!cmdline->mapped)
+        free(cmdline);
+}
+
+struct esh_pipeline *
+esh_pipeline_ref(struct esh_pipeline *pipe)
+{
+    atomic_fetch_add_explicit(&pipe->refcount, 1, memory_order_relaxed);
+    return pipe;
 }
 
 void
@@ -168,27 +213,83 @@ esh_pipeline_free(struct esh_pipeline *pipe)
 {
     struct list_elem * e = list_begin (&pipe->commands);
 
+    if (atomic_fetch_sub_explicit(&pipe->refcount, 1, memory_order_acq_rel) != 1)
+        return;
+
+    if (pipe->mapped) {
+        /* only what was allocated after loading the script */
+        for (; e != list_end (&pipe->commands); e = list_next(e)) {
+            struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+            if (cmd->subst_arena) {
+                free(cmd->argv);
+                free(cmd->subst_arena);
+            }
+            free(cmd->env);
+        }
+        free(pipe->placement);
+        if (pipe->output)
+            esh_output_close(pipe->output);
+        pipe->output = NULL;
+        if (pipe->vjob)
+            esh_vjob_free(pipe->vjob);
+        pipe->vjob = NULL;
+        return;
+    }
+
     for (; e != list_end (&pipe->commands); ) {
         struct esh_command *cmd = list_entry(e, struct esh_command, elem);
         e = list_remove(e);
         esh_command_free(cmd);
     }
-    free(pipe);
+    free(pipe->placement);
+    if (pipe->output)
+        esh_output_close(pipe->output);
+    if (pipe->vjob)
+        esh_vjob_free(pipe->vjob);
+    esh_slab_free(&pipeline_slab, pipe);
+}
+
+char *
+esh_word_unquote(char *w)
+{
+    char *p = w, *q = w, quote = 0;
+    for (; *p; p++) {
+        if (quote ? *p == quote : *p == '\'' || *p == '"')
+            quote = quote ? 0 : *p;
+        else
+            *q++ = *p;
+    }
+    *q = '\0';
+    return w;
 }
 
 void
 esh_command_free(struct esh_command * cmd)
 {
     char ** p = cmd->argv;
-    while (*p) {
-        free(*p++);
+    char * arena = cmd->subst_arena;
+    for (; *p; p++) {
+        if (arena == NULL || *p < arena || *p >= arena + cmd->subst_arena_size)
+            free(*p);
+    }
+    for (p = cmd->env; p && *p; p++) {
+        if (arena == NULL || *p < arena || *p >= arena + cmd->subst_arena_size)
+            free(*p);
     }
+    free(cmd->env);
+    free(arena);
     if (cmd->iored_input)
         free(cmd->iored_input);
     if (cmd->iored_output)
         free(cmd->iored_output);
+    if (cmd->iored_here)
+        free(cmd->iored_here);
+    if (cmd->here_delim)
+        free(cmd->here_delim);
+    if (cmd->group)
+        esh_command_line_free(cmd->group);
     free(cmd->argv);
-    free(cmd);
+    esh_slab_free(&command_slab, cmd);
 }
 
 #define PSH_MODULE_NAME "esh_module"
@@ -244,9 +345,15 @@ esh_plugin_load_from_directory(char *dirname)
         char modname[PATH_MAX + 1];
         snprintf(modname, sizeof modname, "%s/%s", dirname, dentry->d_name);
 
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
         struct esh_plugin * plugin = load_plugin(modname);
-        if (plugin)
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (plugin) {
             list_push_back(&esh_plugin_list, &plugin->elem);
+            esh_hook_loaded(plugin, modname, (end.tv_sec - start.tv_sec) * 1000000000LL
+                    + end.tv_nsec - start.tv_nsec);
+        }
     }
     closedir(dir);
 }
@@ -261,8 +368,12 @@ esh_plugin_initialize(struct esh_shell *shell)
     struct list_elem * e = list_begin(&esh_plugin_list);
     for (; e != list_end(&esh_plugin_list); e = list_next(e)) {
         struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
-        if (plugin->init)
+        if (plugin->init) {
+            struct esh_hook_timer t;
+            esh_hook_begin(&t);
             plugin->init(shell);
+            esh_hook_end(&t, plugin, ESH_HOOK_INIT);
+        }
     }
 }
 
@@ -0,0 +1,276 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Virtual jobs, run on a pool of worker threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "esh.h"
+#include "esh-vjob.h"
+
+struct esh_vjob {
+    struct list_elem elem;      /* in the run queue */
+    esh_vjob_fn fn;
+    void *arg;
+    FILE *out;                  /* memory stream into 'buf' */
+    char *buf;
+    size_t len;
+
+    /* Requests, set by esh_vjob_signal.  'pending' lets checkpoints
+     * skip the lock while there are none. */
+    atomic_bool pending;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* requests changed, or done */
+    bool stop;
+    int kill;                   /* signal asked to end it, or 0 */
+    bool killed;                /* a checkpoint saw 'kill' */
+    bool done;
+    bool orphaned;              /* freed before it was done */
+    int status;
+};
+
+/* The worker pool, and the jobs waiting for a worker */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static bool pool_ready;         /* queue set up, fork handlers installed */
+static struct list pool_queue;
+static int pool_queued;
+static int pool_size;           /* workers started */
+static int pool_busy;           /* workers running a job */
+
+static void
+vjob_destroy(struct esh_vjob *vjob)
+{
+    pthread_mutex_destroy(&vjob->lock);
+    pthread_cond_destroy(&vjob->cond);
+    free(vjob->buf);
+    free(vjob);
+}
+
+/* Run 'vjob' to the end, unless it is asked to end before it starts */
+static void
+run(struct esh_vjob *vjob)
+{
+    int code = esh_vjob_checkpoint(vjob) ? vjob->fn(vjob, vjob->arg) : 0;
+    fclose(vjob->out);
+
+    pthread_mutex_lock(&vjob->lock);
+    vjob->status = vjob->killed ? vjob->kill : W_EXITCODE(code & 0xff, 0);
+    vjob->done = true;
+    bool orphaned = vjob->orphaned;
+    pthread_cond_broadcast(&vjob->cond);
+    pthread_mutex_unlock(&vjob->lock);
+    if (orphaned)
+        vjob_destroy(vjob);
+}
+
+/* A worker: run queued jobs, forever */
+static void *
+worker(void *arg)
+{
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (list_empty(&pool_queue))
+            pthread_cond_wait(&pool_work, &pool_lock);
+        struct esh_vjob *vjob = list_entry(list_pop_front(&pool_queue),
+                                           struct esh_vjob, elem);
+        pool_queued--;
+        pool_busy++;
+        pthread_mutex_unlock(&pool_lock);
+
+        run(vjob);
+
+        pthread_mutex_lock(&pool_lock);
+        pool_busy--;
+    }
+    return NULL;
+}
+
+/* A child forked while a worker held the lock has no workers, and
+ * none of the parent's jobs */
+static void
+pool_prepare(void)
+{
+    pthread_mutex_lock(&pool_lock);
+}
+
+static void
+pool_parent(void)
+{
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void
+pool_child(void)
+{
+    pthread_mutex_init(&pool_lock, NULL);
+    list_init(&pool_queue);
+    pool_queued = 0;
+    pool_size = pool_busy = 0;
+}
+
+/* Start a worker if every worker has a job and jobs are waiting.
+ * Returns false if none is left to run the queued jobs. */
+static bool
+pool_grow(void)
+{
+    if (pool_size >= pool_busy + pool_queued)
+        return true;
+    if (pool_size == ESH_VJOB_MAX_WORKERS)
+        return true;
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_t t;
+    int err = pthread_create(&t, NULL, worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0)
+        return pool_size > 0;
+    pthread_detach(t);
+    pool_size++;
+    return true;
+}
+
+struct esh_vjob *
+esh_vjob_start(esh_vjob_fn fn, void *arg)
+{
+    struct esh_vjob *vjob = calloc(1, sizeof *vjob);
+    if (vjob == NULL)
+        return NULL;
+    vjob->out = open_memstream(&vjob->buf, &vjob->len);
+    if (vjob->out == NULL) {
+        free(vjob);
+        return NULL;
+    }
+    vjob->fn = fn;
+    vjob->arg = arg;
+    atomic_init(&vjob->pending, false);
+    pthread_mutex_init(&vjob->lock, NULL);
+    pthread_cond_init(&vjob->cond, NULL);
+
+    pthread_mutex_lock(&pool_lock);
+    if (!pool_ready) {
+        list_init(&pool_queue);
+        pthread_atfork(pool_prepare, pool_parent, pool_child);
+        pool_ready = true;
+    }
+    list_push_back(&pool_queue, &vjob->elem);
+    pool_queued++;
+    if (!pool_grow()) {
+        list_remove(&vjob->elem);
+        pool_queued--;
+        pthread_mutex_unlock(&pool_lock);
+        fclose(vjob->out);
+        vjob_destroy(vjob);
+        errno = EAGAIN;
+        return NULL;
+    }
+    pthread_cond_signal(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+    return vjob;
+}
+
+void
+esh_vjob_signal(struct esh_vjob *vjob, int sig)
+{
+    pthread_mutex_lock(&vjob->lock);
+    switch (sig) {
+    case 0:
+        break;
+    case SIGSTOP:
+    case SIGTSTP:
+    case SIGTTIN:
+    case SIGTTOU:
+        vjob->stop = true;
+        break;
+    case SIGCONT:
+        vjob->stop = false;
+        break;
+    default:
+        if (vjob->kill == 0)
+            vjob->kill = sig;
+        break;
+    }
+    atomic_store(&vjob->pending, vjob->stop || vjob->kill != 0);
+    pthread_cond_broadcast(&vjob->cond);
+    pthread_mutex_unlock(&vjob->lock);
+}
+
+bool
+esh_vjob_wait(struct esh_vjob *vjob, int ms)
+{
+    struct timespec until;
+    if (ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += ms / 1000;
+        until.tv_nsec += (ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&vjob->lock);
+    while (!vjob->done) {
+        if (ms < 0)
+            pthread_cond_wait(&vjob->cond, &vjob->lock);
+        else if (pthread_cond_timedwait(&vjob->cond, &vjob->lock, &until) == ETIMEDOUT)
+            break;
+    }
+    bool done = vjob->done;
+    pthread_mutex_unlock(&vjob->lock);
+    return done;
+}
+
+int
+esh_vjob_status(struct esh_vjob *vjob)
+{
+    return vjob->status;
+}
+
+const char *
+esh_vjob_output(struct esh_vjob *vjob, size_t *len)
+{
+    *len = vjob->len;
+    return vjob->buf;
+}
+
+void
+esh_vjob_free(struct esh_vjob *vjob)
+{
+    pthread_mutex_lock(&vjob->lock);
+    bool done = vjob->done;
+    vjob->orphaned = true;
+    pthread_mutex_unlock(&vjob->lock);
+    if (done)
+        vjob_destroy(vjob);
+}
+
+FILE *
+esh_vjob_out(struct esh_vjob *vjob)
+{
+    return vjob->out;
+}
+
+bool
+esh_vjob_checkpoint(struct esh_vjob *vjob)
+{
+    if (!atomic_load_explicit(&vjob->pending, memory_order_relaxed))
+        return true;
+
+    pthread_mutex_lock(&vjob->lock);
+    while (vjob->stop && vjob->kill == 0)
+        pthread_cond_wait(&vjob->cond, &vjob->lock);
+    if (vjob->kill != 0)
+        vjob->killed = true;
+    bool go = !vjob->killed;
+    pthread_mutex_unlock(&vjob->lock);
+    return go;
+}
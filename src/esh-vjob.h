@@ -0,0 +1,57 @@
+/*
+ * esh - the 'extensible' shell.
+ *
+ * Virtual jobs: work run inside the shell, on a pool of worker threads.
+ *
+ * A virtual job is a function, not a process.  The shell lists it as
+ * a job with a jid of its own, and stop, bg, fg and kill act on it,
+ * but cooperatively: they only post a request, which the function
+ * honors at its next esh_vjob_checkpoint.  What the function writes to
+ * esh_vjob_out is kept in memory and reported, with its exit status,
+ * once it is done.
+ *
+ * Workers are started as jobs need them, up to ESH_VJOB_MAX_WORKERS,
+ * and kept for later jobs; they block all signals.  A job that finds
+ * no worker free waits for one.  Everything a job's function uses is
+ * in its struct esh_vjob, so plugins, which link their own copy of
+ * libesh.a, may call the functions for the job's function.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Needs esh.h for esh_vjob_fn */
+
+/* Most worker threads started */
+#define ESH_VJOB_MAX_WORKERS    64
+
+/* Queue fn(vjob, arg) to run on a worker.  Returns NULL, with errno
+ * set, if it cannot be run. */
+struct esh_vjob * esh_vjob_start(esh_vjob_fn fn, void *arg);
+
+/* Ask the job to stop (SIGSTOP, SIGTSTP, SIGTTIN or SIGTTOU), to
+ * continue (SIGCONT) or to end (any other signal but 0) */
+void esh_vjob_signal(struct esh_vjob *vjob, int sig);
+
+/* Wait at most 'ms' milliseconds, or for good if 'ms' is negative,
+ * for the job to be done.  Returns true if it is. */
+bool esh_vjob_wait(struct esh_vjob *vjob, int ms);
+
+/* Once the job is done: its wait status, W_EXITCODE of what its
+ * function returned or the signal that ended it */
+int esh_vjob_status(struct esh_vjob *vjob);
+
+/* Once the job is done: what it wrote, 'len' bytes */
+const char * esh_vjob_output(struct esh_vjob *vjob, size_t *len);
+
+/* Free the job, once it is done, or as soon as it is */
+void esh_vjob_free(struct esh_vjob *vjob);
+
+/* For the job's function: where to write its output */
+FILE * esh_vjob_out(struct esh_vjob *vjob);
+
+/* For the job's function, to call now and then: waits while the job
+ * is stopped, and returns false once it was asked to end, after which
+ * the function should return soon. */
+bool esh_vjob_checkpoint(struct esh_vjob *vjob);
@@ -5,93 +5,49 @@
  * Virginia Tech.
  */
 #include <stdio.h>
+#ifndef ESH_NO_READLINE
 #include <readline/readline.h>
+#endif
 #include <unistd.h>
-#include <fcntl.h>
-#include <wait.h>
 #include <assert.h>
 #include <setjmp.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include "esh.h"
 #include "esh-sys-utils.h"
+#include "esh-script.h"
+#include "esh-lineedit.h"
+#include "esh-hooks.h"
+#include "esh-output.h"
+#include "esh-context.h"
+#include "esh-parse.h"
 
-static struct termios *termi;
 static jmp_buf jump_buf;
-static void change_chld_stat(pid_t chld, int stat);
-int jcount;
+extern struct esh_shell shell;
+/* The shell's process context */
+static struct esh_context *ctx;
 
 static void
 usage(char *progname)
 {
-    printf("Usage: %s -h\n"
+    printf("Usage: %s [options] [script]\n"
         " -h            print this help\n"
-        " -p  plugindir directory from which to load plug-ins\n",
+        " -p  plugindir directory from which to load plug-ins\n"
+        " -j  slots     run at most 'slots' background jobs at a time\n"
+        " -n            headless: do not use the terminal for job control\n"
+        " -g            with -n, still put each job in its own process group\n"
+        " -e            use the built-in line editor instead of readline\n"
+        " -k            check the syntax of 'script' only, on all CPUs\n"
+        " script        run commands from file 'script' instead of stdin\n",
         progname);
 
     exit(EXIT_SUCCESS);
 }
-struct list jobs;
-
-/**
-*This method print the commands in the pipeline
-*/
-static void print_command(struct esh_pipeline *Ljobs) {
-    printf("\n[%d]", Ljobs->jid);
-    if(&Ljobs->elem == list_prev(list_rbegin(&jobs))) {
-        printf("-");
-    }
-    if(&Ljobs->elem == list_rbegin(&jobs)) {
-        printf("+");
-    }
-
-    if(Ljobs->status == BACKGROUND) {
-        printf(" Running\t\t");
-    }
-    if(Ljobs->status == STOPPED) {
-        printf(" Stopped\t\t");
-    }
-    if(Ljobs->status == FOREGROUND) {
-        printf(" Foreground\t\t");
-    }
-    if(Ljobs->status == NEEDSTERMINAL) {
-        printf(" Need Terminal\t\t");
-    }
-
-    printf("(");
-    struct list_elem * e = list_begin (&Ljobs->commands);
-    for (; e != list_end (&Ljobs->commands); e = list_next (e)) {
-        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
-        char **p = cmd->argv;
-        while (*p) {
-            printf("%s", *p);
-            p++;
-            if(*p != NULL) {
-                printf(" ");
-            }
-        }
-        if(e != list_rbegin(&Ljobs->commands)) {
-            printf("|");
-        }
-
-    }
-
-
-    if (Ljobs->bg_job)
-        printf(" &");
-
-    printf(")\n");
-}
-
-static struct esh_pipeline * get_job_from_jid(int jid) {
-	struct list_elem * e = list_begin (&jobs);
-	for (; e != list_end(&jobs); e = list_next(e)) {
-		struct esh_pipeline *job = list_entry(e, struct esh_pipeline, elem);
-		if (job->jid == jid) {
-			return job;
-		}
-	}
-	return NULL;
-}
-
 /* Build a prompt by assembling fragments from loaded plugins that
  * implement 'make_prompt.'
  *
@@ -110,7 +66,10 @@ build_prompt_from_plugins(void)
             continue;
 
         /* append prompt fragment created by plug-in */
+        struct esh_hook_timer t;
+        esh_hook_begin(&t);
         char * p = plugin->make_prompt();
+        esh_hook_end(&t, plugin, ESH_HOOK_PROMPT);
         if (prompt == NULL) {
             prompt = p;
         } else {
@@ -127,6 +86,27 @@ build_prompt_from_plugins(void)
     return prompt;
 }
 
+/* Give plugins a chance to change or consume the raw command line.
+ * Returns true if one of them wants processing to stop. */
+static bool
+plugins_process_raw_cmdline(char **cmdline)
+{
+    struct list_elem * e = list_begin(&esh_plugin_list);
+    for (; e != list_end(&esh_plugin_list); e = list_next(e)) {
+        struct esh_plugin *plugin = list_entry(e, struct esh_plugin, elem);
+        if (plugin->process_raw_cmdline == NULL)
+            continue;
+
+        struct esh_hook_timer t;
+        esh_hook_begin(&t);
+        bool stop = plugin->process_raw_cmdline(cmdline);
+        esh_hook_end(&t, plugin, ESH_HOOK_RAW_CMDLINE);
+        if (stop)
+            return true;
+    }
+    return false;
+}
+
 /** Handles a SIGTTOU signal.
 static void
 handle_sigttou(int signal, siginfo_t *sig_inf, void *p) {
@@ -137,31 +117,84 @@ handle_sigttou(int signal, siginfo_t *sig_inf, void *p) {
     }
 }*/
 
-/*
- * SIGCHLD handler.
- * Call waitpid() to learn about any child processes that
- * have exited or changed status (been stopped, needed the
- * terminal, etc.)
- * Just record the information by updating the job list
- * data structures.  Since the call may be spurious (e.g.
- * already pending SIGCHLD is delivered even though
- * a foreground process was already reaped), ignore when
- * waitpid returns -1.
- * Use a loop with WNOHANG since only a single SIGCHLD
- * signal may be delivered for multiple children that have
- * exited.
- */
-static void
-sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
+/* Parse all lines of file 'path' in parallel and print where they
+ * have errors.  Returns the exit status for 'esh -k'. */
+static int
+check_syntax(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        esh_sys_error("esh: %s: ", path);
+        return EXIT_FAILURE;
+    }
+
+    char *text = st.st_size > 0
+               ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (text == MAP_FAILED) {
+        esh_sys_error("esh: %s: mmap: ", path);
+        return EXIT_FAILURE;
+    }
+
+    struct esh_parse_batch batch;
+    if (esh_parse_batch(text, st.st_size, 0, 0, &batch) < 0) {
+        esh_sys_error("esh: %s: ", path);
+        return EXIT_FAILURE;
+    }
+    size_t i;
+    for (i = 0; i < batch.nerrors; i++) {
+        struct esh_parse_error *e = &batch.errors[i];
+        printf("%s:%zu:%d: %s\n", path, e->line, e->column + 1, e->msg);
+    }
+    int status = batch.nerrors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    esh_parse_batch_free(&batch);
+    if (st.st_size > 0)
+        munmap(text, st.st_size);
+    return status;
+}
+
+/* Number of status changes dropped before reaching plugins */
+static unsigned long
+dropped_status_events(void)
 {
-    pid_t child;
-    int status;
+    return esh_context_dropped_events(ctx);
+}
 
-    assert(sig == SIGCHLD);
+/* Run plugin work as a virtual job of the shell */
+static int
+submit_job(struct esh_command *cmd, esh_vjob_fn fn, void *arg)
+{
+    return esh_context_submit(ctx, cmd->pipeline, fn, arg);
+}
 
-    while ((child = waitpid(-1, &status, WUNTRACED|WNOHANG)) > 0) {
-        change_chld_stat(child, status);
+/* Called by the line editor while it waits for input.  Streamed job
+ * output and the results of virtual jobs are written above the line
+ * being edited; returns non-zero if the line must be redrawn. */
+static int
+deliver_events_hook(void)
+{
+    bool report = esh_context_vjobs_done(ctx);
+    if (!report) {
+        esh_context_poll(ctx);
+        if (!esh_output_stream_pending())
+            return 0;
     }
+#ifndef ESH_NO_READLINE
+    if (shell.readline == readline) {
+        rl_clear_visible_line();
+        if (report)
+            esh_context_poll(ctx);
+        esh_output_stream();
+        rl_forced_update_display();
+        return 0;
+    }
+#endif
+    printf("\r\x1b[K");
+    if (report)
+        esh_context_poll(ctx);
+    esh_output_stream();
+    return 1;
 }
 
 /** Handles a SIGTSTP signal. */
@@ -187,290 +220,125 @@ handle_sigint(int signal, siginfo_t *sig_inf, void *p) {
 struct esh_shell shell =
 {
     .build_prompt = build_prompt_from_plugins,
+#ifndef ESH_NO_READLINE
     .readline = readline,       /* GNU readline(3) */
-    .parse_command_line = esh_parse_command_line /* Default parser */
+#else
+    .readline = esh_lineedit_readline,
+#endif
+    .parse_command_line = esh_parse_command_line, /* Default parser */
+    .dropped_status_events = dropped_status_events,
+    .submit_job = submit_job
 };
 
 
-static struct esh_command * get_command_from_pid(pid_t pid) {
-    struct list_elem * e = list_begin(&jobs);
-	for (; e != list_end(&jobs); e = list_next(e)) {
-		struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
-		struct list_elem *c = list_begin(&pipe->commands);
-		for (; c != list_end(&pipe->commands); c = list_next(c)) {
-			struct esh_command *command = list_entry(c, struct esh_command, elem);
-			if (command->pid == pid) {
-			return command;
-		}
-		}
-	}
-	return NULL;
-}
-
-/**
- * Assign ownership of ther terminal to process group
- * pgrp, restoring its terminal state if provided.
- *
- * Before printing a new prompt, the shell should
- * invoke this function with its own process group
- * id (obtained on startup via getpgrp()) and a
- * sane terminal state (obtained on startup via
- * esh_sys_tty_init()).
- */
+/* Read the bodies of pending here-documents in 'cline' from the
+ * shell's input, one line at a time up to the delimiter line.
+ * Bodies are kept in memory and written into a memfd at launch. */
 static void
-give_terminal_to(pid_t pgrp, struct termios *pg_tty_state)
+read_here_documents(struct esh_command_line *cline)
 {
-    esh_signal_block(SIGTTOU);
-    int rc = tcsetpgrp(esh_sys_tty_getfd(), pgrp);
-    if (rc == -1)
-        esh_sys_fatal_error("tcsetpgrp: ");
-
-    if (pg_tty_state)
-        esh_sys_tty_restore(pg_tty_state);
-    esh_signal_unblock(SIGTTOU);
-}
-
-/* You may use this code in your shell without attribution. */
-static void change_chld_stat(pid_t chld, int stat) {
-	assert(chld > 0);
-	struct esh_command *cmd = get_command_from_pid(chld);
-	if (cmd == NULL) {
-		printf("no such job\n");
-		//give_terminal_to(getpgrp(), termi);
-
-		return;
-	}
-	struct esh_pipeline * chld_pipe = cmd->pipeline;
-	if (WIFEXITED(stat)) {
-		chld_pipe->status = BACKGROUND;
-		if (&cmd->elem == list_rbegin(&chld_pipe->commands)) {
-			list_remove(&chld_pipe->elem);
-			give_terminal_to(getpgrp(), termi);
-		}
-	}
-	if(WIFSIGNALED(stat)) {
-        if(WTERMSIG(stat) == 9) {
-            list_remove(&chld_pipe->elem);
-        }
-        else {
-            chld_pipe->status = BACKGROUND;
-            list_remove(&chld_pipe->elem);
-            give_terminal_to(getpgrp(), termi);
-        }
-
-	}
-	if (WIFSTOPPED(stat)) {
-		if (WSTOPSIG(stat) == 19) {
-			printf("19\n");
-			chld_pipe->status = STOPPED;
-		}
-		else {
-			chld_pipe->status = STOPPED;
-			print_command(chld_pipe);
-			give_terminal_to(getpgrp(), termi);
-		}
-	}
-
-	if (list_empty(&jobs)) {
-		jcount = 0;
-	}
+    struct list_elem * e = list_begin(&cline->pipes);
+    for (; e != list_end(&cline->pipes); e = list_next(e)) {
+        struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
+        struct list_elem * c = list_begin(&pipe->commands);
+        for (; c != list_end(&pipe->commands); c = list_next(c)) {
+            struct esh_command *cmd = list_entry(c, struct esh_command, elem);
+            if (cmd->group != NULL)
+                read_here_documents(cmd->group);
+            if (cmd->here_delim == NULL)
+                continue;
+
+            size_t len = 0, cap = 64;
+            char *body = malloc(cap);
+            body[0] = '\0';
+            for (;;) {
+                char * line = shell.readline(isatty(0) ? "> " : NULL);
+                if (line == NULL) {
+                    fprintf(stderr, "esh: here-document delimited by "
+                            "end-of-file (wanted '%s')\n", cmd->here_delim);
+                    break;
+                }
+                if (strcmp(line, cmd->here_delim) == 0) {
+                    free(line);
+                    break;
+                }
+
+                size_t n = strlen(line);
+                while (len + n + 2 > cap)
+                    body = realloc(body, cap *= 2);
+                memcpy(body + len, line, n);
+                len += n;
+                body[len++] = '\n';
+                body[len] = '\0';
+                free(line);
+            }
+            cmd->iored_here = body;
+            free(cmd->here_delim);
+            cmd->here_delim = NULL;
+        }
+    }
 }
 
-static void job_wait(struct esh_pipeline *job) {
-	assert(esh_signal_is_blocked(SIGCHLD));
-
-	while (job->status == FOREGROUND &&  !list_empty(&job->commands)) {
-		int stat;
-		pid_t chld = waitpid(-1, &stat, WUNTRACED);
-//printf("chld: %d\ncaller: %d\nstat: %d\n", chld, getpid(), stat);
-		if (chld != -1) {
-			change_chld_stat(chld, stat);
-		}
-	}
+/* True if the shell's input has no more lines, so that the line just
+ * read is its last.  Only for input that is not a terminal, read by
+ * readline or the line editor, neither of which has buffered more;
+ * a pipe counts once its writer has closed it. */
+static bool
+input_exhausted(void)
+{
+    int avail;
+    struct stat st;
+
+    if (isatty(0) || esh_lineedit_buffered() > 0)
+        return false;
+#ifndef ESH_NO_READLINE
+    if (shell.readline != readline && shell.readline != esh_lineedit_readline)
+        return false;
+#else
+    if (shell.readline != esh_lineedit_readline)
+        return false;
+#endif
+    if (ioctl(0, FIONREAD, &avail) < 0 || avail > 0 || fstat(0, &st) < 0)
+        return false;
+    if (S_ISREG(st.st_mode))
+        return true;
+
+    struct pollfd p = { .fd = 0, .events = POLLIN };
+    return S_ISFIFO(st.st_mode) && poll(&p, 1, 0) == 1
+        && (p.revents & (POLLHUP | POLLIN)) == POLLHUP;
 }
 
-/** processes the builtin commands, or returns false if input is not builtin */
-static bool Process(char** argv) {
-	if(strcmp(argv[0], "kill") == 0) {
-		//printf("Kill: %s\n", argv[1]);
-		if(argv[1] == NULL) {
-            printf("kill: usage: kill");
-		}
-		struct esh_pipeline *job = get_job_from_jid(atoi(argv[1]));
-		if( job != NULL) {
-            if (kill(job->pgrp, SIGKILL) < 0) {
-                esh_sys_fatal_error("-bash: kill: (%s) - Operation not permitted\n", argv[1]);
-            }
-		}
-		else {
-             esh_sys_fatal_error("-bash: kill: (%s) - Operation not permitted\n", argv[1]);
-		}
-
-		return true;
-	}
-
-	else if (strcmp(argv[0], "jobs") == 0) {
-		struct list_elem * j = list_begin(&jobs);
-
-		for(; j != list_end(&jobs); j = list_next(j)){
-			struct esh_pipeline *Ljobs = list_entry(j, struct esh_pipeline, elem);
-			print_command(Ljobs);
-		}
-		return true;
-	}
-	else if (strcmp(argv[0], "bg") == 0) {
-		if (!list_empty(&jobs)) {
-			if (argv[1] == NULL) {
-				struct list_elem * j = list_rbegin(&jobs);
-				struct esh_pipeline *job = list_entry(j, struct esh_pipeline, elem);
-				job->status = BACKGROUND;
-				printf("[%d]+", job->jid);
-				esh_pipeline_print(job);
-				printf("\n");
-				if (kill(job->pgrp, SIGCONT) < 0) {
-					esh_sys_fatal_error("bg: kill failed\n");
-				}
-			}
-			else {
-				struct list_elem * j = list_begin(&jobs);
-				struct esh_pipeline *job;
-				int jid = atoi(argv[1]);
-				int found = 0;
-				for (; j != list_end(&jobs); j = list_next(j)) {
-					job = list_entry(j, struct esh_pipeline, elem);
-					if (job->jid == jid) {
-						found++;
-						break;
-					}
-				}
-				if (!found) {
-					//Job not there
-					printf("bg: %d: no such job\n", jid);
-				}
-				else {
-					job->status = BACKGROUND;
-					printf("[%d]+", job->jid);
-					esh_pipeline_print(job);
-					printf("\n");
-					if (kill(job->pgrp, SIGCONT) < 0) {
-						esh_sys_fatal_error("bg: kill failed\n");
-					}
-				}
-			}
-		}
-		else {
-			printf("-bash: bg: current: no such job\n");
-		}
-		return true;
-	}
-	else if (strcmp(argv[0], "fg") == 0) {
-		if (argv[1] == NULL) {
-			struct list_elem * j = list_rbegin(&jobs);
-			struct esh_pipeline *job = list_entry(j, struct esh_pipeline, elem);
-			if(list_empty(&jobs)) {
-				printf("-bash: fg: current: no such job\n");
-			}
-			else {
-				esh_signal_block(SIGCHLD);
-				job->status = FOREGROUND;
-				print_command(job);
-				give_terminal_to(job->pgrp, termi);
-				if (kill(job->pgrp, SIGCONT) < 0) {
-					esh_sys_fatal_error("bg: kill failed\n");
-				}
-				job_wait(job);
-
-				//list_remove(&job->elem);
-				esh_signal_unblock(SIGCHLD);
-			}
-
-		}
-		else {
-			struct list_elem * j = list_begin(&jobs);
-			struct esh_pipeline *job;
-			int jid = atoi(argv[1]);
-			int found = 0;
-			for (; j != list_end(&jobs); j = list_next(j)) {
-				job = list_entry(j, struct esh_pipeline, elem);
-				if (job->jid == jid) {
-					found++;
-					break;
-				}
-			}
-			if (!found) {
-				//Job not there
-				printf("bg: %d: no such job\n", jid);
-			}
-			else {
-				//list_remove(&job->elem);
-
-				esh_signal_block(SIGCHLD);
-				job->status = FOREGROUND;
-				print_command(job);
-				give_terminal_to(job->pgrp, termi);
-				if (kill(job->pgrp, SIGCONT) < 0) {
-					esh_sys_fatal_error("bg: kill failed\n");
-				}
-				job_wait(job);
-				esh_signal_unblock(SIGCHLD);
-			}
-		}
-		return true;
-	}
-	else if (strcmp(argv[0], "stop") == 0) {
-		if (argv[1] == NULL) {
-			printf("usage: stop [jid]\n");
-		}
-		else {
-			struct list_elem *j = list_begin(&jobs);
-			struct esh_pipeline *job;
-			for (; j != list_end(&jobs); j = list_next(j)) {
-				job = list_entry(j, struct esh_pipeline, elem);
-				if (job->jid == atoi(argv[1])) {
-					break;
-				}
-			}
-			kill(job->pgrp, SIGSTOP);
-		}
-		return true;
-	}
-	/* exit the shell */
-	else if (strcmp(argv[0], "exit") == 0) {
-		exit(EXIT_SUCCESS);
-	}
-	else {
-		return false;
-	}
+/* Exit status of a shell whose last command ended with 'waitstatus' */
+static int
+exit_status(int waitstatus)
+{
+    if (WIFSIGNALED(waitstatus))
+        return 128 + WTERMSIG(waitstatus);
+    return WEXITSTATUS(waitstatus);
 }
 
-
-
-/**
-static struct esh_pipeline * get_job_from_pgrp(pid_t pgrp) {
-	struct list_elem * e = list_begin(&jobs);
-	for (; e != list_end(&jobs); e = list_next(e)) {
-		struct esh_pipeline *pipe = list_entry(e, struct esh_pipeline, elem);
-		if (pipe->pgrp == pgrp) {
-			return pipe;
-		}
-	}
-	return NULL;
-}*/
-
-
-
 int
 main(int ac, char *av[])
 {
     esh_signal_sethandler(SIGTSTP, handle_sigtstp);
     esh_signal_sethandler(SIGINT, handle_sigint);
     int opt;
-    jcount = 0;
+    volatile int status = 0;       /* of the last command; kept across longjmp */
+    int flags = ESH_CONTEXT_PROCESS, job_slots = 0;
+    bool check = false;
+    struct esh_script *script = NULL;
     list_init(&esh_plugin_list);
-    list_init(&jobs);
-    termi = esh_sys_tty_init();
+#ifndef ESH_NO_READLINE
+    /* the environment store owns 'environ'; keep readline out of it */
+    rl_change_environment = 0;
+    /* deliver status changes of background jobs while idle at the prompt;
+     * with a hook, readline spins at end of file on non-terminal input */
+    if (isatty(0))
+        rl_event_hook = deliver_events_hook;
+#endif
+    esh_lineedit_idle_hook = deliver_events_hook;
     /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "hp:")) > 0) {
+    while ((opt = getopt(ac, av, "hp:j:ngek")) > 0) {
         switch (opt) {
         case 'h':
             usage(av[0]);
@@ -479,161 +347,96 @@ main(int ac, char *av[])
         case 'p':
             esh_plugin_load_from_directory(optarg);
             break;
+
+        case 'j':
+            job_slots = atoi(optarg) > 0 ? atoi(optarg) : 0;
+            break;
+
+        case 'n':
+            flags |= ESH_CONTEXT_HEADLESS;
+            break;
+
+        case 'g':
+            flags |= ESH_CONTEXT_PGRPS;
+            break;
+
+        case 'e':
+            shell.readline = esh_lineedit_readline;
+            break;
+
+        case 'k':
+            check = true;
+            break;
         }
     }
 
+    if (check) {
+        if (optind >= ac)
+            usage(av[0]);
+        exit(check_syntax(av[optind]));
+    }
+
+    ctx = esh_context_create(flags);
+    if (ctx == NULL)
+        esh_sys_fatal_error("esh: cannot create context: ");
+    esh_context_set_job_slots(ctx, job_slots);
     esh_plugin_initialize(&shell);
+    esh_context_set_parser(ctx, shell.parse_command_line);
+
+    if (optind < ac) {
+        script = esh_script_open(av[optind], shell.parse_command_line);
+        if (script == NULL)
+            exit(EXIT_FAILURE);
+    }
     setjmp(jump_buf);
 
     /* Read/eval loop. */
     for (;;) {
-        /* Do not output a prompt unless shell's stdin is a terminal */
-        char * prompt = isatty(0) ? shell.build_prompt() : NULL;
-        char * cmdline = shell.readline(prompt);
-        free (prompt);
-
-        if (cmdline == NULL)  /* User typed EOF */
-            break;
-
-        struct esh_command_line * cline = shell.parse_command_line(cmdline);
-        free (cmdline);
-        if (cline == NULL)                  /* Error in command line */
-            continue;
+        struct esh_command_line * cline;
+        esh_context_poll(ctx);
+        esh_output_stream();
+        if (script != NULL) {
+            /* Already parsed, straight from the script's cache */
+            cline = esh_script_next(script);
+            if (cline == NULL)
+                break;
+        } else {
+            /* Do not output a prompt unless shell's stdin is a terminal */
+            char * prompt = isatty(0) ? shell.build_prompt() : NULL;
+            char * cmdline = shell.readline(prompt);
+            free (prompt);
+
+            if (cmdline == NULL)  /* User typed EOF */
+                break;
+
+            if (plugins_process_raw_cmdline(&cmdline)) {
+                free (cmdline);
+                continue;
+            }
+
+            cline = shell.parse_command_line(cmdline);
+            free (cmdline);
+            if (cline == NULL)                  /* Error in command line */
+                continue;
+        }
 
         if (list_empty(&cline->pipes)) {    /* User hit enter */
             esh_command_line_free(cline);
             continue;
         }
 
-	struct list_elem *pipe_chld;
-	int proc_pipe[2], io_pipe[2];
-	struct list_elem * e = list_begin(&cline->pipes);
-	for (; e != list_end(&cline->pipes); e = list_next(e)) {
-		struct esh_pipeline *_pipe = list_entry(e, struct esh_pipeline, elem);
-		struct list_elem *c = list_begin(&_pipe->commands);
-		for (; c != list_end(&_pipe->commands); c = list_next(c)) {
-			struct esh_command *command = list_entry(c, struct esh_command, elem);
-			if (!Process(command->argv)) {
-				esh_signal_sethandler(SIGCHLD, sigchld_handler);
-				esh_signal_unblock(SIGCHLD);
-				if (c == list_begin(&_pipe->commands)) {
-					jcount++;
-					_pipe->jid = jcount;
-					e = list_rend(&cline->pipes);
-					pipe_chld = list_pop_front(&cline->pipes);
-					list_push_back(&jobs, pipe_chld);
-				}
-				if (list_size(&_pipe->commands) > 1 && c != list_rbegin(&_pipe->commands)) {
-					pipe(proc_pipe);
-				}
-				esh_signal_block(SIGCHLD);
-
-				pid_t fork_pid = fork();
-
-				if (fork_pid < 0) {
-					//error
-					esh_sys_fatal_error("execute: fork failed");
-				}
-				else if (fork_pid == 0) {
-					//child  process
-					fork_pid = getpid();
-					if (c == list_begin(&_pipe->commands)) {
-						_pipe->pgrp = fork_pid;
-					}
-					setpgid(fork_pid, _pipe->pgrp);
-					command->pid = fork_pid;
-
-					if (list_size(&_pipe->commands) > 1 && c != list_rbegin(&_pipe->commands)) {
-						close(proc_pipe[0]);
-						dup2(proc_pipe[1], 1);
-						close(proc_pipe[1]);
-					}
-					if (list_size(&_pipe->commands) > 1 && c != list_begin(&_pipe->commands)) {
-						close(io_pipe[1]);
-						dup2(io_pipe[0], 0);
-						close(io_pipe[0]);
-					}
-					if (command->iored_input != NULL) {
-						int input = open(command->iored_input, O_RDONLY);
-						if (input < 0) {
-							esh_sys_fatal_error("execute: open failed\n");
-						}
-						if (dup2(input, 0) < 0) {
-							esh_sys_fatal_error("execute: dup2 failed\n");
-						}
-						close(input);
-					}
-					if (command->iored_output != NULL) {
-						int output;
-						if (command->append_to_output) {
-							if ((output = open(command->iored_output, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) < 0) {
-								esh_sys_fatal_error("execute: open failed\n");
-							}
-						} else {
-							if ((output = open(command->iored_output, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) < 0) {
-								esh_sys_fatal_error("execute: open failed\n");
-							}
-						}
-						if (dup2(output, 1) < 0) {
-							esh_sys_fatal_error("execute: dup2 failed\n");
-						}
-						close(output);
-					}
-					if (_pipe->bg_job) {
-						_pipe->status = BACKGROUND;
-					}
-					else {
-						_pipe->status = FOREGROUND;
-						give_terminal_to(_pipe->pgrp, termi);
-					}
-
-					if (execvp(command->argv[0], command->argv) < 0) {
-						esh_sys_fatal_error("%s: command not found\n", command->argv[0]);
-					}
-				}
-				else if (fork_pid > 0) {
-					//parent process
-					if (c == list_begin(&_pipe->commands)) {
-						_pipe->pgrp = fork_pid;
-					}
-
-					command->pid = fork_pid;
-					setpgid(fork_pid, _pipe->pgrp);
-
-					if (list_size(&_pipe->commands) > 1 && c == list_begin(&_pipe->commands)) {
-						io_pipe[0] = proc_pipe[0];
-						io_pipe[1] = proc_pipe[1];
-					}
-					if (list_size(&_pipe->commands) > 1 && c == list_rbegin(&_pipe->commands)) {
-						close(proc_pipe[0]);
-						close(proc_pipe[1]);
-						close(io_pipe[0]);
-						close(io_pipe[1]);
-					}
-					if (list_size(&_pipe->commands) > 1 && c != list_rbegin(&_pipe->commands) && c != list_begin(&_pipe->commands)) {
-						close(io_pipe[0]);
-						close(io_pipe[1]);
-						io_pipe[0] = proc_pipe[0];
-						io_pipe[1] = proc_pipe[1];
-					}
-
-					if (_pipe->bg_job) {
-						_pipe->status = BACKGROUND;
-						printf("[%d] %d\n", _pipe->jid, _pipe->pgrp);
-					}
-					if (c == list_rbegin(&_pipe->commands) && !_pipe->bg_job) {
-						_pipe->status = FOREGROUND;
-						job_wait(_pipe);
-						give_terminal_to(getpgrp(), termi);
-					}
-				}
-
-				esh_signal_unblock(SIGCHLD);
-			}
-		}
-	}
+        read_here_documents(cline);
 
+        /* The last command of the input may run in place of the shell */
+        if (script != NULL ? esh_script_at_end(script) : input_exhausted())
+            status = esh_context_run_last(ctx, cline);
+        else
+            status = esh_context_run(ctx, cline);
         esh_command_line_free(cline);
+
+        int exit_with;
+        if (esh_context_exited(ctx, &exit_with))
+            exit(exit_with);
     }
-    return 0;
+    return exit_status(status);
 }
@@ -8,7 +8,9 @@
  */
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <obstack.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <termios.h>
 #include "list.h"
@@ -17,6 +19,13 @@
 struct esh_command;
 struct esh_pipeline;
 struct esh_command_line;
+struct esh_placement;
+struct esh_status_event;
+struct esh_vjob;
+
+/* The work of a virtual job (see esh-vjob.h), run on a worker thread.
+ * Returns the job's exit status. */
+typedef int (*esh_vjob_fn)(struct esh_vjob *vjob, void *arg);
 
 /*
  * A esh_shell object allows plugins to access services and information. 
@@ -44,6 +53,16 @@ struct esh_shell {
 
     /* Parse command line */
     struct esh_command_line * (* parse_command_line) (char *);
+
+    /* Number of status changes dropped before reaching plugins */
+    unsigned long (* dropped_status_events) (void);
+
+    /* Run 'fn(vjob, arg)' on a worker thread as a virtual job for the
+     * pipeline of 'cmd', typically from process_builtin.  Run with &,
+     * it is listed by jobs and the shell goes on; otherwise the shell
+     * waits for it, and ^C and ^Z end or stop it.  Returns its jid,
+     * or -1 if it could not be started. */
+    int (* submit_job) (struct esh_command *cmd, esh_vjob_fn fn, void *arg);
 };
 
 /* 
@@ -95,18 +114,31 @@ struct esh_plugin {
     /* Notify the plugin about a child's status change.
      * 'waitstatus' is the value returned by waitpid(2) 
      *
-     * May be called from SIGCHLD handler.
-     * The status of the associated pipeline has not yet been
+     * Called from the main loop, in the order children were reaped;
+     * the status of the associated pipeline may already have been
      * updated.
      * */
     bool (* command_status_change)(struct esh_command *, int waitstatus);
 
     /* Add additional fields here if needed. */
+
+    /* Notify the plugin about 'n' status changes at once.
+     * If set, it is called instead of command_status_change.
+     * Called from the main loop, never from a signal handler. */
+    void (* command_status_batch)(struct esh_status_event *events, size_t n);
+};
+
+/* A child status change, as delivered to plugins */
+struct esh_status_event {
+    struct esh_command *cmd;    /* The command whose process changed */
+    int waitstatus;             /* As returned by waitpid(2) */
 };
 
 /* A command line may contain multiple pipelines. */
 struct esh_command_line {
     struct list/* <esh_pipeline> */ pipes;        /* List of pipelines */
+    bool mapped;             /* True if part of a mapped script cache;
+                                not to be freed. */
 
     /* Add additional fields here if needed. */
 };
@@ -118,6 +150,16 @@ enum job_status  {
     STOPPED,        /* job is stopped via SIGSTOP */
     NEEDSTERMINAL,  /* job is stopped because it was a background job
                        and requires exclusive terminal access */
+    QUEUED,         /* job is a background job waiting for a free
+                       job slot; it has not been forked yet */
+};
+
+/* A scheduling class: CPU policy, nice value and I/O priority class
+ * (see esh-sched.h) */
+struct esh_sched_class {
+    int policy;         /* SCHED_OTHER, SCHED_BATCH or SCHED_IDLE */
+    int nice;           /* nice value, 0 to leave unchanged */
+    int ioclass;        /* IOPRIO_CLASS_NONE, _BE or _IDLE */
 };
 
 /* A pipeline is a list of one or more commands. 
@@ -138,6 +180,26 @@ struct esh_pipeline {
     enum job_status status;  /* Job status. */ 
     struct termios saved_tty_state;  /* The state of the terminal when this job was 
                                         stopped after having been in foreground */
+    struct esh_placement *placement; /* If non-NULL, CPU/NUMA placement of all
+                                        commands, requested with 'on' */
+    bool mapped;             /* True if this pipeline and its commands are
+                                part of a mapped script cache; only the
+                                placement is to be freed. */
+    atomic_int refcount;     /* References held: one by whoever created it
+                                (the jobs list, once launched), one per
+                                queued status event, and any taken by plugins
+                                with esh_pipeline_ref.  Freed when it drops
+                                to zero. */
+    struct esh_output *output;   /* If non-NULL, capture of the output of this
+                                    background job (see esh-output.h) */
+    int waitstatus;          /* Wait status of the last command, once it
+                                exited or stopped */
+    struct esh_vjob *vjob;   /* If non-NULL, this is a virtual job: it runs
+                                on a worker thread of the shell and has no
+                                processes (see esh-vjob.h) */
+    struct esh_sched_class sched;  /* Class the processes of this job were
+                                      last put into; normal unless they
+                                      are in the background class */
 
     /* Add additional fields here if needed. */
 };
@@ -151,9 +213,31 @@ struct esh_command {
     char *iored_output;      /* If non-NULL, command should write to
                                 file 'iored_output' */
     bool append_to_output;   /* True if user typed >> to append */
+    char *iored_here;        /* If non-NULL, command should read the body
+                                of a here-document (<<) or here-string (<<<) */
+    char *here_delim;        /* If non-NULL, delimiter of a here-document
+                                whose body has not been read yet */
+    bool has_subst;          /* True if some argv words are $(...) command
+                                substitutions not yet expanded */
+    char *subst_arena;       /* If non-NULL, buffer holding the output of
+                                expanded substitutions and globs; argv
+                                words that point into it are freed along
+                                with it */
+    size_t subst_arena_size;
+    char **env;              /* If non-NULL, NULL terminated VAR=value
+                                words that apply to this command only */
+    int batch;               /* If > 0, split argv into invocations that
+                                fit ARG_MAX, 'batch' running at a time */
+    struct esh_command_line *group;
+                             /* If non-NULL, this command is a group
+                                { list; } or, if 'subshell', ( list ),
+                                that runs these pipelines; argv is just
+                                "{" or "(" */
+    bool subshell;           /* True if the group runs in a forked shell */
     struct list_elem elem;   /* Link element to link commands in pipeline. */
 
     pid_t   pid;             /* Process id. */
+    bool exited;             /* True once the process has been reaped */
     struct esh_pipeline * pipeline; 
                               /* The pipeline of which this job is a part. */
 
@@ -181,19 +265,46 @@ struct esh_command_line * esh_command_line_create_empty(void);
 /* Create a command line with a single pipeline */
 struct esh_command_line * esh_command_line_create(struct esh_pipeline *pipe);
 
-/* Deallocation functions */
+/* Take a reference to a pipeline; a plugin that keeps a pointer to a
+ * job beyond the hook call must do so, and drop it with
+ * esh_pipeline_free.  Returns pipe. */
+struct esh_pipeline * esh_pipeline_ref(struct esh_pipeline *pipe);
+
+/* Deallocation functions.
+ * esh_pipeline_free drops a reference and frees the pipeline with its
+ * commands when it was the last one. */
 void esh_command_line_free(struct esh_command_line *);
 void esh_pipeline_free(struct esh_pipeline *);
 void esh_command_free(struct esh_command *);
 
+/* Remove the quotes from word 'w', in place: what is between '...' or
+ * "..." is taken as it is.  Returns w. */
+char * esh_word_unquote(char *w);
+
 /* Print functions */
-void esh_command_print(struct esh_command *cmd);
-void esh_pipeline_print(struct esh_pipeline *pipe);
-void esh_command_line_print(struct esh_command_line *line);
+void esh_command_print(FILE *out, struct esh_command *cmd);
+void esh_pipeline_print(FILE *out, struct esh_pipeline *pipe);
+void esh_command_line_print(FILE *out, struct esh_command_line *line);
 
-/* Parse a command line.  Implemented in esh-grammar.y */
+/* Parse a command line.  Implemented in esh-grammar.y
+ * Prints a message to stderr on error.  Safe to call from several
+ * threads; each uses a parser of its own. */
 struct esh_command_line * esh_parse_command_line(char * line);
 
+/* A reentrant parser, with its own scanner state.  Use one per thread. */
+struct esh_parser;
+struct esh_parser * esh_parser_create(void);
+void esh_parser_destroy(struct esh_parser *parser);
+
+/* Parse a command line with 'parser'.  Returns NULL on error, without
+ * printing anything; esh_parser_error tells what went wrong. */
+struct esh_command_line * esh_parse_command_line_r(struct esh_parser *parser,
+                                                   const char *line);
+
+/* Message for the last failed parse, and the offset in the line of the
+ * token where it was found in *column (-1 if unknown) */
+const char * esh_parser_error(struct esh_parser *parser, int *column);
+
 /* Load plugins from directory dir */
 void esh_plugin_load_from_directory(char *dirname);
 
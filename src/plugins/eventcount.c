@@ -0,0 +1,166 @@
+/*
+ * A plug-in that counts child status events, for events_test.py.
+ *
+ * It notes the pid of every process forked, and takes status events
+ * in batches through command_status_batch.  'evcount' prints how many
+ * processes were forked, how many of them had events, how many had
+ * more than one, how many events were for processes it did not see
+ * forked or for 'false' (which eventfilter hides), the largest batch
+ * and the events the shell dropped.
+ *
+ * 'evburst' kills the processes it followed that have not exited and
+ * waits until all are dead.  It runs in the shell's main loop, which
+ * delivers no events meanwhile, so their exits arrive at once.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "../esh.h"
+
+/* Processes followed; more are counted as 'lost' */
+#define MAX_PIDS    8192
+
+static struct esh_shell *shell;
+
+static struct {
+    pid_t pid;
+    unsigned long events;
+    bool killed;                /* by evburst */
+} pids[MAX_PIDS];
+static int npids;
+static unsigned long lost, unknown, hidden_seen;
+static size_t max_batch;
+
+static bool
+init_plugin(struct esh_shell *esh)
+{
+    shell = esh;
+    printf("Plugin 'eventcount' initialized...\n");
+    return true;
+}
+
+static void
+note_forked(struct esh_pipeline *pipe)
+{
+    struct list_elem * e = list_begin(&pipe->commands);
+    for (; e != list_end(&pipe->commands); e = list_next(e)) {
+        struct esh_command *cmd = list_entry(e, struct esh_command, elem);
+        if (npids == MAX_PIDS) {
+            lost++;
+            continue;
+        }
+        pids[npids].pid = cmd->pid;
+        pids[npids].events = 0;
+        pids[npids++].killed = false;
+    }
+}
+
+static void
+count_events(struct esh_status_event *events, size_t n)
+{
+    size_t i;
+    int k;
+
+    if (n > max_batch)
+        max_batch = n;
+    for (i = 0; i < n; i++) {
+        if (strcmp(events[i].cmd->argv[0], "false") == 0)
+            hidden_seen++;
+        for (k = npids - 1; k >= 0 && pids[k].pid != events[i].cmd->pid; k--)
+            ;
+        if (k < 0)
+            unknown++;
+        else
+            pids[k].events++;
+    }
+}
+
+/* State of process 'pid' from /proc, and its parent; 0 if it is gone */
+static char
+proc_state(pid_t pid, pid_t *ppid)
+{
+    char path[64], state = 0;
+    int parent = 0;
+    snprintf(path, sizeof path, "/proc/%d/stat", (int) pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+    /* state and parent follow the command name, in parentheses */
+    char buf[512];
+    size_t n = fread(buf, 1, sizeof buf - 1, f);
+    buf[n] = '\0';
+    char *p = strrchr(buf, ')');
+    if (p == NULL || sscanf(p + 1, " %c %d", &state, &parent) != 2)
+        state = 0;
+    fclose(f);
+    *ppid = parent;
+    return state;
+}
+
+/* Kill the processes of jobs that have not exited, and wait until
+ * they are dead */
+static void
+burst(void)
+{
+    int k, killed = 0, tries;
+    pid_t ppid;
+
+    for (k = 0; k < npids; k++) {
+        /* only children of the shell: pids are reused */
+        char state = proc_state(pids[k].pid, &ppid);
+        if (pids[k].events == 0 && state != 0 && state != 'Z' && ppid == getpid()
+                && kill(pids[k].pid, SIGKILL) == 0) {
+            pids[k].killed = true;
+            killed++;
+        }
+    }
+    for (tries = 0; tries < 500; tries++) {
+        for (k = 0; k < npids; k++) {
+            char state = pids[k].killed ? proc_state(pids[k].pid, &ppid) : 0;
+            if (state != 0 && state != 'Z')
+                break;
+        }
+        if (k == npids)
+            break;
+        usleep(10000);
+    }
+    printf("evburst: killed %d\n", killed);
+}
+
+static void
+print_counts(void)
+{
+    unsigned long seen = 0, repeated = 0;
+    int k;
+    for (k = 0; k < npids; k++) {
+        if (pids[k].events > 0)
+            seen++;
+        if (pids[k].events > 1)
+            repeated++;
+    }
+    printf("evcount: forked %d seen %lu repeated %lu unknown %lu hidden %lu"
+           " lost %lu maxbatch %zu dropped %lu\n", npids, seen, repeated,
+           unknown, hidden_seen, lost, max_batch, shell->dropped_status_events());
+}
+
+static bool
+evcount_builtin(struct esh_command *cmd)
+{
+    if (strcmp(cmd->argv[0], "evcount") == 0)
+        print_counts();
+    else if (strcmp(cmd->argv[0], "evburst") == 0)
+        burst();
+    else
+        return false;
+    return true;
+}
+
+struct esh_plugin esh_module = {
+  .rank = 5,
+  .init = init_plugin,
+  .process_builtin = evcount_builtin,
+  .pipeline_forked = note_forked,
+  .command_status_batch = count_events
+};
@@ -0,0 +1,47 @@
+/*
+ * A plug-in that filters child status events, for events_test.py.
+ *
+ * Its command_status_change returns true for the commands named
+ * 'false', which hides their events from plugins of higher rank.
+ * 'evfilter' prints how many it hid.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "../esh.h"
+
+static unsigned long hidden;
+
+static bool
+init_plugin(struct esh_shell *shell)
+{
+    printf("Plugin 'eventfilter' initialized...\n");
+    return true;
+}
+
+static bool
+hide_false(struct esh_command *cmd, int waitstatus)
+{
+    if (strcmp(cmd->argv[0], "false"))
+        return false;
+
+    hidden++;
+    return true;
+}
+
+static bool
+evfilter_builtin(struct esh_command *cmd)
+{
+    if (strcmp(cmd->argv[0], "evfilter"))
+        return false;
+
+    printf("evfilter: hidden %lu\n", hidden);
+    return true;
+}
+
+struct esh_plugin esh_module = {
+  .rank = 4,
+  .init = init_plugin,
+  .process_builtin = evfilter_builtin,
+  .command_status_change = hide_false
+};
@@ -0,0 +1,118 @@
+#!/usr/bin/python
+#
+# Tests the delivery of child status events to plugins, with the
+# eventfilter and eventcount plugins: every exit of a background job
+# reaches eventcount's command_status_batch exactly once, unless
+# eventfilter's command_status_change hid it (for 'false') or the ring
+# of events was full, in which case it is counted as dropped.
+#
+import sys, imp, atexit, os
+sys.path.append("/home/courses/cs3214/software/pexpect-dpty/");
+import pexpect, shellio, signal, time, os, re, proc_check
+
+# Determine the path this file is in
+thisdir = os.path.dirname(os.path.realpath(__file__))
+
+#Ensure the shell process is terminated
+def force_shell_termination(shell_process):
+    c.close(force=True)
+
+# pulling in the regular expression and other definitions
+# this should be the eshoutput.py file of the hosting shell, see usage above
+definitions_scriptname = sys.argv[1]
+def_module = imp.load_source('', definitions_scriptname)
+
+# you can define logfile=open("log.txt", "w") in your eshoutput.py if you want logging!
+logfile = None
+if hasattr(def_module, 'logfile'):
+    logfile = def_module.logfile
+
+#spawn an instance of the shell, note the -p flags
+c = pexpect.spawn(def_module.shell,  drainpty=True, logfile=logfile, args=['-p', thisdir])
+
+atexit.register(force_shell_termination, shell_process=c)
+
+# set timeout for all following 'expect*' calls to 5 seconds
+c.timeout = 5
+
+assert c.expect("Plugin 'eventcount' initialized") == 0, "eventcount not loaded"
+
+counts_regex = ("evcount: forked (\d+) seen (\d+) repeated (\d+) unknown (\d+)"
+                " hidden (\d+) lost (\d+) maxbatch (\d+) dropped (\d+)")
+
+def evcount():
+    '''eventcount's numbers, by name'''
+    c.sendline("evcount")
+    assert c.expect(counts_regex) == 0, "evcount did not print its counts"
+    names = ["forked", "seen", "repeated", "unknown", "hidden", "lost",
+             "maxbatch", "dropped"]
+    return dict(zip(names, map(int, c.match.groups())))
+
+def evfilter():
+    '''The number of events eventfilter hid'''
+    c.sendline("evfilter")
+    assert c.expect("evfilter: hidden (\d+)") == 0, "evfilter did not print its count"
+    return int(c.match.group(1))
+
+def settle(done):
+    '''eventcount's numbers once done(numbers) holds, or after 10 s'''
+    for i in range(100):
+        n = evcount()
+        if done(n):
+            break
+        time.sleep(0.1)
+    return n
+
+#############################################################################
+# Test 1: each exit of many short background jobs is delivered exactly
+# once, and those of 'false' are hidden by eventfilter
+
+ntrue, nfalse = 0, 0
+for i in range(8):
+    c.sendline("true & " * 20 + "false & " * 5)
+    ntrue, nfalse = ntrue + 20, nfalse + 5
+
+n = settle(lambda n: n["forked"] == ntrue + nfalse and n["seen"] == ntrue)
+assert n["forked"] == ntrue + nfalse, "%d of %d jobs forked" % (n["forked"], ntrue + nfalse)
+assert n["seen"] == ntrue, "%d of %d exits delivered" % (n["seen"], ntrue)
+assert n["repeated"] == 0, "%d exits delivered more than once" % n["repeated"]
+assert n["unknown"] == 0, "%d events for processes not forked" % n["unknown"]
+assert n["hidden"] == 0, "%d events that eventfilter hid were delivered" % n["hidden"]
+assert n["dropped"] == 0, "%d events dropped" % n["dropped"]
+assert evfilter() == nfalse, "eventfilter did not hide the %d exits of false" % nfalse
+
+#############################################################################
+# Test 2: a burst of exits, more than the ring of events holds, while
+# the shell delivers none, is delivered in batches; what does not fit
+# is counted as dropped, and the rest is still delivered exactly once.
+# evburst kills the jobs at once, and waits until all are dead.
+
+ring = 1024             # ESH_EVENT_RING
+nburst = ring + 100
+before = n
+c.timeout = 60
+c.sendline("sleep 100 & " * nburst)
+n = settle(lambda n: n["forked"] == before["forked"] + nburst)
+assert n["forked"] == before["forked"] + nburst, \
+    "%d of %d jobs forked" % (n["forked"] - before["forked"], nburst)
+
+c.sendline("evburst")
+assert c.expect("evburst: killed (\d+)") == 0, "evburst did not run"
+assert int(c.match.group(1)) == nburst, \
+    "evburst killed %s of %d jobs" % (c.match.group(1), nburst)
+assert c.expect("esh: (\d+) child status events dropped") == 0, \
+    "the shell did not report dropped events"
+reported = int(c.match.group(1))
+c.timeout = 5
+
+n = settle(lambda n: n["seen"] + n["dropped"] == ntrue + nburst)
+assert n["dropped"] == reported == nburst - ring, \
+    "%d events dropped, %d reported, of %d over a ring of %d" \
+    % (n["dropped"], reported, nburst, ring)
+assert n["seen"] + n["dropped"] == ntrue + nburst, \
+    "%d exits delivered and %d dropped of %d" % (n["seen"], n["dropped"], ntrue + nburst)
+assert n["repeated"] == 0, "%d exits delivered more than once" % n["repeated"]
+assert n["unknown"] == 0 and n["lost"] == 0, "events for processes not followed"
+assert n["maxbatch"] > 1, "events were not delivered in batches"
+
+shellio.success()
@@ -0,0 +1,86 @@
+/*
+ * An example plug-in that runs long work as a virtual job.
+ *
+ * 'primes N' counts the primes up to N, by trial division.  The count
+ * runs on a worker thread of the shell, not in a process: with &, the
+ * prompt comes back at once, and jobs, stop, bg, fg and kill work on
+ * it as on any job.  In the foreground, ^C ends it and ^Z stops it.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../esh.h"
+#include "../esh-vjob.h"
+
+/* Numbers tried between checkpoints */
+#define CHECK_EVERY     4096
+
+static struct esh_shell *shell;
+
+static bool
+init_plugin(struct esh_shell *esh)
+{
+    shell = esh;
+    printf("Plugin 'primes' initialized...\n");
+    return true;
+}
+
+static bool
+is_prime(unsigned long n)
+{
+    if (n < 2)
+        return false;
+    if (n % 2 == 0)
+        return n == 2;
+    unsigned long d;
+    for (d = 3; d <= n / d; d += 2) {
+        if (n % d == 0)
+            return false;
+    }
+    return true;
+}
+
+/* The job: count, checking now and then whether to stop or end */
+static int
+count_primes(struct esh_vjob *vjob, void *arg)
+{
+    unsigned long limit = *(unsigned long *) arg, n, count = 0;
+    free(arg);
+
+    for (n = 2; n <= limit; n++) {
+        if (n % CHECK_EVERY == 0 && !esh_vjob_checkpoint(vjob))
+            return 1;
+        if (is_prime(n))
+            count++;
+    }
+    fprintf(esh_vjob_out(vjob), "%lu primes up to %lu\n", count, limit);
+    return 0;
+}
+
+/* Implement the primes built-in.
+ * Returns true if handled, false otherwise. */
+static bool
+primes_builtin(struct esh_command *cmd)
+{
+    if (strcmp(cmd->argv[0], "primes"))
+        return false;
+
+    if (cmd->argv[1] == NULL) {
+        printf("usage: primes N\n");
+        return true;
+    }
+    unsigned long *limit = malloc(sizeof *limit);
+    *limit = strtoul(cmd->argv[1], NULL, 10);
+    if (shell->submit_job(cmd, count_primes, limit) < 0) {
+        printf("primes: cannot start job\n");
+        free(limit);
+    }
+    return true;
+}
+
+struct esh_plugin esh_module = {
+  .rank = 3,
+  .init = init_plugin,
+  .process_builtin = primes_builtin
+};
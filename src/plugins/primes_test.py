@@ -0,0 +1,88 @@
+#!/usr/bin/python
+#
+# Tests the primes plugin, whose builtin runs as a virtual job.
+#
+import sys, imp, atexit, os
+sys.path.append("/home/courses/cs3214/software/pexpect-dpty/");
+import pexpect, shellio, signal, time, os, re, proc_check
+
+# Determine the path this file is in
+thisdir = os.path.dirname(os.path.realpath(__file__))
+
+#Ensure the shell process is terminated
+def force_shell_termination(shell_process):
+    c.close(force=True)
+
+# pulling in the regular expression and other definitions
+# this should be the eshoutput.py file of the hosting shell, see usage above
+definitions_scriptname = sys.argv[1]
+def_module = imp.load_source('', definitions_scriptname)
+
+# you can define logfile=open("log.txt", "w") in your eshoutput.py if you want logging!
+logfile = None
+if hasattr(def_module, 'logfile'):
+    logfile = def_module.logfile
+
+#spawn an instance of the shell, note the -p flags
+c = pexpect.spawn(def_module.shell,  drainpty=True, logfile=logfile, args=['-p', thisdir])
+
+atexit.register(force_shell_termination, shell_process=c)
+
+# set timeout for all following 'expect*' calls to 5 seconds
+c.timeout = 5
+
+#############################################################################
+# Now the real test starts!
+#
+
+#############################################################################
+# Test 1: In the foreground, the result is printed when it is done
+
+c.sendline("primes 100000")
+
+assert c.expect("9592 primes up to 100000") == 0, "Shell did not count correctly"
+
+#############################################################################
+# Test 2: With &, the prompt comes back, and the result is reported
+# once the job is done
+
+c.sendline("primes 100000 &")
+
+assert c.expect("\[(\d+)\] virtual") == 0, "Shell did not start a virtual job"
+
+assert c.expect("Done.*\r\n9592 primes up to 100000") == 0, \
+    "Shell did not report the virtual job"
+
+#############################################################################
+# Test 3: stop, bg and kill act on a virtual job
+
+c.sendline("primes 4000000000 &")
+
+assert c.expect("\[(\d+)\] virtual") == 0, "Shell did not start a virtual job"
+jid = c.match.group(1)
+
+c.sendline("stop " + jid)
+c.sendline("jobs")
+
+assert c.expect("Stopped") == 0, "Virtual job did not stop"
+
+c.sendline("bg " + jid)
+c.sendline("jobs")
+
+assert c.expect("Running") == 0, "Virtual job did not continue"
+
+c.sendline("kill " + jid)
+
+assert c.expect("Killed") == 0, "Virtual job was not killed"
+
+#############################################################################
+# Test 4: ^C ends a virtual job in the foreground
+
+c.sendline("primes 4000000000")
+time.sleep(0.5)
+c.sendintr()
+c.sendline("echo alive")
+
+assert c.expect("alive") == 0, "Shell did not come back after ^C"
+
+shellio.success()
@@ -0,0 +1,40 @@
+/*
+ * A plug-in with a slow hook, for slowhook_test.py.
+ *
+ * 'slow MS' sleeps for MS milliseconds inside process_builtin, so that
+ * the call shows up in the 'plugins' builtin, and is reported when
+ * the plugin has a smaller budget.  Other commands return at once.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../esh.h"
+
+static bool
+init_plugin(struct esh_shell *shell)
+{
+    printf("Plugin 'slowhook' initialized...\n");
+    return true;
+}
+
+static bool
+slow_builtin(struct esh_command *cmd)
+{
+    if (strcmp(cmd->argv[0], "slow"))
+        return false;
+
+    long ms = cmd->argv[1] ? atol(cmd->argv[1]) : 100;
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) == -1)
+        ;
+    printf("slept %ld ms\n", ms);
+    return true;
+}
+
+struct esh_plugin esh_module = {
+  .rank = 1,
+  .init = init_plugin,
+  .process_builtin = slow_builtin
+};
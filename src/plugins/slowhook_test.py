@@ -0,0 +1,92 @@
+#!/usr/bin/python
+#
+# Tests the 'plugins' builtin, which shows what the hooks of each plugin
+# cost, and plugin budgets, with the slowhook plugin: 'slow MS' takes
+# MS milliseconds in its process_builtin hook.
+#
+import sys, imp, atexit, os
+sys.path.append("/home/courses/cs3214/software/pexpect-dpty/");
+import pexpect, shellio, signal, time, os, re, proc_check
+
+# Determine the path this file is in
+thisdir = os.path.dirname(os.path.realpath(__file__))
+
+#Ensure the shell process is terminated
+def force_shell_termination(shell_process):
+    c.close(force=True)
+
+# pulling in the regular expression and other definitions
+# this should be the eshoutput.py file of the hosting shell, see usage above
+definitions_scriptname = sys.argv[1]
+def_module = imp.load_source('', definitions_scriptname)
+
+# you can define logfile=open("log.txt", "w") in your eshoutput.py if you want logging!
+logfile = None
+if hasattr(def_module, 'logfile'):
+    logfile = def_module.logfile
+
+#spawn an instance of the shell, note the -p flags
+c = pexpect.spawn(def_module.shell,  drainpty=True, logfile=logfile, args=['-p', thisdir])
+
+atexit.register(force_shell_termination, shell_process=c)
+
+# set timeout for all following 'expect*' calls to 5 seconds
+c.timeout = 5
+
+budget_warning = "plugin slowhook: process_builtin took ([\d.]+) ms \(budget ([\d.]+) ms\)"
+
+#############################################################################
+# Test 1: 'plugins' lists the plugin, where it was loaded from, and the
+# calls of its hook with their cost
+
+c.sendline("slow 50")
+assert c.expect("slept 50 ms") == 0, "slow did not run"
+c.sendline("slow 50")
+assert c.expect("slept 50 ms") == 0, "slow did not run"
+
+c.sendline("plugins")
+assert c.expect("slowhook  rank 1  loaded in [\d.]+ ms  \S*slowhook.so\r\n") == 0, \
+    "plugins did not list slowhook"
+assert c.expect("process_builtin +(\d+) calls [^\r\n]* max +([\d.]+) ms") == 0, \
+    "plugins did not show the process_builtin hook of slowhook"
+calls, max_ms = int(c.match.group(1)), float(c.match.group(2))
+assert calls >= 2, "plugins counted %d calls of process_builtin" % calls
+assert max_ms >= 50, "plugins gave a maximum of %.3f ms for 'slow 50'" % max_ms
+
+#############################################################################
+# Test 2: with a budget, a call over it is reported, and one under it
+# is not
+
+c.sendline("plugins budget slowhook 20")
+c.sendline("slow 60")
+assert c.expect("slept 60 ms") == 0, "slow did not run"
+assert c.expect(budget_warning) == 0, "a call over the budget was not reported"
+took, budget = float(c.match.group(1)), float(c.match.group(2))
+assert took >= 60 and budget == 20, \
+    "the call was reported as %.3f ms over %.3f ms" % (took, budget)
+
+c.sendline("slow 1")
+assert c.expect("slept 1 ms") == 0, "slow did not run"
+c.sendline("echo under-budget | tr a-z A-Z")
+assert c.expect("UNDER-BUDGET") == 0, "echo did not run"
+assert "took" not in c.before, "a call under the budget was reported"
+
+c.sendline("plugins")
+assert c.expect("slowhook  rank 1 [^\r\n]*  budget 20.000 ms\r\n") == 0, \
+    "plugins did not show the budget"
+
+#############################################################################
+# Test 3: a budget of 0 removes it, and an unknown plugin is an error
+
+c.sendline("plugins budget slowhook 0")
+c.sendline("slow 30")
+assert c.expect("slept 30 ms") == 0, "slow did not run"
+c.sendline("echo no-budget | tr a-z A-Z")
+assert c.expect("NO-BUDGET") == 0, "echo did not run"
+assert "took" not in c.before, "a call was reported after the budget was removed"
+
+c.sendline("plugins budget nosuchplugin 5")
+assert c.expect("plugins: nosuchplugin: no such plugin") == 0, \
+    "an unknown plugin was not reported"
+
+shellio.success()